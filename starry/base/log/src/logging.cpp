@@ -1,4 +1,4 @@
-#include <bits/chrono.h>
+#include <time.h>
 #include <chrono>
 #include <cmath>
 #include <cstdlib>
@@ -28,11 +28,22 @@ Logger::OutputFunc Logger::g_output = [](const char* msg, int len) {
 // 默认同步刷新
 Logger::FlushFunc Logger::g_flush = [] { std::cout.flush(); };
 
+// 日志只精确到秒，用粗粒度的系统时钟，同一秒内复用格式化好的时间
+thread_local time_t t_lastSecond = 0;
+thread_local char t_time[32];
+thread_local size_t t_timeLength = 0;
+
 Logger::Logger(LogLevel level, const std::source_location& loc)
     : level_(level), stream_(), location_(loc) {
-  auto time_c = std::chrono::time_point_cast<std::chrono::seconds>(
-      std::chrono::system_clock::now());
-  stream_ << std::format("{:%F %T }", time_c);
+  struct timespec ts;
+  ::clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+  if (ts.tv_sec != t_lastSecond || t_timeLength == 0) {
+    t_lastSecond = ts.tv_sec;
+    auto time_c = std::chrono::sys_seconds(std::chrono::seconds(ts.tv_sec));
+    t_timeLength = static_cast<size_t>(
+        std::format_to_n(t_time, sizeof(t_time), "{:%F %T }", time_c).size);
+  }
+  stream_.append(std::string_view(t_time, t_timeLength));
   stream_ << "[" << std::this_thread::get_id() << "] " << levelToString(level_);
 }
 
@@ -10,22 +10,33 @@
 #include <string>
 #include <string_view>
 #include <utility>
-#include <vector>
+#include "buffer_slice.h"
+#include "delimiter_search.h"
 
 namespace starry {
 
+class BufferPool;
+
 class Buffer {
  public:
   static const size_t kCheapPrepend = 8;     // 预留空间
   static const size_t kInitialSize = 1024;  // 初始化大小
-  explicit Buffer(size_t initialSize = kInitialSize)
-      : buffer_(kCheapPrepend + initialSize),
-        readerIndex_(kCheapPrepend),
-        writerIndex_(kCheapPrepend) {}
+  explicit Buffer(size_t initialSize = kInitialSize);
+  // 从 pool 申请存储，第一次写入时才申请
+  explicit Buffer(BufferPool* pool);
+  ~Buffer();
+
+  Buffer(const Buffer& rhs);
+  Buffer& operator=(const Buffer& rhs);
+  Buffer(Buffer&& rhs) noexcept;
+  Buffer& operator=(Buffer&& rhs) noexcept;
 
   // 交换空间
   void swap(Buffer& rhs) {
-    buffer_.swap(rhs.buffer_);
+    std::swap(buffer_, rhs.buffer_);
+    std::swap(capacity_, rhs.capacity_);
+    std::swap(pool_, rhs.pool_);
+    std::swap(shared_, rhs.shared_);
     std::swap(readerIndex_, rhs.readerIndex_);
     std::swap(writerIndex_, rhs.writerIndex_);
   }
@@ -33,7 +44,7 @@ class Buffer {
   // 可读字节数
   size_t readableBytes() const { return writerIndex_ - readerIndex_; }
   // 可写字节数
-  size_t writableBytes() const { return buffer_.size() - writerIndex_; }
+  size_t writableBytes() const { return capacity_ - writerIndex_; }
   // 读指针前面的字节数
   size_t prependableBytes() const { return readerIndex_; }
   // 读指针
@@ -42,27 +53,48 @@ class Buffer {
   char* beginWrite() { return begin() + writerIndex_; }
 
   // 查找换行符 \r\n
-  const char* findCRLF() const {
-    const char* crlf = std::search(peek(), beginWrite(), kCRLF, kCRLF + 2);
-    return crlf == beginWrite() ? nullptr : crlf;
-  }
+  const char* findCRLF() const { return find(std::string_view(kCRLF, 2)); }
   // 查找换行符 \r\n
   const char* findCRLF(const char* start) const {
-    assert(peek() <= start);
-    assert(start <= beginWrite());
-    const char* crlf = std::search(start, beginWrite(), kCRLF, kCRLF + 2);
-    return crlf == beginWrite() ? nullptr : crlf;
+    return find(start, std::string_view(kCRLF, 2));
   }
-  // 查找换行符 \n
-  const char* findEOL() const {
-    const void* eol = memchr(peek(), '\n', readableBytes());
-    return static_cast<const char*>(eol);
+  // 查找换行符 \r\n，可续扫，见 find(token, scanned)
+  const char* findCRLF(size_t* scanned) const {
+    return find(std::string_view(kCRLF, 2), scanned);
   }
   // 查找换行符 \n
+  const char* findEOL() const { return find(std::string_view("\n", 1)); }
+  // 查找换行符 \n
   const char* findEOL(const char* start) const {
-    const void* eol =
-        memchr(start, '\n', static_cast<size_t>(beginWrite() - start));
-    return static_cast<const char*>(eol);
+    return find(start, std::string_view("\n", 1));
+  }
+  // 查找换行符 \n，可续扫，见 find(token, scanned)
+  const char* findEOL(size_t* scanned) const {
+    return find(std::string_view("\n", 1), scanned);
+  }
+
+  // 查找 token，使用启动时按 CPU 选出的 SIMD 内核
+  const char* find(std::string_view token) const {
+    return search::find(peek(), beginWrite(), token);
+  }
+  // 从 start 开始查找 token
+  const char* find(const char* start, std::string_view token) const {
+    assert(peek() <= start);
+    assert(start <= beginWrite());
+    return search::find(start, beginWrite(), token);
+  }
+  // 可续扫的查找：*scanned 是相对 peek() 的偏移，之前的字节已确认不含 token
+  // 找不到时把 *scanned 推进到下次需要开始扫描的位置，半帧数据不会被重复扫描
+  // 找到时 *scanned 是 token 的偏移；调用方 retrieve(n) 后要把 *scanned 减去 n
+  const char* find(std::string_view token, size_t* scanned) const {
+    assert(*scanned <= readableBytes());
+    const char* found = search::find(peek() + *scanned, beginWrite(), token);
+    if (found) {
+      *scanned = static_cast<size_t>(found - peek());
+    } else if (readableBytes() >= token.size()) {
+      *scanned = readableBytes() - token.size() + 1;
+    }
+    return found;
   }
 
   // 移动 readerIndex_ 指向的位置
@@ -100,6 +132,16 @@ class Buffer {
     retrieve(len);
     return result;
   }
+  // 把前 len 个字节作为切片，不拷贝，也不移动读指针
+  BufferSlice peekAsSlice(size_t len);
+  // 取出长度为 len 的数据作为切片，不拷贝，切片和 Buffer 共享存储
+  BufferSlice retrieveAsSlice(size_t len) {
+    BufferSlice slice = peekAsSlice(len);
+    retrieve(len);
+    return slice;
+  }
+  // 取出所有数据作为切片
+  BufferSlice retrieveAllAsSlice() { return retrieveAsSlice(readableBytes()); }
 
   // 添加长度为 len 的数据 data
   void append(const char* data, size_t len) {
@@ -120,6 +162,13 @@ class Buffer {
     assert(writableBytes() >= len);
   }
 
+  // 按存储的总大小预留空间，kCheapPrepend 算在 size 里面，可写 size - kCheapPrepend；
+  // size 取 BufferPool 的分级时正好占一个块，不会因为预留空间升到下一级
+  void ensureStorage(size_t size) {
+    assert(size > kCheapPrepend);
+    ensureWritableBytes(size - kCheapPrepend);
+  }
+
   // 移动 writerIndex_
   void hasWritten(size_t len) {
     assert(len <= writableBytes());
@@ -127,7 +176,11 @@ class Buffer {
   }
 
   // 移动 readerIndex_ writerIndex_
+  // 存储还被切片引用时不能复用，交给切片，下次写入时重新申请
   void retrieveAll() {
+    if (shared_) {
+      releaseShared();
+    }
     readerIndex_ = kCheapPrepend;
     writerIndex_ = kCheapPrepend;
   }
@@ -221,6 +274,11 @@ class Buffer {
   void prependInt8(int8_t x) { prepend(&x, sizeof x); }
 
   void prepend(const void* data, size_t len) {
+    if (!hasStorage()) {
+      allocateStorage(kInitialSize - kCheapPrepend);  // 正好一个最小的块
+    } else if (isShared()) {
+      reallocate(capacity_);  // 读指针前面的数据可能被切片引用
+    }
     assert(len <= prependableBytes());
     readerIndex_ -= len;
     const char* d = static_cast<const char*>(data);
@@ -229,42 +287,46 @@ class Buffer {
 
   // 整理空间
   void shrink(size_t reserve) {
-    Buffer other;
+    Buffer other(pool_);
     other.ensureWritableBytes(readableBytes() + reserve);
-    other.append(retrieveAllAsString());
+    other.append(peek(), readableBytes());
     swap(other);
   }
 
+  // 没有可读数据时把存储归还给 pool，下次写入时再申请
+  bool releaseIfEmpty();
+  // 是否持有存储
+  bool hasStorage() const { return buffer_ != kEmptyStorage; }
+
   // 增加容量
-  size_t internalCapacity() const { return buffer_.capacity(); }
+  size_t internalCapacity() const { return capacity_; }
 
+  // 读 fd，超出可写空间的部分先读到栈上的备用缓冲区
   ssize_t readFd(int fd, int* savedErrno);
+  // 读 fd，超出可写空间的部分先读到调用方提供的 extrabuf
+  ssize_t readFd(int fd, int* savedErrno, char* extrabuf, size_t extraLen);
 
  private:
-  char* begin() { return buffer_.data(); }              // buffer 的指针
-  const char* begin() const { return buffer_.data(); }  // buffer 的指针
+  char* begin() { return buffer_; }              // buffer 的指针
+  const char* begin() const { return buffer_; }  // buffer 的指针
 
-  // 增加空间
-  void makeSpace(size_t len) {
-    if (writableBytes() + prependableBytes() < len + kCheapPrepend) {
-      buffer_.resize(writerIndex_ + len);
-    } else {
-      assert(kCheapPrepend < readableBytes());
-      size_t readable = readableBytes();
-      std::copy(begin() + readerIndex_, begin() + writerIndex_,
-                begin() + kCheapPrepend);
-      readerIndex_ = kCheapPrepend;
-      writerIndex_ = readerIndex_ + readable;
-      assert(readable == readableBytes());
-    }
-  }
+  void allocateStorage(size_t size);  // 申请 kCheapPrepend + size 的存储
+  void freeStorage();                 // 归还存储
+  void makeSpace(size_t len);         // 增加空间
+  void reallocate(size_t size);       // 换一块 size 大小的存储，只搬可读数据
+  bool isShared();                    // 存储是否还被切片引用
+  void releaseShared();               // 把存储留给切片，自己回到无存储状态
 
  private:
-  std::vector<char> buffer_;  // buffer
-  size_t readerIndex_;        // 读指针
-  size_t writerIndex_;        // 写指针
+  char* buffer_;         // buffer
+  size_t capacity_;      // buffer 的大小
+  BufferPool* pool_;     // 存储来源，为空时直接 new/delete
+  SharedBlock* shared_;  // 切过片后存储由它管理，否则为空
+  size_t readerIndex_;   // 读指针
+  size_t writerIndex_;   // 写指针
 
-  static const char kCRLF[];  // /r/n
+  static const char kCRLF[];                 // /r/n
+  static char kEmptyStorage[kCheapPrepend];  // 没有存储时指向这里
 };
 
 }  // namespace starry
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace starry {
+
+// 每个 EventLoop 一个的分级内存池，Buffer 和 ChainBuffer 的存储都从这里申请
+// 按 2 的幂分级缓存空闲块，只在所属线程里复用，其他线程归还的块直接释放
+// 从 pool 的存储切出的切片持有 pool 的 shared_ptr，所以要切片的 pool 必须由 shared_ptr 持有
+class BufferPool : public std::enable_shared_from_this<BufferPool> {
+ public:
+  static const size_t kMinBlockSize = 1024;       // 最小的分级 1 KiB
+  static const size_t kMaxBlockSize = 64 * 1024;  // 最大的分级 64 KiB
+  static const size_t kNumClasses = 7;            // 1K 2K 4K ... 64K
+  static const size_t kDefaultMaxCachedBytes = 4 * 1024 * 1024;
+
+  // 统计信息，可以在其他线程读取
+  struct Stats {
+    size_t allocations;  // 申请次数
+    size_t hits;         // 从空闲链表中命中的次数
+    size_t releases;     // 归还次数
+    size_t bytesInUse;   // 正在使用的字节数
+    size_t bytesCached;  // 空闲链表中缓存的字节数
+  };
+
+  BufferPool();
+  ~BufferPool();
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  // 申请至少 size 字节的块，实际大小写到 *capacity
+  char* allocate(size_t size, size_t* capacity);
+  // 归还 allocate 得到的块，capacity 是 allocate 返回的实际大小
+  void deallocate(char* block, size_t capacity);
+
+  // 空闲块缓存的上限
+  void setMaxCachedBytes(size_t bytes) { maxCachedBytes_ = bytes; }
+  // 连接的缓冲区空闲多久后归还到池里，0 表示读写完立即归还
+  void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
+  double idleTimeout() const { return idleTimeout_; }
+
+  Stats stats() const;
+
+ private:
+  static size_t classIndex(size_t size);  // size 对应的分级
+  bool isInOwnerThread() const {
+    return ownerThread_ == std::this_thread::get_id();
+  }
+
+  const std::thread::id ownerThread_;                  // 所属线程
+  std::array<std::vector<char*>, kNumClasses> free_;  // 每一级的空闲块
+  size_t maxCachedBytes_;                              // 缓存上限
+  double idleTimeout_;                                 // 空闲归还时间
+
+  std::atomic<size_t> allocations_;
+  std::atomic<size_t> hits_;
+  std::atomic<size_t> releases_;
+  std::atomic<size_t> bytesInUse_;
+  std::atomic<size_t> bytesCached_;
+};
+
+}  // namespace starry
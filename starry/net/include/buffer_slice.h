@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace starry {
+
+class BufferPool;
+
+// 被切片共享的存储块，引用计数归零时把存储归还给 pool
+// 只有被切过片的 Buffer 才会创建，平时 Buffer 独占存储，没有这层开销
+// 持有 pool 的引用，切片交给其他线程后比 EventLoop 活得久也能安全归还
+class SharedBlock {
+ public:
+  // 创建时引用计数为 0，由持有者各自 ref()；pool 必须由 shared_ptr 持有
+  static SharedBlock* create(char* data, size_t capacity, BufferPool* pool);
+
+  void ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+  // 最后一个引用释放时归还存储并删除自己
+  void unref();
+  // 是否只剩一个引用，可以在任意线程释放切片之后调用
+  bool unique() const { return refs_.load(std::memory_order_acquire) == 1; }
+
+  char* data() const { return data_; }
+  size_t capacity() const { return capacity_; }
+
+ private:
+  SharedBlock(char* data, size_t capacity, std::shared_ptr<BufferPool> pool)
+      : refs_(0), data_(data), capacity_(capacity), pool_(std::move(pool)) {}
+
+  std::atomic<int> refs_;             // 引用计数
+  char* data_;                        // 存储
+  size_t capacity_;                   // 存储大小
+  std::shared_ptr<BufferPool> pool_;  // 存储来源，为空时 delete[]
+};
+
+// 只读的引用计数切片，从 Buffer 中切出时不拷贝数据
+// 可以在回调返回后继续持有，也可以交给其他线程或其他 loop 发送，
+// 来自 pool 的切片让 pool 一直活到最后一个切片释放
+class BufferSlice {
+ public:
+  static const size_t npos = static_cast<size_t>(-1);
+
+  BufferSlice() : block_(nullptr), data_(nullptr), size_(0) {}
+  // 引用 block 中 [data, data + size) 的数据
+  BufferSlice(SharedBlock* block, const char* data, size_t size);
+  ~BufferSlice() { reset(); }
+
+  BufferSlice(const BufferSlice& rhs);
+  BufferSlice& operator=(const BufferSlice& rhs);
+  BufferSlice(BufferSlice&& rhs) noexcept;
+  BufferSlice& operator=(BufferSlice&& rhs) noexcept;
+
+  // 拷贝一份数据生成切片，用于 std::string 等没有共享存储的数据
+  static BufferSlice copyOf(std::string_view data);
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  std::string_view view() const { return std::string_view(data_, size_); }
+  std::string toString() const { return std::string(data_, size_); }
+
+  // 从 offset 开始、长度为 len 的子切片，共享同一块存储
+  BufferSlice subslice(size_t offset, size_t len = npos) const;
+  // 丢弃前 n 个字节
+  void removePrefix(size_t n);
+  // 释放引用
+  void reset();
+
+ private:
+  SharedBlock* block_;  // 存储块
+  const char* data_;    // 数据起始
+  size_t size_;         // 数据长度
+};
+
+}  // namespace starry
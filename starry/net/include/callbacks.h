@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <functional>
 #include <memory>
+#include "inline_function.h"
 #include "types.h"
 namespace starry {
 
@@ -21,12 +22,20 @@ class Buffer;
 class TcpConnection;
 using Timestamp = std::chrono::system_clock::time_point;
 using Clock = std::chrono::system_clock;
+// 单调时钟，定时器和超时都用它，不受 NTP 调整系统时间的影响
+using MonoClock = std::chrono::steady_clock;
+using MonoTime = MonoClock::time_point;
 using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
 #include <functional>
-using TimerCallback = std::function<void()>;
+// 定时器回调只在 loop 线程移动和调用，用不分配内存的 InlineFunction
+using TimerCallback = InlineFunction<void()>;
+// 连接回调由 TcpServer/TcpClient 复制给每个连接，保持可复制的 std::function
 using ConnectionCallback = std::function<void(const TcpConnectionPtr&)>;
 using CloseCallback = std::function<void(const TcpConnectionPtr&)>;
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr&)>;
+// 迁移结束后在新 loop 调用，migrated 为 false 表示连接已经不在已连接状态，没有迁移
+using MigrateCallback =
+    std::function<void(const TcpConnectionPtr&, bool migrated)>;
 using HighWaterMarkCallback =
     std::function<void(const TcpConnectionPtr&, size_t)>;
 using MessageCallback =
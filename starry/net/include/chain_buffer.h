@@ -0,0 +1,90 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "buffer_slice.h"
+
+struct iovec;
+
+namespace starry {
+
+class BufferPool;
+
+// 由定长分段组成的链式缓冲区，用作 TcpConnection 的发送缓冲区
+// append 只写尾段，retrieve 只移动头段的读指针，已有数据永远不会被搬移
+class ChainBuffer {
+ public:
+  static const size_t kSegmentSize = 16 * 1024;  // 每个分段的大小
+  static const int kMaxIovecs = 64;              // 一次 writev 最多的分段数
+  static const size_t kMinSliceSize = 1024;      // 更小的切片直接拷贝
+
+  // 分段从 pool 申请，为空时直接 new/delete
+  explicit ChainBuffer(BufferPool* pool = nullptr)
+      : pool_(pool), readable_(0) {}
+  ~ChainBuffer();
+
+  ChainBuffer(const ChainBuffer&) = delete;
+  ChainBuffer& operator=(const ChainBuffer&) = delete;
+
+  // 之后的分段从 pool 申请，已有的分段仍然归还给申请它的 pool
+  void setPool(BufferPool* pool) { pool_ = pool; }
+
+  // 可读字节数
+  size_t readableBytes() const { return readable_; }
+  // 持有的分段数
+  size_t segmentCount() const { return segments_.size(); }
+
+  // 添加长度为 len 的数据 data
+  void append(const char* data, size_t len);
+  void append(const void* data, size_t len) {
+    append(static_cast<const char*>(data), len);
+  }
+  void append(const std::string_view data) { append(data.data(), data.size()); }
+  // 添加切片，较大的切片直接挂到链上，不拷贝
+  void append(const BufferSlice& slice);
+
+  // 丢弃前 len 个字节，读完的分段归还到 pool
+  void retrieve(size_t len);
+  // 丢弃所有数据
+  void retrieveAll();
+  // 取出所有数据，主要用于测试
+  std::string retrieveAllAsString();
+
+  // 用可读数据填充 iov，最多 maxIov 个，返回填充的个数
+  int fillIovec(struct iovec* iov, int maxIov) const;
+  // 用 writev 把数据写到 fd，并丢弃已写的字节
+  ssize_t writeFd(int fd, int* savedErrno);
+  // 同上，最多写 maxBytes 个字节
+  ssize_t writeFd(int fd, int* savedErrno, size_t maxBytes);
+  // 头部连续的切片分段的字节数
+  size_t borrowedPrefixBytes() const;
+  // 用 sendmsg(MSG_ZEROCOPY) 发送头部连续的切片分段，已发出部分的切片追加到
+  // pinned，内核确认发送完成之前这些数据不能释放
+  ssize_t writeFdZeroCopy(int fd,
+                          int* savedErrno,
+                          std::vector<BufferSlice>* pinned);
+
+ private:
+  struct Segment {
+    char* data;         // 分段内存
+    size_t readIndex;   // 读指针
+    size_t writeIndex;  // 写指针
+    BufferSlice slice;  // 切片分段持有的引用，普通分段为空
+    BufferPool* pool;   // 申请分段的 pool
+
+    bool borrowed() const { return !slice.empty(); }  // 是否是切片分段
+  };
+
+  char* allocateSegment();
+  void freeSegment(const Segment& seg);
+
+  BufferPool* pool_;              // 分段的来源
+  std::deque<Segment> segments_;  // 分段链
+  size_t readable_;               // 可读字节总数
+};
+
+}  // namespace starry
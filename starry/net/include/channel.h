@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <functional>
 #include <memory>
 #include "callbacks.h"
@@ -10,9 +11,15 @@ class EventLoop;
 
 class Channel {
  public:
-  using EventCallback = std::function<void()>;
-  using ReadEventCallback =
-      std::function<void(Timestamp)>;
+  using EventCallback = InlineFunction<void()>;
+  using ReadEventCallback = InlineFunction<void(Timestamp)>;
+
+  // poller 直接收数据时这一轮的结果，读回调用 takeReceived 取走
+  struct Received {
+    size_t bytes = 0;  // 追加到接收缓冲区的字节数
+    int error = 0;     // 收数据出错时的 errno
+    bool eof = false;  // 对端关闭了写
+  };
 
   Channel(EventLoop* loop, int fd);
   ~Channel();
@@ -31,7 +38,7 @@ class Channel {
   int fd() const { return fd_; } 
   int events() const {return events_; }
   void setRevent(int revents) { revents_ = revents; }
-  bool isNoneEvent() const { return events_ == kNoneEvent; }
+  bool isNoneEvent() const { return (events_ & ~kEdgeTriggered) == kNoneEvent; }
   EventLoop* ownerLoop() { return loop_;}
   void remove();
   void enableReading() { events_ |= kReadEvent; update(); }
@@ -41,10 +48,26 @@ class Channel {
   void disableAll() { events_ = kNoneEvent; update(); }
   bool isWriting() const { return events_ & kWriteEvent; }
   bool isReading() const {return events_ & kReadEvent; }
+  void enableReadingAndWriting() { events_ |= kReadEvent | kWriteEvent; update(); }
+  // 边缘触发，在第一次 enable 之前设置
+  void setEdgeTriggered(bool on) {
+    events_ = on ? (events_ | kEdgeTriggered) : (events_ & ~kEdgeTriggered);
+  }
+  bool edgeTriggered() const { return events_ & kEdgeTriggered; }
 
-  // 同层epool调用
-  int index() { return index_; }
-  void setIndex(int idx) { index_ = idx; }
+  // 接收缓冲区，在第一次 enable 之前设置：poller 能直接收数据时（io_uring 的
+  // multishot recv）把数据追加到 buffer，再以 EPOLLIN 调用读回调，读回调不再 read；
+  // 是否接管由 poller 在注册时决定，见 receivedByPoller
+  void setReceiveBuffer(Buffer* buffer) { receiveBuffer_ = buffer; }
+  Buffer* receiveBuffer() const { return receiveBuffer_; }
+  void setReceivedByPoller(bool on) { receivedByPoller_ = on; }
+  bool receivedByPoller() const { return receivedByPoller_; }
+  Received* received() { return &received_; }
+  Received takeReceived() {
+    Received received = received_;
+    received_ = Received();
+    return received;
+  }
 
   // 方便调试
   std::string reventsToString() const;
@@ -60,17 +83,20 @@ class Channel {
   static const int kNoneEvent;   // 无事件
   static const int kReadEvent;   // 读事件
   static const int kWriteEvent;  // 写事件
+  static const int kEdgeTriggered;  // 边缘触发标志
 
   EventLoop* loop_;  // 该Channel符所属的 loop
   const int fd_;     // 当前Channel的文件描述符
   int events_;       // 监测的事件
   int revents_;      // epoll触发的事件
-  int index_;        // 代表Channel状态，epoll设定了kNew,kAdded,kDeleted
 
   std::weak_ptr<void> tie_;  // 使用shared_ptr保证TcpConnection的生命周期
   bool tied_;                // 是否成功绑定TcpConnection
   bool eventHandling_;       // 是否正在处理文件描述符
   bool addedToLoop_;         // 是否加入到loop
+  bool receivedByPoller_;    // 读是否由 poller 接管
+  Buffer* receiveBuffer_;    // poller 直接收数据时追加到这里
+  Received received_;        // poller 收到、读回调还没取走的结果
   ReadEventCallback readCallback_;  // 读回调
   EventCallback writeCallback_;     // 写回调
   EventCallback closeCallback_;     // 关闭回调
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace starry {
+
+class Channel;
+
+// 以 fd 为下标的 channel 表，poller 用它代替 std::map<int, Channel*>
+// fd 总是取最小的可用值，表是稠密的，查找、注册和移除都是一次数组访问；
+// 按需倍增，不收缩，大小由同时打开的最大 fd 决定
+class ChannelTable {
+ public:
+  // poller 记录的 channel 状态，和指针放在一起
+  struct Entry {
+    Channel* channel;  // 为空表示这个 fd 没有注册
+    int state;         // 由 poller 解释，没有注册时为 kNoState
+  };
+
+  static constexpr int kNoState = -1;
+  static constexpr size_t kInitialSize = 64;
+
+  ChannelTable() : entries_(kInitialSize, Entry{nullptr, kNoState}), size_(0) {}
+
+  // fd 上注册的 channel，没有时返回 nullptr
+  Channel* channel(int fd) const {
+    return inRange(fd) ? entries_[fd].channel : nullptr;
+  }
+
+  // fd 的表项，没有注册时返回 nullptr
+  Entry* find(int fd) {
+    return inRange(fd) && entries_[fd].channel != nullptr ? &entries_[fd]
+                                                           : nullptr;
+  }
+
+  // 注册 fd，表不够大时倍增
+  Entry* insert(int fd, Channel* channel, int state) {
+    assert(fd >= 0 && channel != nullptr);
+    if (static_cast<size_t>(fd) >= entries_.size()) {
+      size_t n = entries_.size() * 2;
+      while (n <= static_cast<size_t>(fd)) {
+        n *= 2;
+      }
+      entries_.resize(n, Entry{nullptr, kNoState});
+    }
+    Entry* entry = &entries_[fd];
+    assert(entry->channel == nullptr);
+    entry->channel = channel;
+    entry->state = state;
+    ++size_;
+    return entry;
+  }
+
+  void erase(int fd) {
+    assert(find(fd) != nullptr);
+    entries_[fd] = Entry{nullptr, kNoState};
+    --size_;
+  }
+
+  // 注册的 channel 数
+  size_t size() const { return size_; }
+  // 表的容量，调试和测试用
+  size_t capacity() const { return entries_.size(); }
+
+ private:
+  bool inRange(int fd) const {
+    return fd >= 0 && static_cast<size_t>(fd) < entries_.size();
+  }
+
+  std::vector<Entry> entries_;  // 下标是 fd
+  size_t size_;                 // 注册的 channel 数
+};
+
+}  // namespace starry
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace starry::search {
+
+// 查找内核，启动时按 CPUID 选择最快的可用实现
+enum class Kernel { kScalar, kSse2, kAvx2 };
+
+// 在 [begin, end) 中查找 token 第一次出现的位置，找不到返回 nullptr
+const char* find(const char* begin, const char* end, std::string_view token);
+// 用指定的内核查找，用于测试和性能对比
+const char* find(Kernel kernel,
+                 const char* begin,
+                 const char* end,
+                 std::string_view token);
+
+Kernel activeKernel();             // 当前使用的内核
+bool kernelSupported(Kernel kernel);  // 当前 CPU 是否支持该内核
+const char* kernelName(Kernel kernel);
+
+}  // namespace starry::search
@@ -1,30 +1,24 @@
 #pragma once
 
-#include <map>
+#include <string>
 #include <vector>
-#include "channel.h"
-#include "eventloop.h"
+#include "poller.h"
 
-class Channel;
+struct epoll_event;
 
 namespace starry {
 
-class EpollPoller {
+class EpollPoller : public Poller {
  public:
-  using ChannelList = std::vector<Channel*>;
-  EpollPoller(EventLoop* loop);
-  ~EpollPoller();
-
-  Timestamp poll(int timeoutMs, ChannelList* activeChannels);
-  void updateChannel(Channel* channel);
-  void removeChannel(Channel* channel);
-  bool hasChannel(Channel* channel) const;
-  void assertInLoopThread() const {  // 断言是否在同一个线程
-    ownerLoop_->assertInLoopThread();
-  }
+  explicit EpollPoller(EventLoop* loop);
+  ~EpollPoller() override;
+
+  void poll(int timeoutMs, ChannelList* activeChannels) override;
+  void updateChannel(Channel* channel) override;
+  void removeChannel(Channel* channel) override;
+  const char* name() const override { return "epoll"; }
 
  private:
-  using ChannelMap = std::map<int, Channel*>;
   using EventList = std::vector<struct epoll_event>;
 
   // 调试
@@ -37,10 +31,8 @@ class EpollPoller {
 
   static const int kInitEventListSize = 16;  // 初始 epoll 监听的文件数
 
-  EventLoop* ownerLoop_;  // 所属的 EventLoop
-  int epollfd_;           // 创建的epollfd
-  EventList events_;      // 监听的fd
-  ChannelMap channels_;   // fd 对应 C
+  int epollfd_;       // 创建的epollfd
+  EventList events_;  // 监听的fd
 };
 
 }  // namespace starry
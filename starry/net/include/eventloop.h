@@ -1,26 +1,35 @@
 #pragma once
 
 #include "callbacks.h"
+#include "inline_function.h"
+#include "loop_metrics.h"
+#include "loop_stats.h"
+#include "mpsc_queue.h"
 #include "timer_id.h"
 #include <any>
 #include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <memory>
-#include <mutex>
 #include <thread>
+#include <typeinfo>
 #include <vector>
 
 namespace starry {
 
+class BufferPool;
 class Channel;
-class EpollPoller;
+class Poller;
 class TimerQueue;
 
 class EventLoop {
+  friend class TimerQueue;  // 执行定时器回调前更新 progress
+
  public:
-  using Functor = std::function<void()>;
+  // 只能移动，不超过 64 字节的 lambda 不分配内存
+  using Functor = InlineFunction<void()>;
   using ChannelList = std::vector<Channel*>;
 
   EventLoop();
@@ -30,25 +39,54 @@ class EventLoop {
   void loop();  // 循环组织 Channel 和 Poller
   void quit();  // 离开循环
 
-  // 定时器相关
+  // 时间：每轮 poll 返回后读一次时钟缓存起来，本轮的定时器和回调都用它
+  // pollReruenTime 是系统时间，now 是单调时间，只能在 loop 线程读取
   Timestamp pollReruenTime() const { return pollReturnTime_; }
+  MonoTime now() const { return now_; }
+  // 需要精确时间时重新读时钟，同时更新缓存
+  MonoTime refreshNow();
+  // 粗粒度时钟：用 CLOCK_*_COARSE 更新缓存，更便宜，精度约为一个 tick，
+  // 可以在任意线程设置，下一轮生效
+  void setCoarseClock(bool on) { coarseClock_ = on; }
+  bool coarseClock() const { return coarseClock_; }
+
+  // 定时器相关
   int64_t iteration() const { return iteration_; }
   TimerId runAt(Timestamp time, TimerCallback cb);
+  TimerId runAt(MonoTime time, TimerCallback cb);
   TimerId runAfter(double delay, TimerCallback cb);
   TimerId runEvery(double interval, TimerCallback cb);
   void cancel(TimerId timerId);
-  
+  // 定时器的精度：到期时间向上取整到 tick，不会提前触发，最多晚一个 tick
+  // 默认 1 毫秒，可以在任意线程设置，已有的定时器按新的精度重新放置
+  void setTimerResolution(std::chrono::nanoseconds tick);
+  // 定时器允许推迟的时间，默认 0：slack 窗口里先后到期的定时器合并成一次唤醒，
+  // 也少设置几次 timerfd，次数见 stats() 的 timerWakeups 和 timerfdSettimes
+  // 可以在任意线程设置
+  void setTimerSlack(std::chrono::nanoseconds slack);
+
+
+  // 忙轮询：阻塞之前先用零超时 poll 自旋最多 windowUs 微秒，
+  // 空闲时自旋窗口逐步减半，有流量时恢复，适合独占 CPU 核的低延迟 loop
+  // 可以在任意线程设置，统计见 stats() 的 spinNanos 等
+  void setBusyPoll(bool on, int windowUs = kDefaultBusyPollUs);
+  bool busyPoll() const { return busyPoll_; }
+  static constexpr int kDefaultBusyPollUs = 50;
 
   // 预处理函数
   void runInLoop(Functor cb);  // 上层调用在当前EventLoop中调用
   void queueInLoop(Functor cb);  // 允许其他线程安全的向EventLoop所属的线程提交任务
-  size_t queueSize();  // 预处理函数的个数
+  size_t queueSize() const;  // 预处理函数的个数
+  // 在本轮的预处理函数之后执行，用于把同一轮里的操作合并处理，只能在 loop 线程调用
+  void runAtIterationEnd(Functor cb);
 
   // 内部唤醒 EventLoop
   void wakeup();
   void updateChannel(Channel* channel);
   void removeChannel(Channel* channel);
   bool hasChannel(Channel* channel);
+  // 使用的 poller 后端，"epoll" 或 "io_uring"
+  const char* pollerName() const;
 
   // 调试
   void assertInLoopThread() {  // 断言是否在当前线程
@@ -64,6 +102,44 @@ class EventLoop {
   // 获取当前的 EventLoop 实例
   static EventLoop* getEventLoopOfCurrentThread();
 
+  // loop 线程当前在做什么，给 LoopWatchdog 这样的其他线程读取
+  enum class Activity { kIdle, kPolling, kHandlingEvents, kRunningFunctors };
+  struct Progress {
+    uint64_t heartbeat;              // 每次进入 poll 或开始一个回调时加一
+    Activity activity;
+    int fd;                          // 正在处理的 channel，没有时为 -1
+    const std::type_info* callback;  // 正在执行的函数或定时器回调，没有时为空
+  };
+  // 各个字段分别读取，不保证是同一时刻的
+  Progress progress() const;
+  static const char* activityName(Activity activity);
+
+  // 负载，给选择 loop 的 LoopSelector 读取，可以在任意线程调用
+  // 本 loop 上的 TcpConnection 个数，创建时加一，connectDestroyed 时减一
+  int connectionCount() const {
+    return connections_.load(std::memory_order_relaxed);
+  }
+  void addConnection() { connections_.fetch_add(1, std::memory_order_relaxed); }
+  void removeConnection() {
+    connections_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  // 最近一段时间处理事件和待处理函数的时间占比，0 到 1，
+  // 按 kBusyDecayNanos 指数衰减，正在进行的 poll 或回调也计算在内
+  double busyRatio() const;
+  static constexpr int64_t kBusyDecayNanos = 100 * 1000 * 1000;
+
+  // 本 loop 上连接缓冲区的内存池
+  BufferPool* bufferPool() const { return bufferPool_.get(); }
+  // 本 loop 上所有连接共用的读暂存区，只能在 loop 线程使用
+  char* receiveScratch() { return receiveScratch_.get(); }
+  static constexpr size_t kReceiveScratchSize = 64 * 1024;
+  // 本 loop 的计数器
+  LoopStats& stats() { return stats_; }
+  const LoopStats& stats() const { return stats_; }
+  // 本 loop 的延迟和深度分布，其他线程用 metrics().snapshot() 读取
+  LoopMetrics& metrics() { return metrics_; }
+  const LoopMetrics& metrics() const { return metrics_; }
+
   void setContext(const std::any& context) { context_ = context; }
 
   const std::any& getContext() const { return context_; }
@@ -72,7 +148,24 @@ class EventLoop {
 
  private:
   void handleRead();         // 唤醒当前Loop
-  void doPendingFunctors();  // 处理预处理函数
+  void busyPollOnce();       // 忙轮询模式下的一次 poll
+  void updateClock();        // 更新本轮缓存的时间
+  MonoTime timerBase() const;  // 计算定时器到期时间的起点
+  size_t doPendingFunctors();  // 处理预处理函数，返回执行的个数
+  // 用一段 poll 或处理的时间更新 busyRatio
+  void updateBusy(uint64_t nanos, bool busy, MonoTime end);
+  // 开始执行一个回调，更新 progress
+  void beginCallback(int fd, const std::type_info* callback) {
+    currentFd_.store(fd, std::memory_order_relaxed);
+    currentCallback_.store(callback, std::memory_order_relaxed);
+    heartbeat_.store(heartbeat_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+  }
+  void setActivity(Activity activity) {
+    activity_.store(activity, std::memory_order_relaxed);
+    heartbeat_.store(heartbeat_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+  }
 
   // 调试
   void abortNotInLoopThread();  // 致命错误，不在当前线程
@@ -86,9 +179,36 @@ class EventLoop {
   int64_t iteration_;                       // 通过记录循环次数来预估定时时间，减少查看系统时间的次数，提高性能
   std::thread::id threadId_;                  // 当前线程Id
 
+  // 本轮缓存的时间
+  Timestamp pollReturnTime_;  // poll返回时的系统时间，作为消息的接收时间
+  MonoTime now_;              // poll返回时的单调时间，定时器用它计算到期
+  std::atomic<bool> coarseClock_;  // 是否使用粗粒度时钟
+
   // Poller
-  Timestamp pollReturnTime_;  // poll返回时间，用来推导定时任务的结束时间
-  std::unique_ptr<EpollPoller> epollPoller_;                        //  在EventLoop中前向声明的对象，且只由EventLoop独占故用unique_ptr
+  std::unique_ptr<Poller> poller_;  //  在EventLoop中前向声明的对象，且只由EventLoop独占故用unique_ptr
+
+  // 忙轮询
+  std::atomic<bool> busyPoll_;          // 是否开启
+  std::atomic<int> busyPollWindowUs_;   // 最大自旋窗口
+  int64_t spinWindowNs_;                // 当前自旋窗口，只在 loop 线程访问
+
+  // 连接缓冲区的内存池，必须比 TimerQueue 和 Channel 活得久；
+  // 切片持有它的引用，loop 析构后还没释放的切片归还时它还在
+  std::shared_ptr<BufferPool> bufferPool_;
+  std::unique_ptr<char[]> receiveScratch_;  // 读暂存区
+  LoopStats stats_;                         // 计数器
+  LoopMetrics metrics_;                     // 分布
+
+  // 负载
+  std::atomic<int> connections_;          // 连接数
+  std::atomic<double> busyEwma_;          // 上一轮结束时的 busyRatio，只有 loop 线程写
+  std::atomic<int64_t> busyUpdatedNanos_;  // busyEwma_ 的更新时间，也是当前这一段的开始
+
+  // 进度，只有 loop 线程写
+  std::atomic<uint64_t> heartbeat_;
+  std::atomic<Activity> activity_;
+  std::atomic<int> currentFd_;
+  std::atomic<const std::type_info*> currentCallback_;
 
   // 定时器
   std::unique_ptr<TimerQueue> timerQueue_;  //  在EventLoop中前向声明的对象，且只由EventLoop独占故用unique_ptr
@@ -101,9 +221,14 @@ class EventLoop {
   ChannelList activeChannels_;  // 监听到活跃的Channel的集和
   Channel* currentActiveChannel_;
 
-  // EventLoop的所持有的预处理函数函数的集和
-  std::mutex mutex_;
-  std::vector<Functor> pendingFunctors_;
+  // EventLoop的所持有的预处理函数函数的集和，其他线程无锁投递
+  MpscQueue<Functor> pendingFunctors_;
+  std::vector<Functor> runningFunctors_;  // 正在执行的一批，复用容量
+
+  // 本轮结束时执行的函数，只在 loop 线程访问
+  std::vector<Functor> iterationEndFunctors_;
+  std::vector<Functor> runningIterationEnd_;  // 正在执行的一批，复用容量
+  bool callingIterationEnd_;                   // 是否在执行本轮结束函数
 
   std::any context_;
 };
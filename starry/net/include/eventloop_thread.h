@@ -6,6 +6,7 @@
 #include <string>
 #include <thread>
 #include "eventloop.h"
+#include "thread_placement.h"
 
 namespace starry {
 
@@ -19,6 +20,9 @@ class EventLoopThread {
                   const std::string& name = std::string());
   ~EventLoopThread();
 
+  // 线程在创建 EventLoop 之前绑核并设置内存策略，要在 startLoop 之前调用
+  void setPlacement(const ThreadPlacement::Slot& slot) { placement_ = slot; }
+
   EventLoop* startLoop();
 
  private:
@@ -32,6 +36,7 @@ class EventLoopThread {
   bool exiting_;                  // 当前线程是否退出
   // 允许用户在 EventLoop, 线程启动后，事件循环开始前，执行一些初始化工作
   ThreadInitCallback callback_;
+  ThreadPlacement::Slot placement_;  // 线程的位置，默认不限制
 };
 
 }  // namespace starry
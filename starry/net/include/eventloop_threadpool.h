@@ -2,9 +2,13 @@
 
 #include <cstddef>
 #include <functional>
+#include <map>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
+#include "loop_selector.h"
+#include "thread_placement.h"
 
 namespace starry {
 
@@ -20,14 +24,28 @@ class EventLoopThreadPool {
 
   // 设置线程数
   void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+  // 设置线程的放置策略，要在 start 之前调用
+  void setPlacement(const ThreadPlacement& placement) { placement_ = placement; }
+  // 设置 selectLoop 使用的策略，默认轮询，在 baseLoop 线程调用
+  void setSelector(std::unique_ptr<LoopSelector> selector) {
+    selector_ = std::move(selector);
+  }
   // 开启循环
   void start(const ThreadInitCallback& cb = ThreadInitCallback());
 
   EventLoop* getNextLoop();                    // 获取一个 EventLoop
   EventLoop* getLoopForHash(size_t hashCode);  // 获取指定编号的 EventLoop
+  EventLoop* selectLoop(size_t hashCode);      // 按 selector 选择 EventLoop
+  // selector 是否用到 hashCode，见 LoopSelector::needsHash
+  bool selectorNeedsHash() const { return selector_->needsHash(); }
+  // 绑定到 cpu 上的 EventLoop，没有返回 nullptr；有多个时哈希策略按 hashCode 取模，
+  // 其他策略在这个 CPU 的 loop 之间轮询，不动 selector 的状态
+  EventLoop* loopForCpu(int cpu, size_t hashCode);
   std::vector<EventLoop*> getAllLoops();       // 获取所有的 EventLoop
+  std::vector<int> connectionCounts();         // 每个 EventLoop 上的连接数
 
   bool started() const { return started_; }  // 是否开启
+  bool pinned() const { return !loopsByCpu_.empty(); }  // 是否有线程绑了核
 
  private:
   EventLoop* baseLoop_;  // 最顶层的 loop_ ,用来分发连接
@@ -35,8 +53,17 @@ class EventLoopThreadPool {
   bool started_;         // 是否开启循环
   int numThreads_;       // 线程池线程数
   int next_;             // 下一个 EventLoop
+  ThreadPlacement placement_;  // 线程放置策略
+  std::unique_ptr<LoopSelector> selector_;  // 选择 EventLoop 的策略
   std::vector<std::unique_ptr<EventLoopThread>> threads_;  // 线程指针
   std::vector<EventLoop*> loops_;                          // EventLoop 集和
+
+  // 绑定到同一个 CPU 的 loop，next 是这个 CPU 自己的轮询位置
+  struct CpuLoops {
+    std::vector<EventLoop*> loops;
+    size_t next = 0;
+  };
+  std::map<int, CpuLoops> loopsByCpu_;  // 按放置策略绑定的 CPU
 };
 
 }  // namespace starry
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace starry {
+
+// Histogram 的一次快照，可以在任意线程计算分位数
+struct HistogramSnapshot {
+  static constexpr int kSubBucketBits = 3;
+  static constexpr int kSubBuckets = 1 << kSubBucketBits;
+  static constexpr int kBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+  std::array<uint64_t, kBuckets> counts{};  // 每个桶的记录数
+  uint64_t count = 0;                       // 总记录数，等于各桶之和
+  uint64_t sum = 0;                         // 记录值之和
+  uint64_t max = 0;                         // 最大记录值
+
+  // 第 p 分位（0 到 1）所在桶的上界，不超过 max，相对误差不超过 1/8
+  uint64_t percentile(double p) const;
+  double mean() const { return count > 0 ? static_cast<double>(sum) / count : 0; }
+  // count、mean、p50、p90、p99、p999 和 max，调试和日志用
+  std::string toString() const;
+
+  // 桶的下标和取值范围
+  static int bucketIndex(uint64_t value);
+  static uint64_t bucketLowerBound(int index);
+  static uint64_t bucketUpperBound(int index);
+};
+
+// 对数-线性直方图：小于 8 的值各占一个桶，之后每个 2 的幂区间再均分 8 个桶
+// 记录只有一次下标计算和几次 relaxed 原子读写，只能由一个线程（loop 线程）记录，
+// 其他线程随时可以 snapshot，各个桶之间不保证是同一时刻的值
+class Histogram {
+ public:
+  Histogram() = default;
+  Histogram(const Histogram&) = delete;
+  Histogram& operator=(const Histogram&) = delete;
+
+  void record(uint64_t value) {
+    add(counts_[HistogramSnapshot::bucketIndex(value)], 1);
+    add(sum_, value);
+    if (value > max_.load(std::memory_order_relaxed)) {
+      max_.store(value, std::memory_order_relaxed);
+    }
+  }
+
+  HistogramSnapshot snapshot() const;
+
+ private:
+  // 只有一个线程写，不需要原子的读-改-写
+  static void add(std::atomic<uint64_t>& counter, uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n,
+                  std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<uint64_t>, HistogramSnapshot::kBuckets> counts_{};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+}  // namespace starry
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+
+namespace starry {
+
+template <typename Signature, size_t InlineSize = 64>
+class InlineFunction;
+
+namespace detail {
+
+// 可能为空的可调用对象包装
+template <typename F>
+struct IsFunctionWrapper : std::false_type {};
+template <typename Signature>
+struct IsFunctionWrapper<std::function<Signature>> : std::true_type {};
+
+}  // namespace detail
+
+// 只能移动的可调用对象，类似 std::move_only_function，但保证内联存储的大小：
+// 不超过 InlineSize 字节、对齐不超过 max_align_t 且移动不抛异常的可调用对象
+// 直接存放在对象内部，不分配内存；更大的才放到堆上
+// 常见的 [conn, msg] lambda 和 std::bind(&X::f, this, _1) 都可以内联存放
+template <typename R, typename... Args, size_t InlineSize>
+class InlineFunction<R(Args...), InlineSize> {
+ public:
+  static constexpr size_t kInlineSize = InlineSize;
+
+  // 可调用对象 F 是否内联存放
+  template <typename F>
+  static constexpr bool storedInline() {
+    return sizeof(F) <= InlineSize &&
+           alignof(F) <= alignof(std::max_align_t) &&
+           std::is_nothrow_move_constructible_v<F>;
+  }
+
+  InlineFunction() noexcept : ops_(nullptr) {}
+  InlineFunction(std::nullptr_t) noexcept : ops_(nullptr) {}
+
+  template <typename F, typename D = std::decay_t<F>>
+    requires(!std::is_same_v<D, InlineFunction> &&
+             std::is_invocable_r_v<R, D&, Args...>)
+  InlineFunction(F&& f) : ops_(nullptr) {
+    // 空的函数指针和 std::function 构造出空对象
+    if constexpr (std::is_pointer_v<D> || std::is_member_pointer_v<D> ||
+                  detail::IsFunctionWrapper<D>::value) {
+      if (!f) {
+        return;
+      }
+    }
+    if constexpr (storedInline<D>()) {
+      ::new (static_cast<void*>(storage_)) D(std::forward<F>(f));
+      ops_ = &kInlineOps<D>;
+    } else {
+      ::new (static_cast<void*>(storage_)) D*(new D(std::forward<F>(f)));
+      ops_ = &kHeapOps<D>;
+    }
+  }
+
+  ~InlineFunction() { reset(); }
+
+  InlineFunction(InlineFunction&& rhs) noexcept : ops_(nullptr) {
+    moveFrom(rhs);
+  }
+
+  InlineFunction& operator=(InlineFunction&& rhs) noexcept {
+    if (this != &rhs) {
+      reset();
+      moveFrom(rhs);
+    }
+    return *this;
+  }
+
+  InlineFunction& operator=(std::nullptr_t) noexcept {
+    reset();
+    return *this;
+  }
+
+  InlineFunction(const InlineFunction&) = delete;
+  InlineFunction& operator=(const InlineFunction&) = delete;
+
+  // 和 std::function 一样，调用不改变对象本身
+  R operator()(Args... args) const {
+    assert(ops_ != nullptr);
+    return ops_->invoke(storage_, std::forward<Args>(args)...);
+  }
+
+  explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+  // 当前对象是否在堆上分配了存储
+  bool onHeap() const noexcept { return ops_ != nullptr && ops_->heap; }
+
+  // 可调用对象的类型，为空时是 void，和 std::function::target_type 一样
+  const std::type_info& targetType() const noexcept {
+    return ops_ != nullptr ? *ops_->type : typeid(void);
+  }
+
+ private:
+  struct Ops {
+    R (*invoke)(void* storage, Args&&... args);
+    void (*move)(void* dst, void* src) noexcept;  // 移动到 dst 并析构 src
+    void (*destroy)(void* storage) noexcept;
+    const std::type_info* type;
+    bool heap;
+  };
+
+  template <typename D>
+  static R invokeInline(void* storage, Args&&... args) {
+    return std::invoke_r<R>(*static_cast<D*>(storage),
+                            std::forward<Args>(args)...);
+  }
+
+  template <typename D>
+  static void moveInline(void* dst, void* src) noexcept {
+    D* from = static_cast<D*>(src);
+    ::new (dst) D(std::move(*from));
+    from->~D();
+  }
+
+  template <typename D>
+  static void destroyInline(void* storage) noexcept {
+    static_cast<D*>(storage)->~D();
+  }
+
+  template <typename D>
+  static R invokeHeap(void* storage, Args&&... args) {
+    return std::invoke_r<R>(**static_cast<D**>(storage),
+                            std::forward<Args>(args)...);
+  }
+
+  static void moveHeap(void* dst, void* src) noexcept {
+    ::new (dst) void*(*static_cast<void**>(src));
+  }
+
+  template <typename D>
+  static void destroyHeap(void* storage) noexcept {
+    delete *static_cast<D**>(storage);
+  }
+
+  template <typename D>
+  static constexpr Ops kInlineOps = {&invokeInline<D>, &moveInline<D>,
+                                     &destroyInline<D>, &typeid(D), false};
+  template <typename D>
+  static constexpr Ops kHeapOps = {&invokeHeap<D>, &moveHeap, &destroyHeap<D>,
+                                   &typeid(D), true};
+
+  void moveFrom(InlineFunction& rhs) noexcept {
+    if (rhs.ops_ != nullptr) {
+      rhs.ops_->move(storage_, rhs.storage_);
+      ops_ = std::exchange(rhs.ops_, nullptr);
+    }
+  }
+
+  void reset() noexcept {
+    if (ops_ != nullptr) {
+      ops_->destroy(storage_);
+      ops_ = nullptr;
+    }
+  }
+
+  const Ops* ops_;  // 类型相关的操作，为空表示没有可调用对象
+  alignas(std::max_align_t) mutable unsigned char storage_[InlineSize];
+};
+
+}  // namespace starry
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "poller.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf;
+
+namespace starry {
+
+// 基于 io_uring 的 poller，直接使用系统调用，不依赖 liburing
+// 用一次性的 IORING_OP_POLL_ADD 监听就绪事件，触发后在下一轮重新挂上，
+// 挂上时内核会立即检查一次，所以和 epoll 的水平触发语义一致；
+// 边缘触发的 channel 用多次触发的 poll 请求，语义和 EPOLLET 一致；
+// 设置了接收缓冲区的 channel 不再等可读，而是挂一个 multishot recv，
+// 内核把数据收进注册的缓冲区环，poller 追加到 channel 的缓冲区后再通知读回调；
+// fd 注册在固定文件表里，请求不用每次查找和引用文件；
+// 一轮里所有的挂载、取消和等待合并成一次 io_uring_enter 提交，
+// 内核支持时还会注册 ring fd，省去每次 io_uring_enter 查找文件
+class IoUringPoller : public Poller {
+ public:
+  explicit IoUringPoller(EventLoop* loop);
+  ~IoUringPoller() override;
+
+  // 创建 ring 是否成功，失败时由 newDefaultPoller 退回 epoll
+  bool valid() const { return ringFd_ >= 0; }
+
+  void poll(int timeoutMs, ChannelList* activeChannels) override;
+  void updateChannel(Channel* channel) override;
+  void removeChannel(Channel* channel) override;
+  const char* name() const override { return "io_uring"; }
+
+  // 计数，调试和测试用
+  uint64_t enterCalls() const { return enterCalls_; }
+  uint64_t submittedEntries() const { return submittedEntries_; }
+  // 是否支持直接收数据，缓冲区环注册失败或者内核不支持 multishot recv 时为 false
+  bool receiveSupported() const { return receiveSupported_; }
+  // 直接收到的字节数和完成事件数
+  uint64_t receivedBytes() const { return receivedBytes_; }
+  uint64_t receiveCompletions() const { return receiveCompletions_; }
+  // 缓冲区环用完、multishot recv 中断的次数
+  uint64_t receiveBufferShortages() const { return receiveBufferShortages_; }
+  // 注册在固定文件表里的 fd 数
+  size_t fixedFiles() const { return fixedFiles_; }
+
+ private:
+  // 每个 fd 在内核里挂着的请求
+  struct PollState {
+    Channel* channel;
+    uint64_t armedData;  // 挂着的 poll 请求的 user_data，0 表示没有挂
+    int armedEvents;     // 挂着的 poll 请求监听的事件
+    uint64_t recvData;   // 挂着的 multishot recv 的 user_data，0 表示没有挂
+    bool recvCanceling;  // recv 已经取消，还在等最终的完成事件
+    int revents;         // 收割到、还没交给 EventLoop 的事件
+    bool receiving;      // 读由 poller 接管
+    bool fixedFile;      // fd 注册在固定文件表里，下标就是 fd
+  };
+
+  // 收进缓冲区环、还没追加到 channel 缓冲区的数据
+  struct ReceivedChunk {
+    int fd;
+    uint16_t bufferId;
+    uint32_t len;
+  };
+
+  static const unsigned kRingEntries = 256;
+  // 固定文件表的大小，fd 超出的不注册
+  static const unsigned kMaxFixedFiles = 8192;
+  // 缓冲区环：个数必须是 2 的幂
+  static const unsigned kReceiveBuffers = 128;
+  static const unsigned kReceiveBufferSize = 16 * 1024;
+  static const uint16_t kBufferGroup = 0;
+
+  bool setupRing();
+  void setupFixedFiles();
+  void setupReceiveBuffers();
+  // 取消所有请求并等它们结束，再注销固定文件和缓冲区环，
+  // 否则 close 之后内核在后台回收，socket 要晚一些才真正关闭
+  void drain();
+  void unmapRing();
+  // fd 的挂载状态，没有注册时返回 nullptr
+  PollState* findState(int fd);
+  // 按 channel 当前关注的事件挂上、取消或替换请求
+  void reconcile(int fd);
+  io_uring_sqe* nextSqe();
+  void commitSqe();
+  void queuePollAdd(int fd, bool fixedFile, int events, uint64_t userData);
+  void queuePollRemove(uint64_t userData);
+  void queueRecv(int fd, bool fixedFile, uint64_t userData);
+  void queueCancel(uint64_t userData);
+  void queueFilesUpdate(int fd, const int* file);
+  // 提交已排队的请求，waitMs 为 0 时不等待，小于 0 时一直等
+  void submitAndWait(int waitMs);
+  // COOP_TASKRUN 下是否有等着进入内核才处理的完成任务
+  bool taskWorkPending() const;
+  int enter(unsigned toSubmit, unsigned minComplete, unsigned flags,
+            const void* arg, size_t argSize);
+  // 收割完成事件，事件记在 PollState::revents，收到的数据记在 received_
+  void reapCompletions();
+  void handleRecvCompletion(PollState* state, int fd, const io_uring_cqe& cqe);
+  void markReady(PollState* state, int fd, int revents);
+  // 固定文件不可用时这个 fd 退回普通文件
+  void dropFixedFile(PollState* state, int fd);
+  // 把 fd 收到的数据追加到它的接收缓冲区，fd 为 -1 时处理全部
+  void appendReceived(int fd);
+  void recycleBuffer(uint16_t bufferId);
+
+  int ringFd_;           // io_uring 的 fd
+  int enterFd_;          // io_uring_enter 用的 fd，注册后是下标
+  unsigned enterFlags_;  // 注册 ring fd 后带上 IORING_ENTER_REGISTERED_RING
+  bool taskrunFlag_;     // 内核在有待处理的完成任务时设置 IORING_SQ_TASKRUN
+
+  void* ringPtr_;     // SQ 和 CQ 共用的映射
+  size_t ringSize_;
+  io_uring_sqe* sqes_;
+  size_t sqesSize_;
+
+  unsigned* sqHead_;
+  unsigned* sqTail_;
+  unsigned* sqFlags_;
+  unsigned* sqArray_;
+  unsigned sqMask_;
+  unsigned sqEntries_;
+  unsigned* cqHead_;
+  unsigned* cqTail_;
+  io_uring_cqe* cqes_;
+  unsigned cqMask_;
+
+  unsigned fixedFileSlots_;            // 固定文件表的大小，0 表示不支持
+  std::unique_ptr<int[]> fileValues_;  // FILES_UPDATE 读的 fd 值，下标就是 fd
+  size_t fixedFiles_;
+
+  bool receiveSupported_;
+  io_uring_buf* bufferRing_;  // 和内核共享的缓冲区环
+  char* receiveBuffers_;      // 缓冲区环里的缓冲区
+  uint16_t bufferTail_;
+  std::vector<ReceivedChunk> received_;
+
+  uint32_t generation_;  // 区分同一个 fd 先后挂上的请求
+  std::vector<PollState> states_;  // 下标是 fd，和 channels_ 一样按需增长
+  std::vector<int> dirty_;  // 需要在下一次 poll 前重新挂载的 fd
+  std::vector<int> ready_;  // 有事件、还没交给 EventLoop 的 fd
+  uint64_t inflight_;       // 还没有最终完成事件的请求数
+
+  uint64_t enterCalls_;
+  uint64_t submittedEntries_;
+  uint64_t receivedBytes_;
+  uint64_t receiveCompletions_;
+  uint64_t receiveBufferShortages_;
+};
+
+}  // namespace starry
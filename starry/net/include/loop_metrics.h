@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include "histogram.h"
+
+namespace starry {
+
+// 每个 EventLoop 热路径上的分布，时间单位纳秒，只在 loop 线程记录，
+// 其他线程可以随时 snapshot，用来找出哪个 loop 饱和了、时间花在哪里
+struct LoopMetrics {
+  Histogram pollNanos;          // 每轮在 poll 里等待的时间（含忙轮询自旋）
+  Histogram eventsPerIteration; // 每轮 poll 返回的活跃 channel 数
+  Histogram handlerNanos;       // 每个 channel 事件回调的时间
+  Histogram pendingFunctors;    // 每轮执行的待处理函数个数（队列深度）
+  Histogram functorNanos;       // 每轮执行待处理函数的总时间，没有时不记录
+  Histogram timerNanos;         // 每个定时器回调的时间
+  Histogram iterationNanos;     // 每轮从 poll 返回到处理完的时间
+
+  struct Snapshot {
+    HistogramSnapshot pollNanos;
+    HistogramSnapshot eventsPerIteration;
+    HistogramSnapshot handlerNanos;
+    HistogramSnapshot pendingFunctors;
+    HistogramSnapshot functorNanos;
+    HistogramSnapshot timerNanos;
+    HistogramSnapshot iterationNanos;
+
+    // 每个分布一行
+    std::string toString() const;
+  };
+
+  Snapshot snapshot() const;
+};
+
+}  // namespace starry
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace starry {
+
+class EventLoop;
+
+// EventLoopThreadPool 为新连接选择 loop 的策略，在 baseLoop 线程调用
+// loops 非空；hashCode 由调用者给出，TcpServer 用对端 IP 的哈希
+class LoopSelector {
+ public:
+  virtual ~LoopSelector() = default;
+
+  virtual EventLoop* select(const std::vector<EventLoop*>& loops,
+                            size_t hashCode) = 0;
+  // 是否使用 hashCode，不使用时调用者可以不计算，传 0
+  virtual bool needsHash() const { return false; }
+
+  // 轮询，默认策略
+  static std::unique_ptr<LoopSelector> newRoundRobin();
+  // 连接数最少的 loop
+  static std::unique_ptr<LoopSelector> newLeastConnections();
+  // 待处理函数最少的 loop
+  static std::unique_ptr<LoopSelector> newLeastQueue();
+  // 随机取两个 loop，选最近忙碌占比低的那个
+  static std::unique_ptr<LoopSelector> newPowerOfTwoChoices();
+  // 按 hashCode 取模，同一个客户端总是落在同一个 loop 上
+  static std::unique_ptr<LoopSelector> newHash();
+};
+
+class RoundRobinSelector : public LoopSelector {
+ public:
+  RoundRobinSelector() : next_(0) {}
+  EventLoop* select(const std::vector<EventLoop*>& loops,
+                    size_t hashCode) override;
+
+ private:
+  size_t next_;
+};
+
+// 连接数或队列长度相同时从上次选中的下一个开始，避免都落到第一个 loop 上
+class LeastConnectionsSelector : public LoopSelector {
+ public:
+  LeastConnectionsSelector() : next_(0) {}
+  EventLoop* select(const std::vector<EventLoop*>& loops,
+                    size_t hashCode) override;
+
+ private:
+  size_t next_;
+};
+
+class LeastQueueSelector : public LoopSelector {
+ public:
+  LeastQueueSelector() : next_(0) {}
+  EventLoop* select(const std::vector<EventLoop*>& loops,
+                    size_t hashCode) override;
+
+ private:
+  size_t next_;
+};
+
+// 只看两个 loop，开销和 loop 个数无关，也不会让所有连接同时涌向同一个最空闲的 loop
+// 忙碌占比相同时选连接数少的
+class PowerOfTwoChoicesSelector : public LoopSelector {
+ public:
+  explicit PowerOfTwoChoicesSelector(uint64_t seed = 0x9e3779b97f4a7c15ULL)
+      : state_(seed | 1) {}
+  EventLoop* select(const std::vector<EventLoop*>& loops,
+                    size_t hashCode) override;
+
+ private:
+  uint64_t nextRandom();  // xorshift64
+
+  uint64_t state_;
+};
+
+class HashSelector : public LoopSelector {
+ public:
+  EventLoop* select(const std::vector<EventLoop*>& loops,
+                    size_t hashCode) override {
+    return loops[hashCode % loops.size()];
+  }
+  bool needsHash() const override { return true; }
+};
+
+}  // namespace starry
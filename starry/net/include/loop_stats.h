@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "callbacks.h"
+
+namespace starry {
+
+// 每个 EventLoop 的计数器，只在 loop 线程里累加，其他线程可以随时读取
+struct LoopStats {
+  // 只有 loop 线程写，不需要原子的读-改-写
+  static void add(std::atomic<uint64_t>& counter, uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n,
+                  std::memory_order_relaxed);
+  }
+
+  // 读
+  std::atomic<uint64_t> readCalls{0};         // readv 调用次数
+  std::atomic<uint64_t> bytesRead{0};         // 读到的总字节数
+  std::atomic<uint64_t> scratchOverflows{0};  // 读溢出到暂存区的次数
+
+  // 写
+  std::atomic<uint64_t> writeCalls{0};     // write/writev/sendmsg 调用次数
+  std::atomic<uint64_t> bytesWritten{0};   // 写出的总字节数，不含 sendfile
+  std::atomic<uint64_t> batchedSends{0};   // sendv 合并成一次 writev 的次数
+  std::atomic<uint64_t> syscallsSaved{0};  // 合并后省下的写系统调用次数
+  std::atomic<uint64_t> sendfileCalls{0};  // sendfile 调用次数
+  std::atomic<uint64_t> fileBytesSent{0};  // sendfile 发出的字节数
+  std::atomic<uint64_t> corkedSends{0};    // 自动合并写推迟的 send 次数
+  std::atomic<uint64_t> corkFlushes{0};    // 自动合并写在本轮结束时的写出次数
+  std::atomic<uint64_t> zeroCopySends{0};        // MSG_ZEROCOPY 发送次数
+  std::atomic<uint64_t> zeroCopyCompletions{0};  // 内核确认完成的次数
+  std::atomic<uint64_t> zeroCopyCopied{0};       // 其中内核仍然拷贝了的次数
+
+  // 唤醒和定时器
+  std::atomic<uint64_t> wakeups{0};          // poll 返回的次数
+  std::atomic<uint64_t> timerWakeups{0};     // 其中 timerfd 到期的次数
+  std::atomic<uint64_t> timerfdSettimes{0};  // timerfd_settime 调用次数
+  std::atomic<uint64_t> timersFired{0};      // 执行的定时器回调个数
+
+  // 忙轮询，只在开启时统计
+  std::atomic<uint64_t> spinNanos{0};    // 零超时 poll 自旋的时间
+  std::atomic<uint64_t> blockNanos{0};   // 自旋窗口用完后阻塞在 poll 的时间
+  std::atomic<uint64_t> handleNanos{0};  // 处理事件和待处理函数的时间
+  std::atomic<uint64_t> spinHits{0};     // 自旋期间等到事件的次数
+  std::atomic<uint64_t> spinMisses{0};   // 自旋窗口用完转为阻塞的次数
+
+  // 自旋时间占忙轮询总时间的比例
+  double spinFraction() const {
+    double spin = static_cast<double>(spinNanos.load(std::memory_order_relaxed));
+    double total = spin +
+                   static_cast<double>(blockNanos.load(std::memory_order_relaxed)) +
+                   static_cast<double>(handleNanos.load(std::memory_order_relaxed));
+    return total > 0 ? spin / total : 0.0;
+  }
+};
+
+// 每秒的唤醒和 timerfd_settime 次数：定期调用 sample，得到和上次调用之间的平均值
+// 只在一个线程里使用，stats 要比它活得久
+class WakeupRateMeter {
+ public:
+  struct Rates {
+    double wakeups;          // loop 每秒被唤醒的次数
+    double timerWakeups;     // 其中由定时器唤醒的次数
+    double timerfdSettimes;  // 每秒 timerfd_settime 的次数
+    double timersFired;      // 每秒执行的定时器回调个数
+  };
+
+  explicit WakeupRateMeter(const LoopStats& stats)
+      : stats_(stats), last_(read(stats)), lastTime_(MonoClock::now()) {}
+
+  Rates sample() {
+    const Counts counts = read(stats_);
+    const MonoTime now = MonoClock::now();
+    const double seconds = std::chrono::duration<double>(now - lastTime_).count();
+    const double scale = seconds > 0 ? 1.0 / seconds : 0.0;
+    Rates rates{
+        static_cast<double>(counts.wakeups - last_.wakeups) * scale,
+        static_cast<double>(counts.timerWakeups - last_.timerWakeups) * scale,
+        static_cast<double>(counts.timerfdSettimes - last_.timerfdSettimes) * scale,
+        static_cast<double>(counts.timersFired - last_.timersFired) * scale};
+    last_ = counts;
+    lastTime_ = now;
+    return rates;
+  }
+
+ private:
+  struct Counts {
+    uint64_t wakeups;
+    uint64_t timerWakeups;
+    uint64_t timerfdSettimes;
+    uint64_t timersFired;
+  };
+
+  static Counts read(const LoopStats& stats) {
+    return Counts{stats.wakeups.load(std::memory_order_relaxed),
+                  stats.timerWakeups.load(std::memory_order_relaxed),
+                  stats.timerfdSettimes.load(std::memory_order_relaxed),
+                  stats.timersFired.load(std::memory_order_relaxed)};
+  }
+
+  const LoopStats& stats_;
+  Counts last_;
+  MonoTime lastTime_;
+};
+
+}  // namespace starry
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "callbacks.h"
+#include "eventloop.h"
+
+namespace starry {
+
+// 可选的看门狗线程：定期读取每个 loop 的 progress，
+// loop 不在 poll 里且心跳超过 threshold 秒没有变化就认为卡住了，
+// 报告卡住的 loop、正在处理的 channel fd 或正在执行的函数类型
+// 日志按 loop 限速，回调每次卡住调用一次，用来在过载时拒绝新请求
+class LoopWatchdog {
+ public:
+  struct Stall {
+    EventLoop* loop;
+    double seconds;               // 已经卡住的时间
+    EventLoop::Activity activity;
+    int fd;                       // 正在处理的 channel，没有时为 -1
+    std::string callback;         // 正在执行的函数类型，已经 demangle
+  };
+  // 在看门狗线程持锁调用，不能阻塞，不能 watch/unwatch，也不能直接操作卡住的 loop
+  using StallCallback = std::function<void(const Stall&)>;
+
+  static constexpr double kDefaultThreshold = 1.0;        // 秒
+  static constexpr double kDefaultReportInterval = 10.0;  // 秒
+
+  explicit LoopWatchdog(double threshold = kDefaultThreshold);
+  ~LoopWatchdog();
+
+  LoopWatchdog(const LoopWatchdog&) = delete;
+  LoopWatchdog& operator=(const LoopWatchdog&) = delete;
+
+  // 开始监视，loop 析构之前要 unwatch
+  void watch(EventLoop* loop);
+  void unwatch(EventLoop* loop);
+
+  // 同一个 loop 两次日志之间至少间隔 seconds 秒，期间的卡住只计数
+  void setReportInterval(double seconds) { reportInterval_ = seconds; }
+  void setStallCallback(StallCallback cb) { stallCallback_ = std::move(cb); }
+
+  void start();
+  void stop();
+
+  // 检测到的卡住次数，和输出的日志次数
+  uint64_t stalls() const { return stalls_; }
+  uint64_t reports() const { return reports_; }
+
+ private:
+  struct Watched {
+    EventLoop* loop;
+    uint64_t heartbeat;   // 上次看到的心跳
+    MonoTime since;       // 心跳从什么时候开始没有变化
+    bool stalled;         // 本次卡住是否已经计数
+    MonoTime lastReport;  // 上次输出日志的时间
+    uint64_t suppressed;  // 限速期间没有输出的卡住次数
+  };
+
+  void threadFunc();
+  void check(MonoTime now);
+
+  const double threshold_;
+  double reportInterval_;
+  StallCallback stallCallback_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<Watched> loops_;  // mutex_ 保护
+  bool running_;                // mutex_ 保护
+  std::thread thread_;
+
+  std::atomic<uint64_t> stalls_;
+  std::atomic<uint64_t> reports_;
+};
+
+}  // namespace starry
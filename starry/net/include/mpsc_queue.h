@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace starry {
+
+// 多生产者单消费者队列，EventLoop 用它接收其他线程投递的任务
+// 主体是无锁的有界环形队列（每个槽位带序号），满了以后退到加锁的溢出队列；
+// 溢出期间所有生产者都走溢出队列，消费者取溢出队列前先把环里已认领的槽位取完，
+// 保证同一个生产者投递的任务按顺序执行
+template <typename T>
+class MpscQueue {
+ public:
+  static constexpr size_t kDefaultCapacity = 1024;
+
+  // capacity 必须是 2 的幂
+  explicit MpscQueue(size_t capacity = kDefaultCapacity)
+      : cells_(new Cell[capacity]),
+        mask_(capacity - 1),
+        enqueuePos_(0),
+        dequeuePos_(0),
+        count_(0),
+        overflowActive_(false) {
+    for (size_t i = 0; i < capacity; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  // 任意线程调用，返回入队前的元素个数，为 0 时调用方负责唤醒消费者
+  size_t push(T&& value) {
+    // 先计数再入队，消费者看到的计数不会小于实际个数
+    size_t prev = count_.fetch_add(1, std::memory_order_acq_rel);
+    if (!overflowActive_.load(std::memory_order_acquire) && tryPush(value)) {
+      return prev;
+    }
+    std::lock_guard<std::mutex> lock(overflowMutex_);
+    overflow_.push_back(std::move(value));
+    overflowActive_.store(true, std::memory_order_release);
+    return prev;
+  }
+
+  // 按入队顺序取出当前所有元素追加到 out，只能在消费者线程调用，返回取出的个数
+  size_t drain(std::vector<T>* out) {
+    const size_t oldSize = out->size();
+    T value;
+    while (tryPop(&value)) {
+      out->push_back(std::move(value));
+    }
+    if (overflowActive_.load(std::memory_order_acquire)) {
+      std::vector<T> overflow;
+      size_t target = 0;
+      {
+        std::lock_guard<std::mutex> lock(overflowMutex_);
+        overflow.swap(overflow_);
+        target = enqueuePos_.load(std::memory_order_acquire);
+        overflowActive_.store(false, std::memory_order_release);
+      }
+      // 溢出之前认领的槽位可能还没写完，等它们写完再取溢出队列
+      while (dequeuePos_ != target) {
+        if (tryPop(&value)) {
+          out->push_back(std::move(value));
+        } else {
+          std::this_thread::yield();
+        }
+      }
+      for (T& item : overflow) {
+        out->push_back(std::move(item));
+      }
+    }
+    const size_t n = out->size() - oldSize;
+    count_.fetch_sub(n, std::memory_order_acq_rel);
+    return n;
+  }
+
+  // 还没被取走的元素个数，包括正在入队的
+  size_t size() const { return count_.load(std::memory_order_acquire); }
+  size_t capacity() const { return mask_ + 1; }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;  // 等于位置时可写，等于位置 + 1 时可读
+    T value;
+  };
+
+  bool tryPush(T& value) {
+    size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    Cell* cell = nullptr;
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (dif == 0) {
+        if (enqueuePos_.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (dif < 0) {
+        return false;  // 满了
+      } else {
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPop(T* value) {
+    Cell* cell = &cells_[dequeuePos_ & mask_];
+    size_t seq = cell->sequence.load(std::memory_order_acquire);
+    if (seq != dequeuePos_ + 1) {
+      return false;  // 空的，或者生产者还没写完
+    }
+    *value = std::move(cell->value);
+    cell->value = T();
+    cell->sequence.store(dequeuePos_ + mask_ + 1, std::memory_order_release);
+    ++dequeuePos_;
+    return true;
+  }
+
+  std::unique_ptr<Cell[]> cells_;
+  const size_t mask_;
+
+  alignas(64) std::atomic<size_t> enqueuePos_;  // 生产者认领的位置
+  alignas(64) size_t dequeuePos_;               // 消费者读到的位置
+  alignas(64) std::atomic<size_t> count_;       // 未取走的元素个数
+
+  std::atomic<bool> overflowActive_;  // 是否正在使用溢出队列
+  std::mutex overflowMutex_;
+  std::vector<T> overflow_;  // 环满了以后的溢出队列
+};
+
+}  // namespace starry
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include "callbacks.h"
+#include "channel_table.h"
+
+namespace starry {
+
+class Channel;
+class EventLoop;
+
+// IO 多路复用的抽象，EventLoop 只通过它等待和分发事件
+// 默认用 epoll，设置环境变量 STARRY_POLLER=io_uring 改用 io_uring，
+// io_uring 不可用时退回 epoll
+class Poller {
+ public:
+  using ChannelList = std::vector<Channel*>;
+
+  explicit Poller(EventLoop* loop);
+  virtual ~Poller();
+
+  Poller(const Poller&) = delete;
+  Poller& operator=(const Poller&) = delete;
+
+  // 等待最多 timeoutMs 毫秒，把活跃的 channel 放到 activeChannels
+  // 返回后由 EventLoop 读一次时钟，poller 自己不读
+  virtual void poll(int timeoutMs, ChannelList* activeChannels) = 0;
+  virtual void updateChannel(Channel* channel) = 0;
+  virtual void removeChannel(Channel* channel) = 0;
+  virtual bool hasChannel(Channel* channel) const;
+  // 后端名字，用于日志和测试
+  virtual const char* name() const = 0;
+
+  // 根据环境变量创建 poller
+  static Poller* newDefaultPoller(EventLoop* loop);
+
+  void assertInLoopThread() const;  // 断言是否在同一个线程
+
+ protected:
+  ChannelTable channels_;  // fd 对应的 channel 和 poller 记录的状态
+
+ private:
+  EventLoop* ownerLoop_;  // 所属的 EventLoop
+};
+
+}  // namespace starry
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include "buffer.h"
+#include "buffer_pool.h"
+
+namespace starry {
+
+// 自适应的单次读大小：读满就快速变大，连续两次明显读不满就变小一级
+// 大块传输用更少的系统调用，小的 RPC 连接占用更少的内存
+// 大小是 Buffer 存储的总大小，包括 kCheapPrepend，和 BufferPool 的分级对齐
+class ReadSizePolicy {
+ public:
+  static constexpr size_t kMinReadSize = 512;        // 最小读大小
+  static constexpr size_t kMaxReadSize = 64 * 1024;  // 最大读大小
+  static constexpr size_t kInitialReadSize = 2048;   // 初始读大小
+  // 读到上限时也要从 pool 取块，超过最大一级就退回直接 new/delete
+  static_assert(kMaxReadSize <= BufferPool::kMaxBlockSize);
+
+  ReadSizePolicy() : size_(kInitialReadSize), decreaseNow_(false) {}
+
+  // 下一次应该预留的存储大小，见 Buffer::ensureStorage
+  size_t next() const { return size_; }
+
+  // 记录一次读到的字节数，填满可写空间就算读满
+  void record(size_t bytes) {
+    if (bytes >= size_ - Buffer::kCheapPrepend) {
+      size_ = size_ * 4 > kMaxReadSize ? kMaxReadSize : size_ * 4;
+      decreaseNow_ = false;
+    } else if (bytes <= size_ / 2 && size_ > kMinReadSize) {
+      if (decreaseNow_) {
+        size_ /= 2;
+        decreaseNow_ = false;
+      } else {
+        decreaseNow_ = true;
+      }
+    } else {
+      decreaseNow_ = false;
+    }
+  }
+
+ private:
+  size_t size_;       // 当前读大小
+  bool decreaseNow_;  // 上一次已经读不满
+};
+
+}  // namespace starry
@@ -26,6 +26,7 @@ class Socket {
   void setReuseAddr(bool on);   // 允许快速重启服务器，不等待TIME_WAIT状态结束
   void setReusePort(bool on);   // 允许多个套接字绑定到同一IP和端口
   void setKeepAlive(bool on);   // 是否开\开启心跳检测
+  bool setZeroCopy(bool on);    // 开启 SO_ZEROCOPY，内核不支持时返回 false
 
  private:
   const int sockfd_;
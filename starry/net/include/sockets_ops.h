@@ -19,6 +19,10 @@ int accept(int sockfd, struct sockaddr_in6* addr);
 ssize_t read(int sockfd, void* buf, size_t count);
 ssize_t readv(int sockfd, const struct iovec* iov, int iovcnt);
 ssize_t write(int sockfd, const void* buf, size_t count);
+ssize_t writev(int sockfd, const struct iovec* iov, int iovcnt);
+ssize_t sendfile(int sockfd, int fd, off_t* offset, size_t count);
+ssize_t sendmsg(int sockfd, const struct msghdr* msg, int flags);
+ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags);
 void close(int sockfd);
 void shutdownWrite(int sockfd);
 
@@ -30,6 +34,8 @@ void fromIpPort(const char* ip, uint16_t port, struct sockaddr_in* addr);
 void fromIpPort(const char* ip, uint16_t port, struct sockaddr_in6* addr);
 
 int getSocketError(int sockfd);  // 获取 socket 的错误原因
+// 内核最近在哪个 CPU 上处理这个连接的收包（SO_INCOMING_CPU），未知时返回 -1
+int getIncomingCpu(int sockfd);
 
 // 地址转换
 const struct sockaddr* sockaddr_cast(const struct sockaddr_in* addr);
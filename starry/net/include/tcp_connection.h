@@ -1,16 +1,30 @@
 #pragma once
 
+#include <sys/types.h>
 #include <any>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
 #include <memory>
+#include <mutex>
+#include <span>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
 #include "buffer.h"
+#include "buffer_slice.h"
 #include "callbacks.h"
+#include "chain_buffer.h"
 #include "eventloop.h"
 #include "inet_address.h"
+#include "read_size_policy.h"
 #include "socket.h"
 
+struct iovec;
 struct tcp_info;
 
 namespace starry {
@@ -27,8 +41,8 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
                 const InetAddress& localAddr,
                 const InetAddress& peerAddr);
   ~TcpConnection();
-  // 获取 当前 loop
-  EventLoop* getLoop() const { return loop_; }
+  // 获取 当前 loop，迁移之后会变化
+  EventLoop* getLoop() const { return loop_.load(std::memory_order_acquire); }
   // 获取绑定的本地地址
   const std::string& name() const { return name_; }
   const InetAddress& localAddress() const { return localAddr_; }
@@ -45,9 +59,62 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
   void send(const void* message, int len);     // 发送消息
   void send(const std::string_view& message);  // 发送消息
   void send(Buffer* message);                  // 发送消息
+  void send(Buffer&& message);                 // 接管 Buffer 的存储，不拷贝
+  void send(const BufferSlice& message);       // 发送切片，不拷贝数据
+  void send(BufferSlice&& message);            // 发送切片，不拷贝数据
+  // 多段数据用一次 writev 发出，只有没发完的尾部进入发送缓冲区
+  void sendv(std::span<const std::string_view> pieces);
+  void sendv(std::initializer_list<std::string_view> pieces) {
+    sendv(std::span<const std::string_view>(pieces.begin(), pieces.size()));
+  }
+  // 同上，跨线程时只增加切片的引用计数
+  void sendv(std::span<const BufferSlice> slices);
+  // 用 sendfile 发送 fd 中 [offset, offset + length) 的数据，和其他数据保持顺序
+  // fd 由调用方管理，done 被调用之前不能关闭；发完、出错或连接断开时都会调用 done，
+  // 出错时（包括文件比 length 短）连接被关闭
+  void sendFile(int fd,
+                off_t offset,
+                size_t length,
+                const WriteCompleteCallback& done = WriteCompleteCallback());
+  // 自动合并写：同一轮循环里的 send 先攒在发送缓冲区，本轮结束时一次写出，
+  // 攒够 maxCorkedBytes 时提前写出，只能在连接建立前或 loop 线程里设置
+  void setAutoCork(bool on, size_t maxCorkedBytes = kDefaultMaxCorkedBytes) {
+    autoCork_ = on;
+    maxCorkedBytes_ = maxCorkedBytes;
+  }
+  bool autoCork() const { return autoCork_; }
+  static const size_t kDefaultMaxCorkedBytes = 64 * 1024;
+  // 不小于 threshold 的切片用 MSG_ZEROCOPY 发送，内核确认完成后才释放；
+  // 内核不支持时返回 false，总是拷贝（例如回环）时自动退回普通发送
+  bool setZeroCopy(bool on, size_t threshold = kDefaultZeroCopyThreshold);
+  bool zeroCopy() const { return zeroCopy_; }
+  static const size_t kDefaultZeroCopyThreshold = 64 * 1024;
+  static const int kZeroCopyCopiedLimit = 16;  // 连续被拷贝多少次后退回
+  // 边缘触发：读到 EAGAIN 为止，每次事件最多读写 kMaxIoPerEvent 次，
+  // EPOLLOUT 一直注册着，写不完时不再修改 epoll，只能在连接建立前设置
+  void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+  bool edgeTriggered() const { return edgeTriggered_; }
+  static const int kMaxIoPerEvent = 16;
   void shutdown();                             // 半连接：只读不写
   void forceClose();                           // 强制关闭
   void forceCloseWithDelay(double seconds);    // 延时关闭
+  // 把已建立的连接迁移到 loop，可以在任意线程调用，done 在迁移结束后调用
+  // 旧 loop 停止收发，读缓冲区、没发完的数据和其他线程排队的发送都交给新 loop，
+  // 字节不会丢失或乱序，之后的回调都在新 loop 里执行
+  // 只用于 TcpServer 的连接，TcpClient 要求连接始终在自己的 loop 上
+  void migrateTo(EventLoop* loop,
+                 const MigrateCallback& done = MigrateCallback());
+  // 累计读到的字节数，可以在任意线程读取，给 TcpServer 的负载均衡找出繁忙的连接
+  uint64_t bytesReceived() const {
+    return bytesReceived_.load(std::memory_order_relaxed);
+  }
+  // 距上一次调用读到的字节数，负载均衡每次检查时调用，只能在同一个线程调用
+  uint64_t sampleBytesReceived() {
+    const uint64_t bytes = bytesReceived();
+    const uint64_t delta = bytes - bytesSampled_;
+    bytesSampled_ = bytes;
+    return delta;
+  }
   void setTcpNoDelay(bool on);                 // 是否开启 nagle 算法
   void startRead();                            // 开启读
   void stopRead();                             // 停止读
@@ -78,7 +145,7 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
   }
 
   Buffer* inputBuffer() { return &inputBuffer_; }    // 读缓冲区
-  Buffer* outputBuffer() { return &outputBuffer_; }  // 写缓冲区
+  ChainBuffer* outputBuffer() { return &outputBuffer_; }  // 写缓冲区
 
   void setCloseCallback(const CloseCallback& cb) {
     closeCallback_ = cb;
@@ -89,21 +156,93 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
 
  private:
   enum class StateE { kDisconnected, kConnecting, kConnected, kDisconnecting };
+  // 等待 sendfile 的文件区间
+  struct FileRange {
+    int fd;                      // 文件
+    off_t offset;                // 下一次发送的位置
+    size_t remaining;            // 剩余字节数
+    uint64_t position;           // 在输出流中的位置，之前的数据写完才能发
+    WriteCompleteCallback done;  // 发完的回调
+  };
   void handleRead(Timestamp receiveTime);  // 处理读
+  void handleReceived(Timestamp receiveTime);  // poller 已经把数据收进读缓冲区
   void handleWrite();                      // 处理写
   void handleClose();                      // 处理关闭
   void handleError();                      // 处理错误
 
   void sendInLoop(const std::string_view& message);  // 向 loop 发送 message
   void sendInLoop(const void* message, size_t len);  // 像 loop 发送 message
+  void sendInLoop(const BufferSlice& message);       // 发不完的部分挂到链上
+  // 向 loop 发送 message，slice 不为空时未发完的部分引用它而不是拷贝
+  void sendInLoop(const void* message, size_t len, const BufferSlice* slice);
+  void sendvSlicesInLoop(std::span<const BufferSlice> slices);  // 切片版本
+  // 其他线程的发送先放进 pendingSends_，队列由空变非空时才往 loop 投递一次
+  void queueSend(BufferSlice&& message);
+  void queueSendFile(FileRange&& file);
+  void postPendingSends(bool wasEmpty);  // 安排发出 pendingSends_
+  void flushPendingSends();  // 在 loop 线程里按顺序发出 pendingSends_
+  // 在 loop 线程里且没有排队的发送时才能直接写，否则会超过排在前面的数据，
+  // 迁移前在旧 loop 排队的发送可能还没发出
+  bool canSendInLoop() const {
+    return getLoop()->isInLoopThread() &&
+           !hasQueuedSends_.load(std::memory_order_acquire);
+  }
+  // 一次写出 iovcnt 段数据，slices 不为空时与 iov 一一对应
+  void sendvInLoop(const struct iovec* iov,
+                   int iovcnt,
+                   const BufferSlice* slices);
+  void sendFileInLoop(int fd,
+                      off_t offset,
+                      size_t length,
+                      const WriteCompleteCallback& done);
+  ssize_t writePendingOutput(int* savedErrno);  // 按顺序写缓冲数据和文件
+  // 跳过前 skip 个字节，把剩下的数据追加到发送缓冲区
+  void appendOutput(const struct iovec* iov,
+                    int iovcnt,
+                    size_t skip,
+                    const BufferSlice* slices);
+  // 边缘触发时一直写到写完、EAGAIN 或用完预算，返回最后一次的结果
+  ssize_t writeOutput(int* savedErrno);
+  // 开始等待可写，blocked 表示刚才的写被阻塞，边缘触发时内核之后会通知
+  void waitForWritable(bool blocked);
+  void stopWaitingForWritable();  // 数据写完，不再等待可写
+  void scheduleWriteRetry();      // 下一轮再调用 handleWrite
+  void scheduleReadRetry();       // 下一轮再调用 handleRead
+  void retryWrite();
+  void retryRead();
+  void scheduleCorkFlush();  // 安排在本轮结束时写出
+  void flushCorked();        // 本轮结束时写出攒下的数据
+  void flushOutput();        // 立即写出发送缓冲区，写不完的交给 handleWrite
+  ssize_t writeOutputBuffer(int* savedErrno);  // 写发送缓冲区，必要时零拷贝
+  bool handleZeroCopyCompletions();  // 读错误队列里的零拷贝完成通知
+  void abandonPendingFiles();        // 放弃没发完的文件，调用它们的 done
+  void releaseBuffers();             // 把缓冲区的存储还给 loop 的 pool
+  // 是否还有没写完的数据
+  bool hasPendingOutput() const {
+    return outputBuffer_.readableBytes() > 0 || !pendingFiles_.empty();
+  }
+  // 没写完的字节数，包括等待发送的文件
+  size_t pendingOutputBytes() const {
+    return outputBuffer_.readableBytes() + pendingFileBytes_;
+  }
   void shutdownInLoop();                             // 半连接：只读不写
   void forceCloseInLoop();                           // 强制关闭 loop
   void setState(StateE s) { state_ = s; }            // 设置状态标志
   const char* stateToString() const;                 // 打印现在的状态
   void startReadInLoop();                            // 开启读
   void stopReadInLoop();                             // 停止读
+  void scheduleBufferRelease();                      // 安排归还空闲缓冲区
+  void releaseIdleBuffers();                         // 归还空闲缓冲区
+  // 迁移：在旧 loop 里交出连接，在新 loop 里接管
+  void migrateInLoop(EventLoop* loop, const MigrateCallback& done);
+  // undelivered 表示旧 loop 移除 channel 时收到的数据还没通知过上层
+  void migrateEstablished(const MigrateCallback& done, bool undelivered);
+  Channel* newChannel(EventLoop* loop, int fd);  // 创建设置好回调的 Channel
+  // 迁移之后，之前投递到旧 loop 的函数会在旧 loop 线程执行，转交给现在的 loop，
+  // 返回 true 表示已经转交，调用方直接返回
+  bool forwardToCurrentLoop(void (TcpConnection::*fn)());
 
-  EventLoop* loop_;                              // 所持有的 loop
+  std::atomic<EventLoop*> loop_;                 // 所持有的 loop，迁移时改变
   const std::string name_;                       // loop name
   std::atomic<StateE> state_;                    // 现在的状态
   bool reading_;                                 // 是否在读
@@ -118,7 +257,40 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
   CloseCallback closeCallback_;                  // 关闭回调
   size_t highWaterMark_;                         // 高水位线
   Buffer inputBuffer_;                           // 读缓冲区
-  Buffer outputBuffer_;                          // 写缓冲区
+  ChainBuffer outputBuffer_;                     // 写缓冲区，分段链表
+  std::deque<FileRange> pendingFiles_;           // 等待发送的文件区间
+  size_t pendingFileBytes_;                      // 等待发送的文件字节数
+  uint64_t bufferRetrieved_;                     // outputBuffer_ 累计写出的字节数
+  // 其他线程交来的待发数据，按调用顺序发送
+  using PendingSend = std::variant<BufferSlice, FileRange>;
+  std::mutex pendingMutex_;
+  std::vector<PendingSend> pendingSends_;  // 受 pendingMutex_ 保护
+  std::atomic<bool> hasQueuedSends_;       // pendingSends_ 是否非空
+  std::vector<PendingSend> flushing_;      // loop 线程正在发送的一批
+  std::vector<BufferSlice> flushBatch_;    // 连续的切片合成一次 writev
+  bool autoCork_;                          // 是否自动合并写
+  size_t maxCorkedBytes_;                  // 最多攒多少字节
+  bool corkFlushScheduled_;                // 本轮是否已经安排了写出
+  // 零拷贝发送出去、内核还没确认完成的切片
+  struct PinnedSlice {
+    uint32_t id;        // sendmsg 的序号，和完成通知的范围对应
+    BufferSlice slice;  // 发出的数据
+  };
+  bool zeroCopy_;                          // 是否零拷贝发送
+  bool zeroCopySocket_;                    // socket 是否设置过 SO_ZEROCOPY
+  size_t zeroCopyThreshold_;               // 零拷贝的最小字节数
+  uint32_t zeroCopyNextId_;                // 下一次 MSG_ZEROCOPY 发送的序号
+  int zeroCopyCopiedStreak_;               // 连续被内核拷贝的完成次数
+  std::deque<PinnedSlice> zeroCopyPinned_;  // 等待完成的切片
+  std::vector<BufferSlice> pinScratch_;     // writeFdZeroCopy 的输出
+  bool edgeTriggered_;                     // 是否边缘触发
+  bool writeWaiting_;                      // 是否在等待可写
+  ReadSizePolicy readSize_;                      // 自适应的单次读大小
+  MonoTime lastActive_;                          // 最近一次读写的时间
+  bool releaseTimerArmed_;                       // 是否已经安排了归还
+  std::atomic<bool> migrating_;                  // 是否正在迁移
+  std::atomic<uint64_t> bytesReceived_;          // 累计读到的字节数
+  uint64_t bytesSampled_;  // 上一次 sampleBytesReceived 时的 bytesReceived_
   std::any context_;
 };
 
@@ -3,6 +3,7 @@
 #include "eventloop_threadpool.h"
 #include "inet_address.h"
 #include "tcp_connection.h"
+#include "timer_id.h"
 
 #include <atomic>
 #include <cstdint>
@@ -34,6 +35,10 @@ class TcpServer {
   const std::string& ipPort() const { return ipPort_; }
   EventLoop* getLoop() const { return loop_; }
   void setThreadNum(int numThreads);
+  // IO 线程的绑核和 NUMA 策略，见 ThreadPlacement
+  void setThreadPlacement(const ThreadPlacement& placement);
+  // 新连接分配到哪个 IO 线程，默认轮询，见 LoopSelector
+  void setLoopSelector(std::unique_ptr<LoopSelector> selector);
   void setThreadInitCallback(const ThreadInitCallback& cb) {
     threadInitCallback_ = cb;
   }
@@ -51,12 +56,50 @@ class TcpServer {
     writeCompleteCallback_ = cb;
   }
 
+  // 新连接是否开启自动合并写，见 TcpConnection::setAutoCork
+  void setAutoCork(
+      bool on,
+      size_t maxCorkedBytes = TcpConnection::kDefaultMaxCorkedBytes) {
+    autoCork_ = on;
+    maxCorkedBytes_ = maxCorkedBytes;
+  }
+
+  // 新连接是否开启零拷贝发送，见 TcpConnection::setZeroCopy
+  void setZeroCopy(
+      bool on,
+      size_t threshold = TcpConnection::kDefaultZeroCopyThreshold) {
+    zeroCopy_ = on;
+    zeroCopyThreshold_ = threshold;
+  }
+
+  // 新连接是否使用边缘触发，见 TcpConnection::setEdgeTriggered
+  void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+
+  // 按 SO_INCOMING_CPU 把新连接交给绑定在该 CPU 上的 IO 线程，收包和处理在同一个核上；
+  // 要配合 setThreadPlacement 绑核，没有匹配的线程时仍按 LoopSelector 分配
+  void setIncomingCpuPlacement(bool on) { incomingCpu_ = on; }
+  // 按收包 CPU 分配成功的连接数
+  uint64_t incomingCpuMatches() const { return incomingCpuMatches_; }
+
+  // 负载均衡：每隔 interval 秒比较各 IO 线程的 EventLoop::busyRatio，
+  // 最忙的超过 high 且比最闲的高出 gap 时，把最忙线程上这段时间读得最多的连接
+  // 迁到最闲的线程，每次最多迁一个；只有一个连接的线程不迁，迁走也只是换个线程忙
+  // interval 为 0 表示关闭，默认关闭，要在 start 之前设置
+  void setRebalance(double interval, double high = 0.75, double gap = 0.25) {
+    rebalanceInterval_ = interval;
+    rebalanceHigh_ = high;
+    rebalanceGap_ = gap;
+  }
+  // 负载均衡发起的迁移次数
+  uint64_t migrations() const { return migrations_; }
+
  private:
   using ConnectionMap = std::map<std::string, TcpConnectionPtr>;
 
   void newConnection(int sockfd, const InetAddress& peerAddr);
   void removeConnection(const TcpConnectionPtr& conn);
   void removeConnectionInLoop(const TcpConnectionPtr& conn);
+  void rebalance();  // 检查一次负载，必要时迁移一个连接
 
   EventLoop* loop_;                                  // acceptor 的 loop
   const std::string ipPort_;                         // ip:port
@@ -70,6 +113,18 @@ class TcpServer {
   std::atomic<int32_t> started_;                     // 是否开启
   int nextConnId_;                                   // 下一个 EventLoop
   ConnectionMap connections_;                        // 连接 map
+  bool autoCork_;                                    // 新连接是否自动合并写
+  size_t maxCorkedBytes_;                            // 自动合并写的上限
+  bool zeroCopy_;                                    // 新连接是否零拷贝发送
+  size_t zeroCopyThreshold_;                         // 零拷贝的最小字节数
+  bool edgeTriggered_;                               // 新连接是否边缘触发
+  bool incomingCpu_;                                 // 是否按收包 CPU 分配
+  std::atomic<uint64_t> incomingCpuMatches_;         // 按收包 CPU 分配的次数
+  double rebalanceInterval_;                         // 负载均衡的检查间隔
+  double rebalanceHigh_;                             // 最忙线程的阈值
+  double rebalanceGap_;                              // 最忙和最闲的差距
+  TimerId rebalanceTimer_;                           // 负载均衡的定时器
+  std::atomic<uint64_t> migrations_;                 // 迁移次数
 };
 
 }  // namespace starry
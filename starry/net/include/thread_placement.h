@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace starry {
+
+// 本进程可以使用的 CPU 拓扑，从 sysfs 读取
+struct CpuTopology {
+  struct Cpu {
+    int id;    // CPU 编号
+    int core;  // 物理核编号，同一个核上的超线程相同
+    int node;  // NUMA 节点
+  };
+
+  std::vector<Cpu> cpus;  // 在线且在本进程亲和性掩码里的 CPU，按编号排序
+  int numNodes = 1;       // 有 CPU 的 NUMA 节点数
+
+  // 读取失败的部分按单核单节点处理，不会返回空的 cpus
+  static CpuTopology load(const std::string& sysfsRoot = "/sys/devices/system");
+  // 解析 "0-3,8,10-11" 这样的 CPU 列表
+  static std::vector<int> parseCpuList(const std::string& list);
+
+  int nodeOf(int cpu) const;
+};
+
+// EventLoopThreadPool 的线程放置策略
+// 线程在创建 EventLoop 之前绑核并设置内存策略，loop 的 BufferPool、
+// 接收缓冲区以及之后在 loop 线程申请的连接缓冲区都优先分配在本节点上
+class ThreadPlacement {
+ public:
+  enum class Policy {
+    kNone,       // 不绑定，交给调度器
+    kCpuList,    // 第 i 个线程绑定到列表里的第 i 个 CPU
+    kPerCore,    // 每个线程独占一个物理核（包括它的超线程）
+    kNumaLocal,  // 线程轮流分配到各个节点，可以在节点内的 CPU 之间迁移
+  };
+
+  // 一个线程的位置，cpus 为空表示不绑核，node 为 -1 表示不设置内存策略
+  struct Slot {
+    std::vector<int> cpus;
+    int node = -1;
+  };
+
+  ThreadPlacement() : policy_(Policy::kNone) {}
+
+  static ThreadPlacement cpuList(std::vector<int> cpus);
+  static ThreadPlacement perCore();
+  static ThreadPlacement numaLocal();
+
+  Policy policy() const { return policy_; }
+
+  // 为 numThreads 个线程分配位置，线程数多于 CPU、核或节点时循环分配
+  std::vector<Slot> assign(int numThreads, const CpuTopology& topology) const;
+
+  // 在当前线程上生效，失败时记录日志并返回 false，线程继续不受限地运行
+  static bool apply(const Slot& slot);
+
+ private:
+  explicit ThreadPlacement(Policy policy, std::vector<int> cpus = {})
+      : policy_(policy), cpus_(std::move(cpus)) {}
+
+  Policy policy_;
+  std::vector<int> cpus_;  // kCpuList 使用
+};
+
+// 设置当前线程名，超过 15 个字符的部分会被截掉
+void setCurrentThreadName(const std::string& name);
+
+}  // namespace starry
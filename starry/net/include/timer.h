@@ -1,41 +1,66 @@
 #pragma once
 
-#include <atomic>
 #include <cstdint>
+#include <typeinfo>
 #include <utility>
 #include "callbacks.h"
 
 namespace starry {
 
+class TimerPool;
+
+// 定时器对象由 TimerPool 分配，TimingWheel 用里面的链表指针把它挂到槽上
 class Timer {
  public:
-  Timer(TimerCallback cb, Timestamp when, double interval)
-      : callback_(std::move(cb)),
-        expiration_(when),
-        interval_(static_cast<int64_t>(interval * 1000)),
-        repeat_(interval > 0),
-        sequence_(++s_numCreated_) {}
+  Timer()
+      : interval_(0),
+        sequence_(0),
+        tick_(0),
+        prev_(nullptr),
+        next_(nullptr),
+        pool_(nullptr),
+        bucket_(kNoBucket),
+        canceled_(false) {}
+
+  Timer(const Timer&) = delete;
+  Timer& operator=(const Timer&) = delete;
+
+  // 从池里取出后设置，sequence 在所属的 TimerQueue 里唯一
+  void init(TimerCallback cb, MonoTime when, double interval, int64_t sequence);
+  // 放回池里之前释放回调，序号清零，之前的 TimerId 不会再匹配
+  void clear();
 
   void run() const { callback_(); }
+  const std::type_info& callbackType() const { return callback_.targetType(); }
 
-  Timestamp expiration() const { return expiration_; }
-  bool repeat() const { return repeat_; }
+  MonoTime expiration() const { return expiration_; }
+  bool repeat() const { return interval_ > 0; }
   int64_t sequence() const { return sequence_; }
-  void restart(Timestamp now);
-  static int64_t s_numCreated() { return s_numCreated_; }
+  void restart(MonoTime now);
 
-  bool operator<(const Timer t) const {
-    return expiration_ < t.expiration_;
-  } 
+  // 在本轮的回调执行期间被取消，不再执行也不再重复
+  bool canceled() const { return canceled_; }
+  void cancel() { canceled_ = true; }
+
+  TimerPool* pool() const { return pool_; }
 
  private:
-  const TimerCallback callback_;  // 定时器回调函数
-  Timestamp expiration_;          // 定时器下次触发的时间
-  const int64_t interval_;  // 如果是重复定时器，这是两次触发之间的时间间隔
-  const bool repeat_;       // 是否是重复定时器
-  const int64_t sequence_;
+  friend class TimerPool;
+  friend class TimingWheel;
+
+  static constexpr int kNoBucket = -1;
 
-  static std::atomic<int64_t> s_numCreated_;
+  TimerCallback callback_;  // 定时器回调函数
+  MonoTime expiration_;     // 定时器下次触发的时间
+  int64_t interval_;  // 重复定时器两次触发之间的间隔，单位微秒，0 表示不重复
+  // 0 表示空闲；共享池里的定时器只在持有 TimerQueue::sharedMutex_ 时读写
+  int64_t sequence_;
+  int64_t tick_;     // 时间轮里的到期 tick
+  Timer* prev_;      // 所在槽的链表，空闲时 next_ 串起空闲链表
+  Timer* next_;
+  TimerPool* pool_;  // 所属的池
+  int bucket_;       // 所在的槽，不在时间轮里时为 kNoBucket
+  bool canceled_;
 };
 
 }  // namespace starry
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "timer.h"
+
+namespace starry {
+
+// 定时器对象池：按块申请，用完放回空闲链表，池析构之前不归还内存
+// 所以过期的 TimerId 里的指针总是可以解引用，比较序号就能知道定时器还在不在
+// 不加锁，由使用者保证只在一个线程里访问或者自己加锁
+class TimerPool {
+ public:
+  static constexpr size_t kChunkSize = 1024;  // 每块的定时器个数
+
+  TimerPool() : free_(nullptr), inUse_(0) {}
+
+  TimerPool(const TimerPool&) = delete;
+  TimerPool& operator=(const TimerPool&) = delete;
+
+  Timer* allocate() {
+    if (free_ == nullptr) {
+      grow();
+    }
+    Timer* timer = free_;
+    free_ = timer->next_;
+    timer->next_ = nullptr;
+    ++inUse_;
+    return timer;
+  }
+
+  // 释放回调，放回空闲链表
+  void release(Timer* timer) {
+    assert(timer->pool_ == this);
+    timer->clear();
+    timer->next_ = free_;
+    free_ = timer;
+    --inUse_;
+  }
+
+  // 只比较地址，不解引用：timer 可能来自别的池，正在被别的线程写
+  bool owns(const Timer* timer) const {
+    std::less<const Timer*> less;
+    for (const auto& chunk : chunks_) {
+      if (!less(timer, chunk.get()) && less(timer, chunk.get() + kChunkSize)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  size_t inUse() const { return inUse_; }
+  size_t capacity() const { return chunks_.size() * kChunkSize; }
+
+ private:
+  void grow() {
+    chunks_.emplace_back(new Timer[kChunkSize]);
+    Timer* chunk = chunks_.back().get();
+    for (size_t i = kChunkSize; i > 0; --i) {
+      chunk[i - 1].pool_ = this;
+      chunk[i - 1].next_ = free_;
+      free_ = &chunk[i - 1];
+    }
+  }
+
+  std::vector<std::unique_ptr<Timer[]>> chunks_;
+  Timer* free_;   // 空闲链表，通过 Timer::next_ 串起来
+  size_t inUse_;  // 已经分配出去的个数
+};
+
+}  // namespace starry
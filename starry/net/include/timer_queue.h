@@ -1,12 +1,15 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
-#include <set>
-#include <utility>
+#include <mutex>
 #include <vector>
 
 #include "callbacks.h"
 #include "channel.h"
+#include "timer_pool.h"
+#include "timing_wheel.h"
 
 namespace starry {
 
@@ -14,40 +17,52 @@ class EventLoop;
 class Timer;
 class TimerId;
 
+// 定时器放在分层时间轮里，添加和取消都是 O(1)，用一个 timerfd 唤醒 loop
+// 到期时间按 tick 向上取整，默认 1 毫秒，见 EventLoop::setTimerResolution
+// 允许 slack 时 timerfd 设在最早的定时器最晚可以触发的时间，一次唤醒执行窗口内
+// 所有到期的定时器；新定时器的窗口包含当前设置的时间时不用重新设置
 class TimerQueue {
  public:
-  explicit TimerQueue(EventLoop* loop);
+  static constexpr std::chrono::nanoseconds kDefaultResolution =
+      std::chrono::milliseconds(1);
+
+  explicit TimerQueue(EventLoop* loop,
+                      std::chrono::nanoseconds resolution = kDefaultResolution);
   ~TimerQueue();
 
   // 添加新的定时器
-  TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+  TimerId addTimer(TimerCallback cb, MonoTime when, double interval);
   // 取消一个定时器
   void cancel(TimerId timerId);
+  // 修改 tick 的长度，可以在任意线程调用
+  void setResolution(std::chrono::nanoseconds resolution);
+  // 定时器最多可以晚 slack 触发，可以在任意线程调用
+  void setSlack(std::chrono::nanoseconds slack);
 
  private:
-  using Entry = std::pair<Timestamp, Timer*>;
-  using TimerList = std::set<Entry>;
-  using ActiveTimer = std::pair<Timer*, int64_t>;
-  using ActiveTimerSet = std::set<ActiveTimer>;
-
   void addTimerInLoop(Timer* timer);   // 添加定时器回调函数
   void cancelInLoop(TimerId timerId);  // 取消定时器回调函数
+  void setResolutionInLoop(std::chrono::nanoseconds resolution);
+  void setSlackInLoop(std::chrono::nanoseconds slack);
+  MonoTime deadlineOf(MonoTime event) const;  // event 加上 slack，不会溢出
   void handleRead();                   // 处理 timerfd 的读时间，即定时器触发
-  std::vector<Entry> getExpired(Timestamp now);  // 获取所有以过期的定时器
-  void reset(const std::vector<Entry>& expired,
-             Timestamp now);  // 重置定时器状态
-
-  bool insert(Timer* timer);  // 插入定时器
+  void reset(MonoTime now);            // 重新放入重复的定时器，释放其他的
+  void rearm();                        // 按时间轮的下一次处理时间设置 timerfd
+  void resetTimerfd(MonoTime expiration);  // 按绝对时间设置 timerfd
+  void release(Timer* timer);          // 把定时器还给所属的池
 
   EventLoop* loop_;
   const int timerfd_;
   Channel timerfdChannel_;
-  // O(1)时间找到要触发的定时器activeTimers_
-  TimerList timers_;
-  // 通过定时器指针和序号，快速查找到对应定时器，用来取消定时
-  ActiveTimerSet activeTimers_;
+  TimerPool pool_;        // loop 线程添加的定时器，不加锁
+  std::mutex sharedMutex_;
+  TimerPool sharedPool_;  // 其他线程添加的定时器，由 sharedMutex_ 保护
+  TimingWheel wheel_;
+  std::atomic<int64_t> nextSequence_;  // 定时器的序号，和指针一起组成 TimerId
+  std::vector<Timer*> expired_;        // 本次到期的定时器，复用容量
   bool callingExpiredTimers_;
-  ActiveTimerSet cancelingTimers_; // 取消的定时器
+  MonoTime armedExpiration_;  // timerfd 当前设置的触发时间，没有设置时为 max
+  std::chrono::nanoseconds slack_;  // 定时器允许推迟的时间
 };
 
 }  // namespace starry
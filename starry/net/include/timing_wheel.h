@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "callbacks.h"
+#include "timer.h"
+
+namespace starry {
+
+// 分层时间轮，TimerQueue 用它保存定时器
+// 时间按 tick 离散，到期时间向上取整到 tick，定时器不会提前触发，最多晚一个 tick
+// kLevels 层，每层 kSlots 个槽，第 L 层的一个槽覆盖 kSlots^L 个 tick；
+// 定时器放在到期 tick 和当前 tick 最高的不同位所在的层，所以同一层里有定时器的槽
+// 总在当前位置之后，不需要回绕；当前 tick 走到高层某个槽的起点时，
+// 把槽里的定时器重新放到低层
+// 插入和删除是链表操作，O(1)；每层一个 64 位的位图记录非空的槽，找下一个要处理的槽
+// 只需要几次位运算，空转的 tick 直接跳过
+class TimingWheel {
+ public:
+  static constexpr int kSlotBits = 6;
+  static constexpr int kSlots = 1 << kSlotBits;
+  static constexpr int kLevels = 11;  // 11 * 6 位，覆盖全部非负的 int64 tick
+
+  explicit TimingWheel(std::chrono::nanoseconds tick);
+
+  TimingWheel(const TimingWheel&) = delete;
+  TimingWheel& operator=(const TimingWheel&) = delete;
+
+  // 按 timer->expiration() 放入，已经过去的放到下一个 tick
+  // 返回需要处理它所在槽的时间，可能早于到期时间，见 nextEvent
+  MonoTime insert(Timer* timer);
+  void remove(Timer* timer);
+  static bool contains(const Timer* timer) {
+    return timer->bucket_ != Timer::kNoBucket;
+  }
+
+  // 取出 now 之前到期的定时器，按到期 tick 的顺序追加到 expired
+  void expire(MonoTime now, std::vector<Timer*>* expired);
+  // 下一次需要调用 expire 的时间，是最早的非空槽的起点，
+  // 可能只是把高层的槽降到低层；没有定时器时返回 MonoTime::max()
+  MonoTime nextEvent() const;
+  // now 之前没有要处理的槽时把当前 tick 直接移到 now，
+  // 之后放入的定时器按离 now 的距离选层，不用先走一遍已经过去的降级
+  void skipTo(MonoTime now);
+
+  // 修改 tick 的长度，已有的定时器按新的长度重新放置
+  void setTick(std::chrono::nanoseconds tick);
+  std::chrono::nanoseconds tick() const {
+    return std::chrono::nanoseconds(tickNanos_);
+  }
+  size_t size() const { return size_; }
+
+ private:
+  struct Slot {
+    Timer* head;
+    Timer* tail;
+  };
+
+  int64_t ceilTick(MonoTime time) const;   // 不早于 time 的第一个 tick
+  int64_t floorTick(MonoTime time) const;  // 不晚于 time 的最后一个 tick
+  MonoTime timeOf(int64_t tick) const;     // tick 的起点
+  int64_t place(Timer* timer);  // 按 tick_ 挂到槽上，返回槽的起点
+  void unlink(Timer* timer);
+  int64_t nextEventTick() const;           // 没有定时器时返回 INT64_MAX
+  void cascade(int level, int index);      // 把高层的一个槽重新放到低层
+  void takeAll(std::vector<Timer*>* timers);  // 取出所有定时器
+
+  int64_t tickNanos_;     // 一个 tick 的长度
+  int64_t currentTick_;   // 到这个 tick 为止到期的定时器都已经取出
+  size_t size_;           // 定时器个数
+  uint64_t occupied_[kLevels];       // 每层非空的槽
+  Slot slots_[kLevels * kSlots];     // 第 L 层第 i 个槽在 L * kSlots + i
+};
+
+}  // namespace starry
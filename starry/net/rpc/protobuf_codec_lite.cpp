@@ -98,6 +98,14 @@ void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
     }
 
     if (buf->readableBytes() >= implicit_cast<size_t>(kHeaderLen + len)) {
+      // 整帧切出来交给 rawCb_，不拷贝；切片不移动读指针，
+      // 解析出错时 errorCallback_ 看到的 buf 里还是这一帧，和没有 rawCb_ 时一样
+      if (rawCb_ &&
+          !rawCb_(conn, buf->peekAsSlice(kHeaderLen + len), receiveTime)) {
+        buf->retrieve(kHeaderLen + len);
+        continue;
+      }
+
       // 不使用Arena分配消息对象
       MessagePtr message(prototype_->New());  // 移除arena参数
 
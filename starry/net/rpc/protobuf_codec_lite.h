@@ -10,6 +10,7 @@
 #include <type_traits>
 
 #include "buffer.h"
+#include "buffer_slice.h"
 #include "callbacks.h"
 #include "tcp_connection.h"
 
@@ -36,8 +37,10 @@ class ProtobufCodecLite {
     kParseError,
   };
 
-  using RawMessageCallback =
-      std::function<bool(const TcpConnectionPtr&, std::string_view, Timestamp)>;
+  // 收到完整的一帧（含长度头）时先调用，切片可以在回调返回后继续持有；
+  // 返回 false 表示已经处理，不再解析成 protobuf 消息
+  using RawMessageCallback = std::function<
+      bool(const TcpConnectionPtr&, const BufferSlice&, Timestamp)>;
 
   using ProtobufMessageCallback = std::function<
       void(const TcpConnectionPtr&, const MessagePtr&, Timestamp)>;
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include <google/protobuf/wrappers.pb.h>
+#include <string>
+#include <vector>
+#include "buffer.h"
+#include "buffer_slice.h"
+#include "protobuf_codec_lite.h"
+
+namespace starry {
+
+namespace {
+
+const char kTag[] = "TEST";
+
+// 记录 codec 的各个回调
+class CodecRecorder {
+ public:
+  explicit CodecRecorder(bool parseAfterRaw)
+      : codec_(&google::protobuf::StringValue::default_instance(), kTag,
+               [this](const TcpConnectionPtr&, const MessagePtr& message,
+                      Timestamp) {
+                 values_.push_back(
+                     static_cast<google::protobuf::StringValue*>(message.get())
+                         ->value());
+               },
+               [this, parseAfterRaw](const TcpConnectionPtr&,
+                                     const BufferSlice& frame, Timestamp) {
+                 frames_.push_back(frame);
+                 return parseAfterRaw;
+               },
+               [this](const TcpConnectionPtr&, Buffer* buf, Timestamp,
+                      ProtobufCodecLite::ErrorCode errorCode) {
+                 errors_.push_back(errorCode);
+                 errorBytes_ = buf->readableBytes();
+               }) {}
+
+  // 编码一帧追加到 buf，返回这一帧的内容
+  std::string encode(const std::string& value, Buffer* buf) {
+    google::protobuf::StringValue message;
+    message.set_value(value);
+    Buffer frame;
+    codec_.fillEmptyBuffer(&frame, message);
+    std::string bytes = frame.retrieveAllAsString();
+    buf->append(bytes);
+    return bytes;
+  }
+
+  ProtobufCodecLite codec_;
+  std::vector<std::string> values_;
+  std::vector<BufferSlice> frames_;
+  std::vector<ProtobufCodecLite::ErrorCode> errors_;
+  size_t errorBytes_ = 0;
+};
+
+}  // namespace
+
+// 1. rawCb 拿到整帧的切片，返回 false 时不再解析，切片在回调之后仍然有效
+TEST(ProtobufCodecLiteTest, RawCallbackTakesFrame) {
+  CodecRecorder recorder(false);
+  Buffer buf;
+  const std::string first = recorder.encode("first", &buf);
+  const std::string second = recorder.encode("second", &buf);
+  recorder.codec_.onMessage(nullptr, &buf, Timestamp());
+
+  EXPECT_EQ(buf.readableBytes(), 0u);
+  ASSERT_EQ(recorder.frames_.size(), 2u);
+  buf.append("overwrite the storage");
+  EXPECT_EQ(recorder.frames_[0].view(), first);
+  EXPECT_EQ(recorder.frames_[1].view(), second);
+  EXPECT_TRUE(recorder.values_.empty());
+  EXPECT_TRUE(recorder.errors_.empty());
+}
+
+// 2. rawCb 返回 true 时继续解析成消息
+TEST(ProtobufCodecLiteTest, RawCallbackThenParse) {
+  CodecRecorder recorder(true);
+  Buffer buf;
+  recorder.encode("hello", &buf);
+  recorder.codec_.onMessage(nullptr, &buf, Timestamp());
+
+  EXPECT_EQ(buf.readableBytes(), 0u);
+  EXPECT_EQ(recorder.frames_.size(), 1u);
+  EXPECT_EQ(recorder.values_, std::vector<std::string>{"hello"});
+  EXPECT_TRUE(recorder.errors_.empty());
+}
+
+// 3. 校验和错误的帧：errorCallback 看到的 buf 里还是这一帧，后面的帧不再处理
+TEST(ProtobufCodecLiteTest, RawCallbackCorruptFrame) {
+  CodecRecorder recorder(true);
+  Buffer buf;
+  std::string frame = recorder.encode("broken", &buf);
+  buf.retrieveAll();
+  frame[frame.size() - 1] ^= 0x5a;
+  buf.append(frame);
+  recorder.encode("after", &buf);
+  const size_t total = buf.readableBytes();
+  recorder.codec_.onMessage(nullptr, &buf, Timestamp());
+
+  ASSERT_EQ(recorder.errors_.size(), 1u);
+  EXPECT_EQ(recorder.errors_[0], ProtobufCodecLite::ErrorCode::kCheckSumError);
+  EXPECT_EQ(recorder.errorBytes_, total);
+  EXPECT_EQ(buf.readableBytes(), total);
+  EXPECT_EQ(buf.retrieveAsString(frame.size()), frame);
+  ASSERT_EQ(recorder.frames_.size(), 1u);
+  EXPECT_EQ(recorder.frames_[0].view(), frame);
+  EXPECT_TRUE(recorder.values_.empty());
+}
+
+}  // namespace starry
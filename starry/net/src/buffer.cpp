@@ -1,10 +1,14 @@
 #include "buffer.h"
+#include "buffer_pool.h"
 #include "sockets_ops.h"
 
+#include <algorithm>
+#include <cassert>
 #include <cstddef>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/uio.h>
+#include <utility>
 
 using namespace starry;
 
@@ -12,26 +16,195 @@ const char Buffer::kCRLF[] = "\r\n";
 
 const size_t Buffer::kCheapPrepend;
 const size_t Buffer::kInitialSize;
+char Buffer::kEmptyStorage[Buffer::kCheapPrepend];
+
+Buffer::Buffer(size_t initialSize)
+    : buffer_(kEmptyStorage),
+      capacity_(kCheapPrepend),
+      pool_(nullptr),
+      shared_(nullptr),
+      readerIndex_(kCheapPrepend),
+      writerIndex_(kCheapPrepend) {
+  allocateStorage(initialSize);
+}
+
+Buffer::Buffer(BufferPool* pool)
+    : buffer_(kEmptyStorage),
+      capacity_(kCheapPrepend),
+      pool_(pool),
+      shared_(nullptr),
+      readerIndex_(kCheapPrepend),
+      writerIndex_(kCheapPrepend) {}
+
+Buffer::~Buffer() {
+  freeStorage();
+}
+
+// 只拷贝可读的数据
+Buffer::Buffer(const Buffer& rhs) : Buffer(rhs.pool_) {
+  if (rhs.hasStorage()) {
+    allocateStorage(rhs.readableBytes());
+    append(rhs.peek(), rhs.readableBytes());
+  }
+}
+
+Buffer& Buffer::operator=(const Buffer& rhs) {
+  if (this != &rhs) {
+    Buffer tmp(rhs);
+    swap(tmp);
+  }
+  return *this;
+}
+
+Buffer::Buffer(Buffer&& rhs) noexcept : Buffer(rhs.pool_) {
+  swap(rhs);
+}
+
+Buffer& Buffer::operator=(Buffer&& rhs) noexcept {
+  if (this != &rhs) {
+    Buffer tmp(std::move(rhs));
+    swap(tmp);
+  }
+  return *this;
+}
+
+// 申请新的存储，调用前必须没有可读数据
+void Buffer::allocateStorage(size_t size) {
+  assert(readableBytes() == 0);
+  freeStorage();
+  size_t total = kCheapPrepend + size;
+  if (pool_) {
+    buffer_ = pool_->allocate(total, &capacity_);
+  } else {
+    buffer_ = new char[total];
+    capacity_ = total;
+  }
+  readerIndex_ = kCheapPrepend;
+  writerIndex_ = kCheapPrepend;
+}
+
+// 归还存储，之后指向 kEmptyStorage；被切片引用时只释放自己的引用
+void Buffer::freeStorage() {
+  if (shared_) {
+    shared_->unref();
+    shared_ = nullptr;
+    buffer_ = kEmptyStorage;
+    capacity_ = kCheapPrepend;
+  } else if (hasStorage()) {
+    if (pool_) {
+      pool_->deallocate(buffer_, capacity_);
+    } else {
+      delete[] buffer_;
+    }
+    buffer_ = kEmptyStorage;
+    capacity_ = kCheapPrepend;
+  }
+  readerIndex_ = kCheapPrepend;
+  writerIndex_ = kCheapPrepend;
+}
+
+bool Buffer::releaseIfEmpty() {
+  if (readableBytes() == 0 && hasStorage()) {
+    freeStorage();
+    return true;
+  }
+  return false;
+}
+
+// 没有存储就申请，空间不够就换一块更大的，只拷贝可读数据；
+// 否则把可读数据挪到前面。存储被切片引用时不能原地搬移，也换一块
+void Buffer::makeSpace(size_t len) {
+  if (!hasStorage()) {
+    allocateStorage(len);
+  } else if (isShared()) {
+    reallocate(std::max(capacity_, kCheapPrepend + readableBytes() + len));
+  } else if (writableBytes() + prependableBytes() < len + kCheapPrepend) {
+    reallocate(std::max(capacity_ * 2, kCheapPrepend + readableBytes() + len));
+  } else {
+    assert(kCheapPrepend < readerIndex_);
+    size_t readable = readableBytes();
+    std::copy(begin() + readerIndex_, begin() + writerIndex_,
+              begin() + kCheapPrepend);
+    readerIndex_ = kCheapPrepend;
+    writerIndex_ = readerIndex_ + readable;
+    assert(readable == readableBytes());
+  }
+}
+
+// 申请新存储并把可读数据搬过去，旧存储按 freeStorage 的规则释放
+void Buffer::reallocate(size_t size) {
+  size_t readable = readableBytes();
+  char* data = nullptr;
+  size_t capacity = 0;
+  if (pool_) {
+    data = pool_->allocate(size, &capacity);
+  } else {
+    data = new char[size];
+    capacity = size;
+  }
+  std::copy(peek(), peek() + readable, data + kCheapPrepend);
+  freeStorage();
+  buffer_ = data;
+  capacity_ = capacity;
+  readerIndex_ = kCheapPrepend;
+  writerIndex_ = readerIndex_ + readable;
+}
+
+// 切片都释放后收回存储的独占权，之后就和没切过片一样
+bool Buffer::isShared() {
+  if (shared_ && shared_->unique()) {
+    delete shared_;
+    shared_ = nullptr;
+  }
+  return shared_ != nullptr;
+}
+
+// 可读数据已经不要了，存储留给切片，下次写入时重新申请
+void Buffer::releaseShared() {
+  if (isShared()) {
+    freeStorage();
+  }
+}
+
+// 切出 [peek(), peek() + len)，第一次切片时把存储交给 SharedBlock 管理；
+// 之后 makeSpace 和 prepend 都不会原地改写被切片引用的数据
+BufferSlice Buffer::peekAsSlice(size_t len) {
+  assert(len <= readableBytes());
+  if (len == 0) {
+    return BufferSlice();
+  }
+  if (!shared_) {
+    shared_ = SharedBlock::create(buffer_, capacity_, pool_);
+    shared_->ref();
+  }
+  return BufferSlice(shared_, peek(), len);
+}
 
 // 读取文件描述符 fd 的字符，如果读取超过 buffer 就使用备用缓冲区
 ssize_t Buffer::readFd(int fd, int* savedErrno) {
   char extrabuf[65536];
+  return readFd(fd, savedErrno, extrabuf, sizeof(extrabuf));
+}
+
+// 读取文件描述符 fd 的字符，超出的部分读到 extrabuf 再追加进来
+ssize_t Buffer::readFd(int fd, int* savedErrno, char* extrabuf,
+                       size_t extraLen) {
   struct iovec vec[2];
   const size_t writeable = writableBytes();
   vec[0].iov_base = begin() + writerIndex_;
   vec[0].iov_len = writeable;
   vec[1].iov_base = extrabuf;
-  vec[1].iov_len  =sizeof(extrabuf);
-  const int iovcnt = (writeable < sizeof(extrabuf)) ? 2 : 1;
+  vec[1].iov_len = extraLen;
+  const int iovcnt = (writeable < extraLen) ? 2 : 1;
   const ssize_t n = sockets::readv(fd, vec, iovcnt);
   if (n < 0) {
     *savedErrno = errno;
   } else if (static_cast<size_t>(n) <= writeable) {
     writerIndex_ += n;
   } else {
-    writerIndex_ = buffer_.size();
+    writerIndex_ = capacity_;
     append(extrabuf, n - writeable);
   }
-  
+
   return n;
 }
@@ -0,0 +1,88 @@
+#include "buffer_pool.h"
+
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <thread>
+
+using namespace starry;
+
+const size_t BufferPool::kMinBlockSize;
+const size_t BufferPool::kMaxBlockSize;
+const size_t BufferPool::kNumClasses;
+const size_t BufferPool::kDefaultMaxCachedBytes;
+
+BufferPool::BufferPool()
+    : ownerThread_(std::this_thread::get_id()),
+      maxCachedBytes_(kDefaultMaxCachedBytes),
+      idleTimeout_(0.0),
+      allocations_(0),
+      hits_(0),
+      releases_(0),
+      bytesInUse_(0),
+      bytesCached_(0) {}
+
+BufferPool::~BufferPool() {
+  for (auto& list : free_) {
+    for (char* block : list) {
+      delete[] block;
+    }
+  }
+}
+
+// 1K -> 0, 2K -> 1, ... 64K -> 6
+size_t BufferPool::classIndex(size_t size) {
+  assert(size <= kMaxBlockSize);
+  if (size <= kMinBlockSize) {
+    return 0;
+  }
+  return std::bit_width(size - 1) - std::bit_width(kMinBlockSize - 1);
+}
+
+// 小于 kMaxBlockSize 的按分级取整，优先从空闲链表取；更大的直接申请
+char* BufferPool::allocate(size_t size, size_t* capacity) {
+  allocations_.fetch_add(1, std::memory_order_relaxed);
+  if (size > kMaxBlockSize) {
+    *capacity = size;
+    bytesInUse_.fetch_add(size, std::memory_order_relaxed);
+    return new char[size];
+  }
+
+  size_t index = classIndex(size);
+  *capacity = kMinBlockSize << index;
+  bytesInUse_.fetch_add(*capacity, std::memory_order_relaxed);
+  if (isInOwnerThread() && !free_[index].empty()) {
+    char* block = free_[index].back();
+    free_[index].pop_back();
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    bytesCached_.fetch_sub(*capacity, std::memory_order_relaxed);
+    return block;
+  }
+  return new char[*capacity];
+}
+
+// 所属线程归还的块放回空闲链表，超出缓存上限或跨线程归还的直接释放
+void BufferPool::deallocate(char* block, size_t capacity) {
+  releases_.fetch_add(1, std::memory_order_relaxed);
+  bytesInUse_.fetch_sub(capacity, std::memory_order_relaxed);
+  if (capacity <= kMaxBlockSize && isInOwnerThread() &&
+      bytesCached_.load(std::memory_order_relaxed) + capacity <=
+          maxCachedBytes_) {
+    size_t index = classIndex(capacity);
+    assert((kMinBlockSize << index) == capacity);
+    free_[index].push_back(block);
+    bytesCached_.fetch_add(capacity, std::memory_order_relaxed);
+  } else {
+    delete[] block;
+  }
+}
+
+BufferPool::Stats BufferPool::stats() const {
+  Stats s;
+  s.allocations = allocations_.load(std::memory_order_relaxed);
+  s.hits = hits_.load(std::memory_order_relaxed);
+  s.releases = releases_.load(std::memory_order_relaxed);
+  s.bytesInUse = bytesInUse_.load(std::memory_order_relaxed);
+  s.bytesCached = bytesCached_.load(std::memory_order_relaxed);
+  return s;
+}
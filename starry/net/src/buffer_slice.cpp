@@ -0,0 +1,106 @@
+#include "buffer_slice.h"
+#include "buffer_pool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <string_view>
+#include <utility>
+
+using namespace starry;
+
+const size_t BufferSlice::npos;
+
+SharedBlock* SharedBlock::create(char* data,
+                                 size_t capacity,
+                                 BufferPool* pool) {
+  return new SharedBlock(data, capacity,
+                         pool ? pool->shared_from_this() : nullptr);
+}
+
+// 最后一个引用释放时归还存储，可能发生在任意线程；
+// 释放的是 pool 的最后一个引用时 pool 随之析构
+void SharedBlock::unref() {
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    if (pool_) {
+      pool_->deallocate(data_, capacity_);
+    } else {
+      delete[] data_;
+    }
+    delete this;
+  }
+}
+
+BufferSlice::BufferSlice(SharedBlock* block, const char* data, size_t size)
+    : block_(block), data_(data), size_(size) {
+  assert(block_ != nullptr);
+  block_->ref();
+}
+
+BufferSlice::BufferSlice(const BufferSlice& rhs)
+    : block_(rhs.block_), data_(rhs.data_), size_(rhs.size_) {
+  if (block_) {
+    block_->ref();
+  }
+}
+
+BufferSlice& BufferSlice::operator=(const BufferSlice& rhs) {
+  if (this != &rhs) {
+    BufferSlice tmp(rhs);
+    *this = std::move(tmp);
+  }
+  return *this;
+}
+
+BufferSlice::BufferSlice(BufferSlice&& rhs) noexcept
+    : block_(std::exchange(rhs.block_, nullptr)),
+      data_(std::exchange(rhs.data_, nullptr)),
+      size_(std::exchange(rhs.size_, 0)) {}
+
+BufferSlice& BufferSlice::operator=(BufferSlice&& rhs) noexcept {
+  if (this != &rhs) {
+    reset();
+    block_ = std::exchange(rhs.block_, nullptr);
+    data_ = std::exchange(rhs.data_, nullptr);
+    size_ = std::exchange(rhs.size_, 0);
+  }
+  return *this;
+}
+
+BufferSlice BufferSlice::copyOf(std::string_view data) {
+  if (data.empty()) {
+    return BufferSlice();
+  }
+  char* storage = new char[data.size()];
+  std::copy(data.begin(), data.end(), storage);
+  return BufferSlice(SharedBlock::create(storage, data.size(), nullptr),
+                     storage, data.size());
+}
+
+BufferSlice BufferSlice::subslice(size_t offset, size_t len) const {
+  assert(offset <= size_);
+  len = std::min(len, size_ - offset);
+  if (len == 0) {
+    return BufferSlice();
+  }
+  return BufferSlice(block_, data_ + offset, len);
+}
+
+void BufferSlice::removePrefix(size_t n) {
+  assert(n <= size_);
+  if (n == size_) {
+    reset();
+  } else {
+    data_ += n;
+    size_ -= n;
+  }
+}
+
+void BufferSlice::reset() {
+  if (block_) {
+    block_->unref();
+  }
+  block_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+}
@@ -0,0 +1,187 @@
+#include "buffer_pool.h"
+#include "chain_buffer.h"
+#include "sockets_ops.h"
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace starry;
+
+const size_t ChainBuffer::kSegmentSize;
+const int ChainBuffer::kMaxIovecs;
+const size_t ChainBuffer::kMinSliceSize;
+
+ChainBuffer::~ChainBuffer() {
+  retrieveAll();
+}
+
+char* ChainBuffer::allocateSegment() {
+  if (pool_) {
+    size_t capacity = 0;
+    char* data = pool_->allocate(kSegmentSize, &capacity);
+    assert(capacity == kSegmentSize);
+    return data;
+  }
+  return new char[kSegmentSize];
+}
+
+// 切片分段的引用随 Segment 一起析构，这里只归还自己申请的分段
+void ChainBuffer::freeSegment(const Segment& seg) {
+  if (seg.borrowed()) {
+    return;
+  }
+  if (seg.pool) {
+    seg.pool->deallocate(seg.data, kSegmentSize);
+  } else {
+    delete[] seg.data;
+  }
+}
+
+// 先填满尾段的剩余空间，不够再追加新分段；切片分段是只读的，不能往里写
+void ChainBuffer::append(const char* data, size_t len) {
+  while (len > 0) {
+    if (segments_.empty() || segments_.back().borrowed() ||
+        segments_.back().writeIndex == kSegmentSize) {
+      segments_.push_back(
+          Segment{allocateSegment(), 0, 0, BufferSlice(), pool_});
+    }
+    Segment& tail = segments_.back();
+    size_t n = std::min(len, kSegmentSize - tail.writeIndex);
+    std::copy(data, data + n, tail.data + tail.writeIndex);
+    tail.writeIndex += n;
+    readable_ += n;
+    data += n;
+    len -= n;
+  }
+}
+
+// 切片分段直接引用切片的数据，太小的切片拷贝进尾段，避免分段过碎
+void ChainBuffer::append(const BufferSlice& slice) {
+  if (slice.size() < kMinSliceSize) {
+    append(slice.data(), slice.size());
+    return;
+  }
+  segments_.push_back(Segment{const_cast<char*>(slice.data()), 0,
+                              slice.size(), slice, nullptr});
+  readable_ += slice.size();
+}
+
+// 移动头段的读指针，读完的分段归还到 pool
+void ChainBuffer::retrieve(size_t len) {
+  assert(len <= readable_);
+  readable_ -= len;
+  while (len > 0) {
+    Segment& head = segments_.front();
+    size_t n = std::min(len, head.writeIndex - head.readIndex);
+    head.readIndex += n;
+    len -= n;
+    if (head.readIndex == head.writeIndex) {
+      freeSegment(head);
+      segments_.pop_front();
+    }
+  }
+}
+
+void ChainBuffer::retrieveAll() {
+  for (const Segment& seg : segments_) {
+    freeSegment(seg);
+  }
+  segments_.clear();
+  readable_ = 0;
+}
+
+std::string ChainBuffer::retrieveAllAsString() {
+  std::string result;
+  result.reserve(readable_);
+  for (const Segment& seg : segments_) {
+    result.append(seg.data + seg.readIndex, seg.writeIndex - seg.readIndex);
+  }
+  retrieveAll();
+  return result;
+}
+
+int ChainBuffer::fillIovec(struct iovec* iov, int maxIov) const {
+  int n = 0;
+  for (auto it = segments_.begin(); it != segments_.end() && n < maxIov;
+       ++it) {
+    if (it->writeIndex > it->readIndex) {
+      iov[n].iov_base = it->data + it->readIndex;
+      iov[n].iov_len = it->writeIndex - it->readIndex;
+      ++n;
+    }
+  }
+  return n;
+}
+
+// 一次 writev 写出最多 kMaxIovecs 个分段
+ssize_t ChainBuffer::writeFd(int fd, int* savedErrno) {
+  return writeFd(fd, savedErrno, readable_);
+}
+
+// 截掉超过 maxBytes 的 iovec，用于文件之前的数据只写到文件为止
+ssize_t ChainBuffer::writeFd(int fd, int* savedErrno, size_t maxBytes) {
+  struct iovec vec[kMaxIovecs];
+  int iovcnt = fillIovec(vec, kMaxIovecs);
+  size_t total = 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    if (total + vec[i].iov_len >= maxBytes) {
+      vec[i].iov_len = maxBytes - total;
+      iovcnt = i + 1;
+      break;
+    }
+    total += vec[i].iov_len;
+  }
+  const ssize_t n = sockets::writev(fd, vec, iovcnt);
+  if (n < 0) {
+    *savedErrno = errno;
+  } else {
+    retrieve(static_cast<size_t>(n));
+  }
+  return n;
+}
+
+size_t ChainBuffer::borrowedPrefixBytes() const {
+  size_t bytes = 0;
+  for (auto it = segments_.begin(); it != segments_.end() && it->borrowed();
+       ++it) {
+    bytes += it->writeIndex - it->readIndex;
+  }
+  return bytes;
+}
+
+// 只有切片分段的数据由引用计数管理，能在内核完成之前一直保持不变
+ssize_t ChainBuffer::writeFdZeroCopy(int fd,
+                                     int* savedErrno,
+                                     std::vector<BufferSlice>* pinned) {
+  struct iovec vec[kMaxIovecs];
+  int iovcnt = 0;
+  for (auto it = segments_.begin();
+       it != segments_.end() && it->borrowed() && iovcnt < kMaxIovecs; ++it) {
+    vec[iovcnt].iov_base = it->data + it->readIndex;
+    vec[iovcnt].iov_len = it->writeIndex - it->readIndex;
+    ++iovcnt;
+  }
+  struct msghdr msg = {};
+  msg.msg_iov = vec;
+  msg.msg_iovlen = iovcnt;
+  const ssize_t n = sockets::sendmsg(fd, &msg, MSG_ZEROCOPY);
+  if (n < 0) {
+    *savedErrno = errno;
+    return n;
+  }
+  size_t left = static_cast<size_t>(n);
+  for (auto it = segments_.begin(); left > 0; ++it) {
+    size_t take = std::min(left, it->writeIndex - it->readIndex);
+    pinned->push_back(it->slice.subslice(it->readIndex, take));
+    left -= take;
+  }
+  retrieve(static_cast<size_t>(n));
+  return n;
+}
@@ -16,23 +16,24 @@ using namespace starry;
 const int Channel::kNoneEvent = 0;
 const int Channel::kReadEvent = EPOLLIN | EPOLLPRI;
 const int Channel::kWriteEvent = EPOLLOUT;
+const int Channel::kEdgeTriggered = static_cast<int>(EPOLLET);
 
 Channel::Channel(EventLoop* loop, int fd)
     : loop_(loop),
       fd_(fd),
       events_(0),
       revents_(0),
-      index_(-1),
       tied_(false),
       eventHandling_(false),
-      addedToLoop_(false) {}
+      addedToLoop_(false),
+      receivedByPoller_(false),
+      receiveBuffer_(nullptr) {}
 
 Channel::~Channel() {
   assert(!eventHandling_);
+  // 不访问 loop_，TcpConnection 的 Channel 可能在 loop 之后析构；
+  // remove 时已经清掉 addedToLoop_
   assert(!addedToLoop_);
-  if (loop_->isInLoopThread()){
-    assert(!loop_->hasChannel(this));
-  }
 }
 
 void Channel::tie(const std::shared_ptr<void>& obj){
@@ -105,6 +106,8 @@ std::string Channel::eventsToString(int fd, int ev) {
     oss << "HUP ";
   if (ev & EPOLLERR)
     oss << "ERR ";
+  if (ev & EPOLLET)
+    oss << "ET ";
   
   return oss.str();
 }
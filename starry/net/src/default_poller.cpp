@@ -0,0 +1,23 @@
+#include "epoll_poller.h"
+#include "io_uring_poller.h"
+#include "logging.h"
+#include "poller.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+using namespace starry;
+
+// STARRY_POLLER=io_uring 时优先用 io_uring，内核不支持时退回 epoll
+Poller* Poller::newDefaultPoller(EventLoop* loop) {
+  const char* backend = ::getenv("STARRY_POLLER");
+  if (backend != nullptr && ::strcmp(backend, "io_uring") == 0) {
+    std::unique_ptr<IoUringPoller> poller(new IoUringPoller(loop));
+    if (poller->valid()) {
+      return poller.release();
+    }
+    LOG_WARN << "io_uring is not available, fall back to epoll";
+  }
+  return new EpollPoller(loop);
+}
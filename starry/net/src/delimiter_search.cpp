@@ -0,0 +1,262 @@
+#include "delimiter_search.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STARRY_SEARCH_X86 1
+#endif
+
+namespace starry::search {
+
+namespace {
+
+using FindFunc = const char* (*)(const char*, const char*, const char*, size_t);
+
+// 标量实现：memchr 找首字节，再比较剩余字节
+const char* findScalar(const char* begin,
+                       const char* end,
+                       const char* token,
+                       size_t len) {
+  if (static_cast<size_t>(end - begin) < len) {
+    return nullptr;
+  }
+  const char* last = end - len;
+  const char* p = begin;
+  while (p <= last) {
+    p = static_cast<const char*>(
+        ::memchr(p, token[0], static_cast<size_t>(last - p) + 1));
+    if (p == nullptr) {
+      return nullptr;
+    }
+    if (::memcmp(p + 1, token + 1, len - 1) == 0) {
+      return p;
+    }
+    ++p;
+  }
+  return nullptr;
+}
+
+#ifdef STARRY_SEARCH_X86
+
+// 在 64 位候选掩码里逐个核对首字节之后的字节
+inline const char* verifyCandidates(uint64_t mask,
+                                    const char* base,
+                                    const char* last,
+                                    const char* token,
+                                    size_t len) {
+  while (mask != 0) {
+    const char* p = base + __builtin_ctzll(mask);
+    if (p > last) {
+      return nullptr;
+    }
+    if (::memcmp(p + 1, token + 1, len - 1) == 0) {
+      return p;
+    }
+    mask &= mask - 1;
+  }
+  return nullptr;
+}
+
+// 向量实现：每轮比较 64 字节（4 个 16 字节块）的首字节，
+// 四个块合并后只需一次判断，有候选时再逐个核对
+const char* findSse2(const char* begin,
+                     const char* end,
+                     const char* token,
+                     size_t len) {
+  if (static_cast<size_t>(end - begin) < len) {
+    return nullptr;
+  }
+  const char* last = end - len;  // token 可能出现的最后位置
+  const __m128i first = _mm_set1_epi8(token[0]);
+  const char* p = begin;
+  for (; p + 64 <= end; p += 64) {
+    const __m128i m0 = _mm_cmpeq_epi8(
+        first, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    const __m128i m1 = _mm_cmpeq_epi8(
+        first, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)));
+    const __m128i m2 = _mm_cmpeq_epi8(
+        first, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)));
+    const __m128i m3 = _mm_cmpeq_epi8(
+        first, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)));
+    const __m128i any =
+        _mm_or_si128(_mm_or_si128(m0, m1), _mm_or_si128(m2, m3));
+    if (_mm_movemask_epi8(any) != 0) {
+      const uint64_t mask =
+          static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(m0))) |
+          static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(m1)))
+              << 16 |
+          static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(m2)))
+              << 32 |
+          static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(m3)))
+              << 48;
+      if (const char* found = verifyCandidates(mask, p, last, token, len)) {
+        return found;
+      }
+      if (p + 64 > last) {
+        return nullptr;
+      }
+    }
+  }
+  return findScalar(p, end, token, len);
+}
+
+// 同 findSse2，每轮比较 128 字节（4 个 32 字节块）
+// 先处理到 32 字节对齐，主循环只做对齐加载，避免跨缓存行
+__attribute__((target("avx2"))) const char* findAvx2(const char* begin,
+                                                     const char* end,
+                                                     const char* token,
+                                                     size_t len) {
+  if (static_cast<size_t>(end - begin) < len) {
+    return nullptr;
+  }
+  const char* last = end - len;
+  const __m256i first = _mm256_set1_epi8(token[0]);
+  if (end - begin < 32) {
+    return findScalar(begin, end, token, len);
+  }
+
+  // 第一个块不对齐
+  uint64_t head = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+      first, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin)))));
+  if (const char* found = verifyCandidates(head, begin, last, token, len)) {
+    return found;
+  }
+  const char* p = reinterpret_cast<const char*>(
+      (reinterpret_cast<uintptr_t>(begin) + 32) & ~static_cast<uintptr_t>(31));
+
+  for (; p + 128 <= end; p += 128) {
+    const __m256i m0 = _mm256_cmpeq_epi8(
+        first, _mm256_load_si256(reinterpret_cast<const __m256i*>(p)));
+    const __m256i m1 = _mm256_cmpeq_epi8(
+        first, _mm256_load_si256(reinterpret_cast<const __m256i*>(p + 32)));
+    const __m256i m2 = _mm256_cmpeq_epi8(
+        first, _mm256_load_si256(reinterpret_cast<const __m256i*>(p + 64)));
+    const __m256i m3 = _mm256_cmpeq_epi8(
+        first, _mm256_load_si256(reinterpret_cast<const __m256i*>(p + 96)));
+    const __m256i any =
+        _mm256_or_si256(_mm256_or_si256(m0, m1), _mm256_or_si256(m2, m3));
+    if (!_mm256_testz_si256(any, any)) {
+      const uint64_t lo =
+          static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(m0))) |
+          static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(m1)))
+              << 32;
+      if (const char* found = verifyCandidates(lo, p, last, token, len)) {
+        return found;
+      }
+      const uint64_t hi =
+          static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(m2))) |
+          static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(m3)))
+              << 32;
+      if (const char* found = verifyCandidates(hi, p + 64, last, token, len)) {
+        return found;
+      }
+      if (p + 128 > last) {
+        return nullptr;
+      }
+    }
+  }
+  for (; p + 32 <= end; p += 32) {
+    const uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(first,
+                          _mm256_load_si256(reinterpret_cast<const __m256i*>(p)))));
+    if (const char* found = verifyCandidates(mask, p, last, token, len)) {
+      return found;
+    }
+  }
+  return findScalar(p, end, token, len);
+}
+
+#endif  // STARRY_SEARCH_X86
+
+FindFunc kernelFunc(Kernel kernel) {
+  switch (kernel) {
+#ifdef STARRY_SEARCH_X86
+    case Kernel::kAvx2:
+      return findAvx2;
+    case Kernel::kSse2:
+      return findSse2;
+#endif
+    default:
+      return findScalar;
+  }
+}
+
+// 启动时选一次内核
+Kernel selectKernel() {
+#ifdef STARRY_SEARCH_X86
+  __builtin_cpu_init();
+#endif
+  if (kernelSupported(Kernel::kAvx2)) {
+    return Kernel::kAvx2;
+  }
+  if (kernelSupported(Kernel::kSse2)) {
+    return Kernel::kSse2;
+  }
+  return Kernel::kScalar;
+}
+
+// 用局部静态变量，保证其他编译单元的静态初始化里也能安全调用
+Kernel kernelInUse() {
+  static const Kernel kernel = selectKernel();
+  return kernel;
+}
+
+FindFunc findInUse() {
+  static const FindFunc func = kernelFunc(kernelInUse());
+  return func;
+}
+
+}  // namespace
+
+const char* find(const char* begin, const char* end, std::string_view token) {
+  if (token.empty()) {
+    return begin;
+  }
+  return findInUse()(begin, end, token.data(), token.size());
+}
+
+const char* find(Kernel kernel,
+                 const char* begin,
+                 const char* end,
+                 std::string_view token) {
+  if (token.empty()) {
+    return begin;
+  }
+  return kernelFunc(kernel)(begin, end, token.data(), token.size());
+}
+
+Kernel activeKernel() {
+  return kernelInUse();
+}
+
+bool kernelSupported(Kernel kernel) {
+  switch (kernel) {
+#ifdef STARRY_SEARCH_X86
+    case Kernel::kAvx2:
+      return __builtin_cpu_supports("avx2");
+    case Kernel::kSse2:
+      return __builtin_cpu_supports("sse2");
+#endif
+    case Kernel::kScalar:
+      return true;
+    default:
+      return false;
+  }
+}
+
+const char* kernelName(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::kAvx2:
+      return "avx2";
+    case Kernel::kSse2:
+      return "sse2";
+    default:
+      return "scalar";
+  }
+}
+
+}  // namespace starry::search
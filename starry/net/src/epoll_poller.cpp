@@ -15,12 +15,12 @@
 
 using namespace starry;
 
-const int kNew = -1;
+const int kNew = ChannelTable::kNoState;
 const int kAdded = 1;
 const int kDeleted = 2;
 
 EpollPoller::EpollPoller(EventLoop* loop)
-    : ownerLoop_(loop),
+    : Poller(loop),
       epollfd_(::epoll_create1(EPOLL_CLOEXEC)),
       events_(kInitEventListSize) {
   if (epollfd_ < 0) {
@@ -33,13 +33,12 @@ EpollPoller::~EpollPoller() {
 }
 
 // 把监听到的活跃文件描述符通过 fillActiveChannels 放到 activeChannels中
-Timestamp EpollPoller::poll(int timeoutMs, ChannelList* activeChannels) {
+void EpollPoller::poll(int timeoutMs, ChannelList* activeChannels) {
   LOG_TRACE << "fd total count " << channels_.size();
   int numEvents = ::epoll_wait(epollfd_, events_.data(),
                                static_cast<int>(events_.size()), timeoutMs);
 
   int savedErron = errno;
-  auto now = Clock::now();
   if (numEvents > 0) {
     LOG_TRACE << numEvents << " events happened";
     fillActiveChannels(numEvents, activeChannels);
@@ -54,7 +53,6 @@ Timestamp EpollPoller::poll(int timeoutMs, ChannelList* activeChannels) {
       LOG_FATAL << "EPollPoller::poll()";
     }
   }
-  return now;
 }
 
 void EpollPoller::fillActiveChannels(int numEvents,
@@ -68,31 +66,28 @@ void EpollPoller::fillActiveChannels(int numEvents,
 }
 
 // kNew 加入 events_, kDeleted 判断有没有删干净， kAdded
-// 没有事件就删除fd，有事件就修改
+// 没有事件就删除fd，有事件就修改；状态记在 channels_ 的表项里
 void EpollPoller::updateChannel(Channel* channel) {
   assertInLoopThread();
-  const int index = channel->index();
-  LOG_TRACE << "fd = " << channel->fd() << "events = " << channel->events()
+  const int fd = channel->fd();
+  ChannelTable::Entry* entry = channels_.find(fd);
+  const int index = entry != nullptr ? entry->state : kNew;
+  LOG_TRACE << "fd = " << fd << "events = " << channel->events()
             << " index = " << index;
-  int fd = channel->fd();
   if (index == kNew || index == kDeleted) {
     if (index == kNew) {
-      assert(channels_.find(fd) == channels_.end());
-      channels_[fd] = channel;
+      entry = channels_.insert(fd, channel, kAdded);
     } else {
-      assert(channels_.find(fd) != channels_.end());
-      assert(channels_[fd] == channel);
+      assert(entry->channel == channel);
+      entry->state = kAdded;
     }
-
-    channel->setIndex(kAdded);
     update(EPOLL_CTL_ADD, channel);
   } else {
-    assert(channels_.find(fd) != channels_.end());
-    assert(channels_[fd] == channel);
+    assert(entry->channel == channel);
     assert(index == kAdded);
     if (channel->isNoneEvent()) {
       update(EPOLL_CTL_DEL, channel);
-      channel->setIndex(kDeleted);
+      entry->state = kDeleted;
     } else {
       update(EPOLL_CTL_MOD, channel);
     }
@@ -104,19 +99,17 @@ void EpollPoller::removeChannel(Channel* channel) {
   assertInLoopThread();
   int fd = channel->fd();
   LOG_TRACE << "fd = " << fd;
-  assert(channels_.find(fd) != channels_.end());
-  assert(channels_[fd] == channel);
+  ChannelTable::Entry* entry = channels_.find(fd);
+  assert(entry != nullptr);
+  assert(entry->channel == channel);
   assert(channel->isNoneEvent());
-  int index = channel->index();
+  int index = entry->state;
   assert(index == kAdded || index == kDeleted);
-  size_t n = channels_.erase(fd);
-  (void)n;
-  assert(n == 1);
+  channels_.erase(fd);
 
   if (index == kAdded) {
     update(EPOLL_CTL_DEL, channel);
   }
-  channel->setIndex(kNew);
 }
 
 // 把 channel 转换成 event 用 epoll_ctl 执行对 fd 的operation
@@ -149,9 +142,3 @@ const std::string EpollPoller::operationToString(int op) {
       return "Unknown Operation";
   }
 }
-
-bool EpollPoller::hasChannel(Channel* channel) const {
-  assertInLoopThread();
-  ChannelMap::const_iterator it = channels_.find(channel->fd());
-  return it != channels_.end() && it->second == channel;
-}
@@ -1,8 +1,9 @@
+#include "buffer_pool.h"
 #include "callbacks.h"
 #include "channel.h"
 #include "eventloop.h"
 #include "logging.h"
-#include "epoll_poller.h"
+#include "poller.h"
 #include "sockets_ops.h"
 #include "timer_id.h"
 #include "timer_queue.h"
@@ -13,10 +14,11 @@
 #include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <ctime>
 #include <functional>
-#include <mutex>
 #include <thread>
 #include <utility>
 
@@ -24,6 +26,7 @@ using namespace starry;
 
 thread_local EventLoop* t_loopInThisThread = 0;
 const int kPollTimeMs = 10000;
+const int kBusyPollMinDivisor = 16;  // 自旋窗口最小缩到最大窗口的 1/16
 
 // 创建唤醒 looping_ 的fd
 int createEventfd() {
@@ -35,6 +38,13 @@ int createEventfd() {
   return evtfd;
 }
 
+// 两个时间之间的纳秒数，混用粗粒度时钟时可能倒退，记为 0
+uint64_t nanosBetween(MonoTime start, MonoTime end) {
+  return end > start ? static_cast<uint64_t>((end - start) /
+                                             std::chrono::nanoseconds(1))
+                     : 0;
+}
+
 // 正确设置 wakeupFd_ ,使之能唤醒 looping_
 EventLoop::EventLoop()
     : looping_(false),
@@ -43,11 +53,28 @@ EventLoop::EventLoop()
       callingPendingFunctors_(false),
       iteration_(0),
       threadId_(std::this_thread::get_id()),
-      epollPoller_(new EpollPoller(this)),
+      pollReturnTime_(Clock::now()),
+      now_(MonoClock::now()),
+      coarseClock_(false),
+      poller_(Poller::newDefaultPoller(this)),
+      busyPoll_(false),
+      busyPollWindowUs_(kDefaultBusyPollUs),
+      spinWindowNs_(0),
+      bufferPool_(std::make_shared<BufferPool>()),
+      receiveScratch_(new char[kReceiveScratchSize]),
+      connections_(0),
+      busyEwma_(0.0),
+      busyUpdatedNanos_(MonoClock::now().time_since_epoch() /
+                        std::chrono::nanoseconds(1)),
+      heartbeat_(0),
+      activity_(Activity::kIdle),
+      currentFd_(-1),
+      currentCallback_(nullptr),
       timerQueue_(new TimerQueue(this)),
       wakeupFd_(createEventfd()),
       wakeupChannel_(new Channel(this, wakeupFd_)),
-      currentActiveChannel_(nullptr) {
+      currentActiveChannel_(nullptr),
+      callingIterationEnd_(false) {
   LOG_DEBUG << "EventLoop created " << this << " in thread " << threadId_;
   if (t_loopInThisThread) {
     LOG_FATAL << "Another EventLoop " << t_loopInThisThread
@@ -69,35 +96,133 @@ EventLoop::~EventLoop() {
   t_loopInThisThread = nullptr;
 }
 
-// 从 epollPoller_ 获得 activeChannels_, 处理活跃的 channel 和 预处理函数
+// 从 poller_ 获得 activeChannels_, 处理活跃的 channel 和 预处理函数
 void EventLoop::loop() {
   assert(!looping_);
   assertInLoopThread();
   looping_ = true;
-  quit_ = false;
   LOG_TRACE << "EventLoop " << this << " start looping";
+  // loop 之外投递的函数没有唤醒，队列非空时其他线程投递也不会唤醒，
+  // 先唤醒一次，第一轮 poll 不阻塞
+  if (pendingFunctors_.size() > 0 || !iterationEndFunctors_.empty()) {
+    wakeup();
+  }
 
+  // 分布用精确时钟，没有开启粗粒度时钟时直接用本轮缓存的时间
+  MonoTime iterationEnd = MonoClock::now();
   while (!quit_) {
     activeChannels_.clear();
-    pollReturnTime_ = epollPoller_->poll(kPollTimeMs, &activeChannels_);
+    setActivity(Activity::kPolling);
+    const bool busyPoll = busyPoll_.load(std::memory_order_relaxed);
+    if (busyPoll) {
+      busyPollOnce();
+    } else {
+      poller_->poll(kPollTimeMs, &activeChannels_);
+    }
+    updateClock();
+    const MonoTime handleStart =
+        coarseClock_.load(std::memory_order_relaxed) ? MonoClock::now() : now_;
+    const uint64_t pollNanos = nanosBetween(iterationEnd, handleStart);
+    metrics_.pollNanos.record(pollNanos);
+    updateBusy(pollNanos, false, handleStart);
+    metrics_.eventsPerIteration.record(activeChannels_.size());
     ++iteration_;
+    LoopStats::add(stats_.wakeups, 1);
     if (Logger::logLevel() <= LogLevel::TRACE) {
       printActiceChannels();
     }
     eventHandling_ = true;
+    setActivity(Activity::kHandlingEvents);
+    MonoTime handlerStart = handleStart;
     for (Channel* channel : activeChannels_) {
       currentActiveChannel_ = channel;
+      beginCallback(channel->fd(), nullptr);
       currentActiveChannel_->handleEvent(pollReturnTime_);
+      const MonoTime handlerEnd = MonoClock::now();
+      metrics_.handlerNanos.record(nanosBetween(handlerStart, handlerEnd));
+      handlerStart = handlerEnd;
     }
     currentActiveChannel_ = nullptr;
     eventHandling_ = false;
-    doPendingFunctors();
+    beginCallback(-1, nullptr);
+    const size_t functors = doPendingFunctors();
+    iterationEnd = MonoClock::now();
+    if (functors > 0) {
+      metrics_.functorNanos.record(nanosBetween(handlerStart, iterationEnd));
+    }
+    const uint64_t handleNanos = nanosBetween(handleStart, iterationEnd);
+    metrics_.iterationNanos.record(handleNanos);
+    updateBusy(handleNanos, true, iterationEnd);
+    if (busyPoll) {
+      LoopStats::add(stats_.handleNanos, handleNanos);
+    }
   }
 
+  // quit 之前投递的函数也要执行，比如 TcpServer 析构时投递的 connectDestroyed，
+  // 它和 quit 几乎同时到达时，可能赶上 loop 刚取走这一轮的函数
+  doPendingFunctors();
   LOG_TRACE << "EventLoop " << this << " stop looping";
+  setActivity(Activity::kIdle);
+  // 在结束时而不是开始时清除，loop 之前调用的 quit 才不会丢失，
+  // 否则 EventLoopThread 刚启动就析构时线程不会退出
+  quit_ = false;
   looping_ = false;
 }
 
+// poll 和处理各记一段，按时长加权：w = 1 - e^(-t/tau)，一段通常远短于 tau，
+// 用一阶近似 t/tau 省掉 exp
+void EventLoop::updateBusy(uint64_t nanos, bool busy, MonoTime end) {
+  const double weight =
+      std::min(1.0, static_cast<double>(nanos) / kBusyDecayNanos);
+  const double ewma = busyEwma_.load(std::memory_order_relaxed);
+  busyEwma_.store(ewma + weight * ((busy ? 1.0 : 0.0) - ewma),
+                  std::memory_order_relaxed);
+  busyUpdatedNanos_.store(end.time_since_epoch() / std::chrono::nanoseconds(1),
+                          std::memory_order_relaxed);
+}
+
+// 当前这一段还没有记录：阻塞在 poll 里的按空闲衰减，
+// 卡在一个很慢的回调里的按忙碌上升，不用等这一轮结束
+double EventLoop::busyRatio() const {
+  const double ewma = busyEwma_.load(std::memory_order_relaxed);
+  const Activity activity = activity_.load(std::memory_order_relaxed);
+  if (activity == Activity::kIdle) {
+    return ewma;
+  }
+  const int64_t elapsed =
+      MonoClock::now().time_since_epoch() / std::chrono::nanoseconds(1) -
+      busyUpdatedNanos_.load(std::memory_order_relaxed);
+  if (elapsed <= 0) {
+    return ewma;
+  }
+  const double keep = std::exp(-static_cast<double>(elapsed) / kBusyDecayNanos);
+  return activity == Activity::kPolling ? ewma * keep
+                                        : 1.0 - (1.0 - ewma) * keep;
+}
+
+// 每轮只读一次时钟，本轮的定时器、回调和 runAfter 都用缓存的值
+void EventLoop::updateClock() {
+  using std::chrono::duration_cast;
+  if (coarseClock_.load(std::memory_order_relaxed)) {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    now_ = MonoTime(duration_cast<MonoClock::duration>(
+        std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec)));
+    ::clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    pollReturnTime_ = Timestamp(duration_cast<Clock::duration>(
+        std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec)));
+  } else {
+    now_ = MonoClock::now();
+    pollReturnTime_ = Clock::now();
+  }
+}
+
+MonoTime EventLoop::refreshNow() {
+  assertInLoopThread();
+  now_ = MonoClock::now();
+  return now_;
+}
+
 // 离开循环，唤醒 looping_ 确保成功离开
 void EventLoop::quit() {
   quit_ = true;
@@ -106,6 +231,58 @@ void EventLoop::quit() {
   }
 }
 
+// 阻塞在 poll 里的 loop 需要唤醒才能切换模式
+void EventLoop::setBusyPoll(bool on, int windowUs) {
+  busyPollWindowUs_ = std::max(windowUs, 1);
+  busyPoll_ = on;
+  if (!isInLoopThread()) {
+    wakeup();
+  }
+}
+
+// 在自旋窗口内反复零超时 poll，等到事件就返回，窗口用完再阻塞
+// 自旋等到事件，或者阻塞后很快就有事件，说明有流量，窗口加倍；
+// 阻塞超过最大窗口说明空闲，窗口减半，避免空转浪费 CPU
+void EventLoop::busyPollOnce() {
+  using std::chrono::nanoseconds;
+  using std::chrono::steady_clock;
+  const int64_t windowNs =
+      static_cast<int64_t>(busyPollWindowUs_.load(std::memory_order_relaxed)) *
+      1000;
+  if (spinWindowNs_ <= 0 || spinWindowNs_ > windowNs) {
+    spinWindowNs_ = windowNs;
+  }
+
+  const auto start = steady_clock::now();
+  const auto deadline = start + nanoseconds(spinWindowNs_);
+  auto now = start;
+  do {
+    poller_->poll(0, &activeChannels_);
+    now = steady_clock::now();
+    if (!activeChannels_.empty() || quit_) {
+      LoopStats::add(stats_.spinNanos,
+                     static_cast<uint64_t>((now - start) / nanoseconds(1)));
+      LoopStats::add(stats_.spinHits, 1);
+      spinWindowNs_ = std::min(spinWindowNs_ * 2, windowNs);
+      return;
+    }
+  } while (now < deadline);
+  LoopStats::add(stats_.spinNanos,
+                 static_cast<uint64_t>((now - start) / nanoseconds(1)));
+  LoopStats::add(stats_.spinMisses, 1);
+
+  poller_->poll(kPollTimeMs, &activeChannels_);
+  const auto end = steady_clock::now();
+  LoopStats::add(stats_.blockNanos,
+                 static_cast<uint64_t>((end - now) / nanoseconds(1)));
+  if (end - now < nanoseconds(windowNs)) {
+    spinWindowNs_ = std::min(spinWindowNs_ * 2, windowNs);
+  } else {
+    spinWindowNs_ =
+        std::max(spinWindowNs_ / 2, windowNs / kBusyPollMinDivisor);
+  }
+}
+
 // 如果是当前线程就执行，否则就加入到队列中等待执行
 void EventLoop::runInLoop(Functor cb) {
   if (isInLoopThread()) {
@@ -115,52 +292,82 @@ void EventLoop::runInLoop(Functor cb) {
   }
 }
 
-// 把 cb 放到 pendingFunctors_ 中
+// 把 cb 放到 pendingFunctors_ 中，只在队列由空变为非空时唤醒；
+// loop 线程自己投递的会在本轮 doPendingFunctors 执行，不需要唤醒
 void EventLoop::queueInLoop(Functor cb) {
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    pendingFunctors_.push_back(std::move(cb));
+  size_t prev = pendingFunctors_.push(std::move(cb));
+  if (prev == 0 && !isInLoopThread()) {
+    wakeup();
   }
+}
 
-  if (!isInLoopThread() || callingPendingFunctors_) {
+// 放到 iterationEndFunctors_ 中，在本轮 doPendingFunctors 的最后执行；
+// 正在执行本轮结束函数时再添加的要等下一轮，需要唤醒
+void EventLoop::runAtIterationEnd(Functor cb) {
+  assertInLoopThread();
+  iterationEndFunctors_.push_back(std::move(cb));
+  if (callingIterationEnd_) {
     wakeup();
   }
 }
 
-// 返回 pendingFunctors_ 的大小，访问时要加锁
-size_t EventLoop::queueSize() {
-  std::lock_guard<std::mutex> lock(mutex_);
+// 返回 pendingFunctors_ 的大小，读原子计数，不加锁
+size_t EventLoop::queueSize() const {
   return pendingFunctors_.size();
 }
 
+// 系统时间在调用时换算成单调时间，之后调整系统时间不影响这个定时器
 TimerId EventLoop::runAt(Timestamp time, TimerCallback cb) {
+  MonoTime when =
+      MonoClock::now() +
+      std::chrono::duration_cast<MonoClock::duration>(time - Clock::now());
+  return runAt(when, std::move(cb));
+}
+
+TimerId EventLoop::runAt(MonoTime time, TimerCallback cb) {
   return timerQueue_->addTimer(std::move(cb), time, 0.0);
 }
 
 TimerId EventLoop::runAfter(double delay, TimerCallback cb) {
-  Timestamp time = Clock::now() +
-                   std::chrono::nanoseconds(static_cast<int64_t>(delay * 1e9));
+  MonoTime time = timerBase() + std::chrono::nanoseconds(
+                                    static_cast<int64_t>(delay * 1e9));
   return runAt(time, std::move(cb));
 }
 
 TimerId EventLoop::runEvery(double interval, TimerCallback cb) {
-  Timestamp time = Clock::now() + std::chrono::nanoseconds(
-                                      static_cast<int64_t>(interval * 1e9));
+  MonoTime time = timerBase() + std::chrono::nanoseconds(
+                                    static_cast<int64_t>(interval * 1e9));
   return timerQueue_->addTimer(std::move(cb), time, interval);
 }
 
+// loop 线程在循环中用本轮缓存的时间，其他线程和循环开始之前读当前时间
+MonoTime EventLoop::timerBase() const {
+  if (looping_.load(std::memory_order_relaxed) && isInLoopThread()) {
+    return now_;
+  }
+  return MonoClock::now();
+}
+
 void EventLoop::cancel(TimerId timerId) {
   return timerQueue_->cancel(timerId);
 }
 
-// 调用 epollPoller_ 的函数更新 channel
+void EventLoop::setTimerResolution(std::chrono::nanoseconds tick) {
+  timerQueue_->setResolution(tick);
+}
+
+void EventLoop::setTimerSlack(std::chrono::nanoseconds slack) {
+  timerQueue_->setSlack(slack);
+}
+
+// 调用 poller_ 的函数更新 channel
 void EventLoop::updateChannel(Channel* channel) {
   assert(channel->ownerLoop() == this);
   assertInLoopThread();
-  epollPoller_->updateChannel(channel);
+  poller_->updateChannel(channel);
 }
 
-// 调用 epollPoller_ 的函数，移除指定 channel 或者 非活跃的 channel
+// 调用 poller_ 的函数，移除指定 channel 或者 非活跃的 channel
 void EventLoop::removeChannel(Channel* channel) {
   assert(channel->ownerLoop() == this);
   assertInLoopThread();
@@ -169,14 +376,18 @@ void EventLoop::removeChannel(Channel* channel) {
            std::find(activeChannels_.begin(), activeChannels_.end(), channel) ==
                activeChannels_.end());
   }
-  epollPoller_->removeChannel(channel);
+  poller_->removeChannel(channel);
 }
 
-// 调用 epollPoller_ 的函数，查看是否有该 channel
+// 调用 poller_ 的函数，查看是否有该 channel
 bool EventLoop::hasChannel(Channel* channel) {
   assert(channel->ownerLoop() == this);
   assertInLoopThread();
-  return epollPoller_->hasChannel(channel);
+  return poller_->hasChannel(channel);
+}
+
+const char* EventLoop::pollerName() const {
+  return poller_->name();
 }
 
 // 打印崩溃信息
@@ -205,19 +416,60 @@ void EventLoop::handleRead() {
 }
 
 // 执行预处理函数
-void EventLoop::doPendingFunctors() {
-  std::vector<Functor> functors;
+size_t EventLoop::doPendingFunctors() {
   callingPendingFunctors_ = true;
+  setActivity(Activity::kRunningFunctors);
 
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    functors.swap(pendingFunctors_);
+  pendingFunctors_.drain(&runningFunctors_);
+  metrics_.pendingFunctors.record(runningFunctors_.size());
+  size_t executed = runningFunctors_.size();
+  for (const Functor& functor : runningFunctors_) {
+    beginCallback(-1, &functor.targetType());
+    functor();
   }
+  runningFunctors_.clear();
 
-  for (const Functor& functor : functors) {
+  // 本轮结束函数，期间 queueInLoop 的函数会唤醒下一轮
+  callingIterationEnd_ = true;
+  runningIterationEnd_.swap(iterationEndFunctors_);
+  executed += runningIterationEnd_.size();
+  for (const Functor& functor : runningIterationEnd_) {
+    beginCallback(-1, &functor.targetType());
     functor();
   }
+  runningIterationEnd_.clear();
+  callingIterationEnd_ = false;
   callingPendingFunctors_ = false;
+  beginCallback(-1, nullptr);
+
+  // 执行期间投递的函数不会唤醒（队列非空），由这里唤醒下一轮
+  if (pendingFunctors_.size() > 0) {
+    wakeup();
+  }
+  return executed;
+}
+
+EventLoop::Progress EventLoop::progress() const {
+  Progress progress;
+  progress.heartbeat = heartbeat_.load(std::memory_order_relaxed);
+  progress.activity = activity_.load(std::memory_order_relaxed);
+  progress.fd = currentFd_.load(std::memory_order_relaxed);
+  progress.callback = currentCallback_.load(std::memory_order_relaxed);
+  return progress;
+}
+
+const char* EventLoop::activityName(Activity activity) {
+  switch (activity) {
+    case Activity::kIdle:
+      return "idle";
+    case Activity::kPolling:
+      return "polling";
+    case Activity::kHandlingEvents:
+      return "handling events";
+    case Activity::kRunningFunctors:
+      return "running functors";
+  }
+  return "unknown";
 }
 
 // 调试：打印活跃的 channel
@@ -32,6 +32,12 @@ EventLoop* EventLoopThread::startLoop() {
 
 // 创建一个 loop_, 并运行
 void EventLoopThread::threadFunc() {
+  if (!name_.empty()) {
+    setCurrentThreadName(name_);
+  }
+  // 先确定位置再创建 loop，loop 的内存才会分配在本节点上
+  ThreadPlacement::apply(placement_);
+
   EventLoop* loop = new EventLoop();  // 使用堆分配
 
   if (callback_) {
@@ -5,6 +5,7 @@
 #include <cstdio>
 #include <memory>
 #include <string>
+#include <vector>
 #include "eventloop_threadpool.h"
 
 using namespace starry;
@@ -14,7 +15,8 @@ EventLoopThreadPool::EventLoopThreadPool(EventLoop* baseLoop, const std::string&
       name_(nameArg),
       started_(false),
       numThreads_(0),
-      next_(0) {}
+      next_(0),
+      selector_(LoopSelector::newRoundRobin()) {}
 
 EventLoopThreadPool::~EventLoopThreadPool() {}
 
@@ -25,10 +27,23 @@ void EventLoopThreadPool::start(const ThreadInitCallback& cb) {
 
   started_ = true;
 
+  std::vector<ThreadPlacement::Slot> slots;
+  if (placement_.policy() != ThreadPlacement::Policy::kNone) {
+    slots = placement_.assign(numThreads_, CpuTopology::load());
+  }
+
   for (int i = 0; i < numThreads_; i++) {
     EventLoopThread* t = new EventLoopThread(cb, name_ + std::to_string(i));
+    if (!slots.empty()) {
+      t->setPlacement(slots[i]);
+    }
     threads_.push_back(std::unique_ptr<EventLoopThread>(t));
     loops_.push_back(t->startLoop());
+    if (!slots.empty()) {
+      for (int cpu : slots[i].cpus) {
+        loopsByCpu_[cpu].loops.push_back(loops_.back());
+      }
+    }
   }
 
   if (!numThreads_ && cb) {
@@ -60,6 +75,36 @@ EventLoop* EventLoopThreadPool::getLoopForHash(size_t hashCode) {
   return loop;
 }
 
+// 用 selector_ 选择线程，没有子线程时返回 baseLoop_
+EventLoop* EventLoopThreadPool::selectLoop(size_t hashCode) {
+  baseLoop_->assertInLoopThread();
+  assert(started_);
+  if (loops_.empty()) {
+    return baseLoop_;
+  }
+  return selector_->select(loops_, hashCode);
+}
+
+// 只看放置策略给线程分配的 CPU，没有设置放置策略时总是返回 nullptr
+EventLoop* EventLoopThreadPool::loopForCpu(int cpu, size_t hashCode) {
+  baseLoop_->assertInLoopThread();
+  assert(started_);
+  auto it = loopsByCpu_.find(cpu);
+  if (it == loopsByCpu_.end()) {
+    return nullptr;
+  }
+  // selector_ 的轮询位置和连接数比较都是针对全部 loop 的，
+  // 拿它在一个 CPU 的几个 loop 里选会打乱 selectLoop 的分配
+  CpuLoops& pinned = it->second;
+  const size_t n = pinned.loops.size();
+  if (selector_->needsHash()) {
+    return pinned.loops[hashCode % n];
+  }
+  EventLoop* loop = pinned.loops[pinned.next++];
+  pinned.next %= n;
+  return loop;
+}
+
 // 获取全部线程
 std::vector<EventLoop*> EventLoopThreadPool::getAllLoops() {
   baseLoop_->assertInLoopThread();
@@ -70,3 +115,12 @@ std::vector<EventLoop*> EventLoopThreadPool::getAllLoops() {
     return loops_;
   }
 }
+
+// 每个线程上的连接数，顺序和 getAllLoops 相同
+std::vector<int> EventLoopThreadPool::connectionCounts() {
+  std::vector<int> counts;
+  for (EventLoop* loop : getAllLoops()) {
+    counts.push_back(loop->connectionCount());
+  }
+  return counts;
+}
@@ -0,0 +1,76 @@
+#include "histogram.h"
+
+#include <cstdio>
+
+using namespace starry;
+
+int HistogramSnapshot::bucketIndex(uint64_t value) {
+  if (value < kSubBuckets) {
+    return static_cast<int>(value);
+  }
+  const int exponent = 63 - __builtin_clzll(value);
+  const int shift = exponent - kSubBucketBits;
+  return (shift + 1) * kSubBuckets +
+         static_cast<int>((value >> shift) & (kSubBuckets - 1));
+}
+
+uint64_t HistogramSnapshot::bucketLowerBound(int index) {
+  if (index < kSubBuckets) {
+    return static_cast<uint64_t>(index);
+  }
+  const int shift = index / kSubBuckets - 1;
+  const uint64_t sub = static_cast<uint64_t>(index % kSubBuckets);
+  return (kSubBuckets + sub) << shift;
+}
+
+uint64_t HistogramSnapshot::bucketUpperBound(int index) {
+  if (index < kSubBuckets) {
+    return static_cast<uint64_t>(index);
+  }
+  const int shift = index / kSubBuckets - 1;
+  return bucketLowerBound(index) + ((uint64_t{1} << shift) - 1);
+}
+
+uint64_t HistogramSnapshot::percentile(double p) const {
+  if (count == 0) {
+    return 0;
+  }
+  p = p < 0 ? 0 : (p > 1 ? 1 : p);
+  // 第 rank 个记录（从 1 开始）所在的桶
+  uint64_t rank = static_cast<uint64_t>(p * static_cast<double>(count) + 0.5);
+  rank = rank == 0 ? 1 : rank;
+  uint64_t seen = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    seen += counts[i];
+    if (seen >= rank) {
+      uint64_t upper = bucketUpperBound(i);
+      return upper < max ? upper : max;
+    }
+  }
+  return max;
+}
+
+std::string HistogramSnapshot::toString() const {
+  char buf[192];
+  snprintf(buf, sizeof(buf),
+           "count=%llu mean=%.0f p50=%llu p90=%llu p99=%llu p999=%llu max=%llu",
+           static_cast<unsigned long long>(count), mean(),
+           static_cast<unsigned long long>(percentile(0.5)),
+           static_cast<unsigned long long>(percentile(0.9)),
+           static_cast<unsigned long long>(percentile(0.99)),
+           static_cast<unsigned long long>(percentile(0.999)),
+           static_cast<unsigned long long>(max));
+  return buf;
+}
+
+// 总数按各桶之和计算，保证分位数和计数一致
+HistogramSnapshot Histogram::snapshot() const {
+  HistogramSnapshot snap;
+  for (int i = 0; i < HistogramSnapshot::kBuckets; ++i) {
+    snap.counts[i] = counts_[i].load(std::memory_order_relaxed);
+    snap.count += snap.counts[i];
+  }
+  snap.sum = sum_.load(std::memory_order_relaxed);
+  snap.max = max_.load(std::memory_order_relaxed);
+  return snap;
+}
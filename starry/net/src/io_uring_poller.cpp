@@ -0,0 +1,720 @@
+#include "io_uring_poller.h"
+#include "buffer.h"
+#include "channel.h"
+#include "eventloop.h"
+#include "logging.h"
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+using namespace starry;
+
+namespace {
+
+const int kAdded = 1;
+
+// 取消请求的 user_data，完成时直接忽略
+const uint64_t kRemoveData = 0;
+// 更新固定文件表的 user_data，fd 部分是 -1，不会和 channel 的请求重复
+const uint64_t kFilesUpdateData = 0xffffffff00000000ULL;
+// 从固定文件表里移除
+const int kNoFile = -1;
+
+// 高 32 位是 fd，低 32 位是挂载序号
+uint64_t makeUserData(int fd, uint32_t generation) {
+  return static_cast<uint64_t>(static_cast<uint32_t>(fd)) << 32 | generation;
+}
+
+int userDataFd(uint64_t data) {
+  return static_cast<int>(data >> 32);
+}
+
+int ioUringSetup(unsigned entries, io_uring_params* params) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringRegister(int fd, unsigned opcode, void* arg, unsigned nrArgs) {
+  return static_cast<int>(
+      ::syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+
+}  // namespace
+
+IoUringPoller::IoUringPoller(EventLoop* loop)
+    : Poller(loop),
+      ringFd_(-1),
+      enterFd_(-1),
+      enterFlags_(0),
+      taskrunFlag_(false),
+      ringPtr_(MAP_FAILED),
+      ringSize_(0),
+      sqes_(nullptr),
+      sqesSize_(0),
+      sqHead_(nullptr),
+      sqTail_(nullptr),
+      sqFlags_(nullptr),
+      sqArray_(nullptr),
+      sqMask_(0),
+      sqEntries_(0),
+      cqHead_(nullptr),
+      cqTail_(nullptr),
+      cqes_(nullptr),
+      cqMask_(0),
+      fixedFileSlots_(0),
+      fixedFiles_(0),
+      receiveSupported_(false),
+      bufferRing_(nullptr),
+      receiveBuffers_(nullptr),
+      bufferTail_(0),
+      generation_(0),
+      inflight_(0),
+      enterCalls_(0),
+      submittedEntries_(0),
+      receivedBytes_(0),
+      receiveCompletions_(0),
+      receiveBufferShortages_(0) {
+  if (!setupRing()) {
+    unmapRing();
+    return;
+  }
+  setupFixedFiles();
+  setupReceiveBuffers();
+}
+
+IoUringPoller::~IoUringPoller() {
+  if (valid()) {
+    drain();
+  }
+  unmapRing();
+}
+
+// 创建 ring 并映射 SQ、CQ 和 SQE 数组，需要单次映射和带超时的等待
+bool IoUringPoller::setupRing() {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  // 只在进入内核时处理完成任务，减少打断 loop 线程；
+  // 有待处理的任务时内核设置 IORING_SQ_TASKRUN，不等待的 poll 据此决定是否进入内核
+  params.flags = IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG;
+  ringFd_ = ioUringSetup(kRingEntries, &params);
+  if (ringFd_ < 0 && errno == EINVAL) {
+    memset(&params, 0, sizeof(params));
+    ringFd_ = ioUringSetup(kRingEntries, &params);
+  }
+  if (ringFd_ < 0) {
+    LOG_SYSERR << "io_uring_setup";
+    return false;
+  }
+  taskrunFlag_ = (params.flags & IORING_SETUP_TASKRUN_FLAG) != 0;
+  const unsigned required =
+      IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP;
+  if ((params.features & required) != required) {
+    LOG_WARN << "io_uring lacks required features " << params.features;
+    return false;
+  }
+
+  size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_t cqSize =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  ringSize_ = sqSize > cqSize ? sqSize : cqSize;
+  ringPtr_ = ::mmap(nullptr, ringSize_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+  if (ringPtr_ == MAP_FAILED) {
+    LOG_SYSERR << "mmap io_uring ring";
+    return false;
+  }
+  sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  void* sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    LOG_SYSERR << "mmap io_uring sqes";
+    return false;
+  }
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+  char* base = static_cast<char*>(ringPtr_);
+  sqHead_ = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+  sqTail_ = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+  sqFlags_ = reinterpret_cast<unsigned*>(base + params.sq_off.flags);
+  sqArray_ = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+  sqMask_ = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+  sqEntries_ = params.sq_entries;
+  cqHead_ = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+  cqTail_ = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+  cqMask_ = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+
+  // 注册 ring fd，失败不影响使用
+  enterFd_ = ringFd_;
+  io_uring_rsrc_update update;
+  memset(&update, 0, sizeof(update));
+  update.offset = static_cast<uint32_t>(-1);
+  update.data = static_cast<uint64_t>(ringFd_);
+  if (ioUringRegister(ringFd_, IORING_REGISTER_RING_FDS, &update, 1) == 1) {
+    enterFd_ = static_cast<int>(update.offset);
+    enterFlags_ = IORING_ENTER_REGISTERED_RING;
+  }
+  return true;
+}
+
+// 注册一张空的固定文件表，channel 注册时把 fd 放进下标为 fd 的槽位；
+// 表的大小不能超过 RLIMIT_NOFILE，失败时所有请求都用普通 fd
+void IoUringPoller::setupFixedFiles() {
+  unsigned slots = kMaxFixedFiles;
+  struct rlimit limit;
+  if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < slots) {
+    slots = static_cast<unsigned>(limit.rlim_cur);
+  }
+  io_uring_rsrc_register reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.nr = slots;
+  reg.flags = IORING_RSRC_REGISTER_SPARSE;
+  if (ioUringRegister(ringFd_, IORING_REGISTER_FILES2, &reg, sizeof(reg)) < 0) {
+    LOG_WARN << "io_uring fixed files are not available: "
+             << strerror_tl(errno);
+    return;
+  }
+  fileValues_.reset(new int[slots]);
+  for (unsigned i = 0; i < slots; ++i) {
+    fileValues_[i] = static_cast<int>(i);
+  }
+  fixedFileSlots_ = slots;
+}
+
+// 注册缓冲区环，multishot recv 从这里取缓冲区；
+// 数据在 poll 返回前追加到 channel 的缓冲区，缓冲区马上归还
+void IoUringPoller::setupReceiveBuffers() {
+  const size_t ringBytes = kReceiveBuffers * sizeof(io_uring_buf);
+  void* ring = ::mmap(nullptr, ringBytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring == MAP_FAILED) {
+    LOG_SYSERR << "mmap io_uring buffer ring";
+    return;
+  }
+  void* buffers =
+      ::mmap(nullptr, static_cast<size_t>(kReceiveBuffers) * kReceiveBufferSize,
+             PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffers == MAP_FAILED) {
+    LOG_SYSERR << "mmap io_uring receive buffers";
+    ::munmap(ring, ringBytes);
+    return;
+  }
+  bufferRing_ = static_cast<io_uring_buf*>(ring);
+  receiveBuffers_ = static_cast<char*>(buffers);
+
+  io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+  reg.ring_entries = kReceiveBuffers;
+  reg.bgid = kBufferGroup;
+  if (ioUringRegister(ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    LOG_WARN << "io_uring buffer ring is not available: "
+             << strerror_tl(errno);
+    ::munmap(receiveBuffers_,
+             static_cast<size_t>(kReceiveBuffers) * kReceiveBufferSize);
+    ::munmap(bufferRing_, ringBytes);
+    bufferRing_ = nullptr;
+    receiveBuffers_ = nullptr;
+    return;
+  }
+  for (unsigned i = 0; i < kReceiveBuffers; ++i) {
+    recycleBuffer(static_cast<uint16_t>(i));
+  }
+  receiveSupported_ = true;
+}
+
+void IoUringPoller::drain() {
+  for (size_t fd = 0; fd < states_.size(); ++fd) {
+    const PollState& state = states_[fd];
+    if (state.channel == nullptr) {
+      continue;
+    }
+    if (state.armedData != 0) {
+      queuePollRemove(state.armedData);
+    }
+    if (state.recvData != 0 && !state.recvCanceling) {
+      queueCancel(state.recvData);
+    }
+  }
+  struct __kernel_timespec ts;
+  ts.tv_sec = 0;
+  ts.tv_nsec = 100 * 1000 * 1000;
+  io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+  arg.sigmask_sz = _NSIG / 8;
+  arg.ts = reinterpret_cast<uint64_t>(&ts);
+  while (inflight_ > 0) {
+    const unsigned toSubmit =
+        *sqTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    int ret = enter(toSubmit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                    &arg, sizeof(arg));
+    if (ret < 0 && errno != EINTR) {
+      break;  // 超时也不再等，剩下的交给内核回收
+    }
+    unsigned head = *cqHead_;
+    const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      if (!(cqes_[head & cqMask_].flags & IORING_CQE_F_MORE)) {
+        --inflight_;
+      }
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+  }
+  if (fixedFileSlots_ > 0) {
+    ioUringRegister(ringFd_, IORING_UNREGISTER_FILES, nullptr, 0);
+  }
+  if (bufferRing_ != nullptr) {
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = kBufferGroup;
+    ioUringRegister(ringFd_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+  }
+}
+
+void IoUringPoller::unmapRing() {
+  if (sqes_ != nullptr) {
+    ::munmap(sqes_, sqesSize_);
+    sqes_ = nullptr;
+  }
+  if (ringPtr_ != MAP_FAILED) {
+    ::munmap(ringPtr_, ringSize_);
+    ringPtr_ = MAP_FAILED;
+  }
+  if (ringFd_ >= 0) {
+    ::close(ringFd_);
+    ringFd_ = -1;
+  }
+  if (bufferRing_ != nullptr) {
+    ::munmap(receiveBuffers_,
+             static_cast<size_t>(kReceiveBuffers) * kReceiveBufferSize);
+    ::munmap(bufferRing_, kReceiveBuffers * sizeof(io_uring_buf));
+    bufferRing_ = nullptr;
+    receiveBuffers_ = nullptr;
+  }
+}
+
+// 先把本轮变化的 fd 挂好，再和等待一起提交，最后收割完成事件，
+// 收到的数据追加到各自的缓冲区之后才交给 EventLoop
+void IoUringPoller::poll(int timeoutMs, ChannelList* activeChannels) {
+  LOG_TRACE << "fd total count " << channels_.size();
+  for (int fd : dirty_) {
+    reconcile(fd);
+  }
+  dirty_.clear();
+
+  // 移除 channel 时顺带收割的事件还没交出去，这一轮不等待
+  submitAndWait(ready_.empty() ? timeoutMs : 0);
+  reapCompletions();
+  appendReceived(-1);
+  for (int fd : ready_) {
+    PollState* state = findState(fd);
+    if (state == nullptr || state->revents == 0) {
+      continue;  // 已经移除，或者重复的记录
+    }
+    state->channel->setRevent(state->revents);
+    state->revents = 0;
+    activeChannels->push_back(state->channel);
+  }
+  ready_.clear();
+  if (!activeChannels->empty()) {
+    LOG_TRACE << activeChannels->size() << " events happened";
+  } else {
+    LOG_TRACE << "nothing happened";
+  }
+}
+
+// 新的 channel 记录下来并放进固定文件表，真正的挂载推迟到 poll，
+// 同一轮的多次修改只提交一次
+void IoUringPoller::updateChannel(Channel* channel) {
+  assertInLoopThread();
+  const int fd = channel->fd();
+  LOG_TRACE << "fd = " << fd << " events = " << channel->events();
+  ChannelTable::Entry* entry = channels_.find(fd);
+  if (entry == nullptr) {
+    channels_.insert(fd, channel, kAdded);
+    if (static_cast<size_t>(fd) >= states_.size()) {
+      states_.resize(channels_.capacity(), PollState());
+    }
+    PollState state = PollState();
+    state.channel = channel;
+    state.receiving = receiveSupported_ && channel->receiveBuffer() != nullptr;
+    channel->setReceivedByPoller(state.receiving);
+    if (static_cast<unsigned>(fd) < fixedFileSlots_) {
+      queueFilesUpdate(fd, &fileValues_[fd]);
+      state.fixedFile = true;
+      ++fixedFiles_;
+    }
+    states_[fd] = state;
+  } else {
+    assert(entry->channel == channel);
+    assert(entry->state == kAdded);
+  }
+  dirty_.push_back(fd);
+}
+
+// 取消挂着的请求，之后到达的完成事件序号对不上会被忽略；
+// recv 取消之前已经收进缓冲区环的数据在这里交给 channel，迁移连接时不能丢：
+// 立即提交取消并处理完成任务，被取消的 recv 不会再从 socket 取数据
+void IoUringPoller::removeChannel(Channel* channel) {
+  assertInLoopThread();
+  const int fd = channel->fd();
+  LOG_TRACE << "fd = " << fd;
+  assert(channels_.find(fd) != nullptr);
+  assert(channels_.channel(fd) == channel);
+  assert(channel->isNoneEvent());
+  PollState* state = findState(fd);
+  assert(state != nullptr);
+  if (state->armedData != 0) {
+    queuePollRemove(state->armedData);
+  }
+  if (state->recvData != 0) {
+    if (!state->recvCanceling) {
+      queueCancel(state->recvData);
+    }
+    submitAndWait(0);
+    reapCompletions();
+  }
+  if (state->receiving) {
+    appendReceived(fd);  // 包括之前移除别的 channel 时收割到的
+  }
+  if (state->fixedFile) {
+    queueFilesUpdate(fd, &kNoFile);
+    --fixedFiles_;
+  }
+  channel->setReceivedByPoller(false);
+  *state = PollState();
+  channels_.erase(fd);
+}
+
+IoUringPoller::PollState* IoUringPoller::findState(int fd) {
+  if (fd < 0 || static_cast<size_t>(fd) >= states_.size() ||
+      states_[fd].channel == nullptr) {
+    return nullptr;
+  }
+  return &states_[fd];
+}
+
+// 接管读的 channel 用 multishot recv 代替可读事件，其余事件仍然用 poll 请求
+void IoUringPoller::reconcile(int fd) {
+  PollState* found = findState(fd);
+  if (found == nullptr) {
+    return;  // 已经移除
+  }
+  PollState& state = *found;
+  const int events = state.channel->events();
+  const bool wantRecv = state.receiving && (events & EPOLLIN);
+  if (wantRecv && state.recvData == 0) {
+    state.recvData = makeUserData(fd, ++generation_);
+    queueRecv(fd, state.fixedFile, state.recvData);
+  } else if (!wantRecv && state.recvData != 0 && !state.recvCanceling) {
+    // 取消之前收到的数据照常交给 channel，最终的完成事件到了才能重新挂上
+    queueCancel(state.recvData);
+    state.recvCanceling = true;
+  }
+
+  const int pollEvents = state.receiving ? (events & ~EPOLLIN) : events;
+  if (state.armedData != 0 && state.armedEvents == pollEvents) {
+    return;
+  }
+  if (state.armedData != 0) {
+    queuePollRemove(state.armedData);
+    state.armedData = 0;
+  }
+  if ((pollEvents & ~EPOLLET) != 0) {
+    state.armedData = makeUserData(fd, ++generation_);
+    state.armedEvents = pollEvents;
+    queuePollAdd(fd, state.fixedFile, pollEvents, state.armedData);
+  }
+}
+
+// SQ 满了先提交一批再取
+io_uring_sqe* IoUringPoller::nextSqe() {
+  unsigned tail = *sqTail_;
+  unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+  if (tail - head >= sqEntries_) {
+    submitAndWait(0);
+    head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (tail - head >= sqEntries_) {
+      LOG_FATAL << "io_uring submission queue is full";
+    }
+  }
+  unsigned index = tail & sqMask_;
+  io_uring_sqe* sqe = &sqes_[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqArray_[index] = index;
+  return sqe;
+}
+
+// 每个请求最后都有一个不带 IORING_CQE_F_MORE 的完成事件
+void IoUringPoller::commitSqe() {
+  __atomic_store_n(sqTail_, *sqTail_ + 1, __ATOMIC_RELEASE);
+  ++inflight_;
+}
+
+// 边缘触发的 channel 用多次触发的请求，只在有新的唤醒时通知，一直挂着
+void IoUringPoller::queuePollAdd(int fd,
+                                 bool fixedFile,
+                                 int events,
+                                 uint64_t userData) {
+  io_uring_sqe* sqe = nextSqe();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  if (fixedFile) {
+    sqe->flags = IOSQE_FIXED_FILE;
+  }
+  // epoll 的事件位和 poll 的相同，EPOLLRDHUP 也就是 POLLRDHUP
+  sqe->poll32_events = static_cast<uint32_t>(events & ~EPOLLET);
+  if (events & EPOLLET) {
+    sqe->len = IORING_POLL_ADD_MULTI;
+  }
+  sqe->user_data = userData;
+  commitSqe();
+}
+
+void IoUringPoller::queuePollRemove(uint64_t userData) {
+  io_uring_sqe* sqe = nextSqe();
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->fd = -1;
+  sqe->addr = userData;
+  sqe->user_data = kRemoveData;
+  commitSqe();
+}
+
+// 一直挂着，每次有数据就从缓冲区环取一个缓冲区收进去，
+// 缓冲区环用完、出错或者对端关闭时结束
+void IoUringPoller::queueRecv(int fd, bool fixedFile, uint64_t userData) {
+  io_uring_sqe* sqe = nextSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  if (fixedFile) {
+    sqe->flags |= IOSQE_FIXED_FILE;
+  }
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->buf_group = kBufferGroup;
+  sqe->user_data = userData;
+  commitSqe();
+}
+
+void IoUringPoller::queueCancel(uint64_t userData) {
+  io_uring_sqe* sqe = nextSqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = userData;
+  sqe->user_data = kRemoveData;
+  commitSqe();
+}
+
+// 在提交时按顺序执行，排在后面的请求看到的是更新后的表；
+// file 指向的值要保持到提交，所以指向 fileValues_ 或者 kNoFile
+void IoUringPoller::queueFilesUpdate(int fd, const int* file) {
+  io_uring_sqe* sqe = nextSqe();
+  sqe->opcode = IORING_OP_FILES_UPDATE;
+  sqe->fd = -1;
+  sqe->addr = reinterpret_cast<uint64_t>(file);
+  sqe->len = 1;
+  sqe->off = static_cast<uint64_t>(fd);
+  sqe->user_data = kFilesUpdateData;
+  commitSqe();
+}
+
+void IoUringPoller::submitAndWait(int waitMs) {
+  const unsigned toSubmit =
+      *sqTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+  int ret = 0;
+  if (waitMs == 0) {
+    // 没有要提交的、也没有待处理的完成任务时不进入内核，忙轮询也能看到新的完成事件
+    if (toSubmit == 0 && !taskWorkPending()) {
+      return;
+    }
+    ret = enter(toSubmit, 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+  } else {
+    struct __kernel_timespec ts;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if (waitMs > 0) {
+      ts.tv_sec = waitMs / 1000;
+      ts.tv_nsec = static_cast<long long>(waitMs % 1000) * 1000 * 1000;
+      arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+    ret = enter(toSubmit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                &arg, sizeof(arg));
+  }
+  if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY &&
+      errno != EAGAIN) {
+    LOG_SYSERR << "io_uring_enter";
+  }
+}
+
+// 没有 TASKRUN_FLAG 时完成任务由内核异步处理，不需要进入内核
+bool IoUringPoller::taskWorkPending() const {
+  return taskrunFlag_ &&
+         (__atomic_load_n(sqFlags_, __ATOMIC_ACQUIRE) & IORING_SQ_TASKRUN);
+}
+
+int IoUringPoller::enter(unsigned toSubmit,
+                         unsigned minComplete,
+                         unsigned flags,
+                         const void* arg,
+                         size_t argSize) {
+  ++enterCalls_;
+  int ret = static_cast<int>(::syscall(__NR_io_uring_enter, enterFd_, toSubmit,
+                                       minComplete, flags | enterFlags_, arg,
+                                       argSize));
+  if (ret > 0) {
+    submittedEntries_ += static_cast<uint64_t>(ret);
+  }
+  return ret;
+}
+
+// 请求完成后就不再挂着，记下来在下一轮按需要重新挂上
+void IoUringPoller::reapCompletions() {
+  unsigned head = *cqHead_;
+  const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head) {
+    const io_uring_cqe& cqe = cqes_[head & cqMask_];
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+      --inflight_;
+    }
+    if (cqe.user_data == kRemoveData) {
+      continue;
+    }
+    if (cqe.user_data == kFilesUpdateData) {
+      if (cqe.res < 0) {
+        LOG_ERROR << "io_uring files update error = " << -cqe.res;
+      }
+      continue;
+    }
+    const int fd = userDataFd(cqe.user_data);
+    PollState* state = findState(fd);
+    if (state != nullptr && state->recvData == cqe.user_data) {
+      handleRecvCompletion(state, fd, cqe);
+      continue;
+    }
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+      // channel 已经移除，它的数据在移除时已经交出去了
+      recycleBuffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+    }
+    if (state == nullptr || state->armedData != cqe.user_data) {
+      continue;  // 已经被取消或替换
+    }
+    // 多次触发的请求还挂着时带 IORING_CQE_F_MORE，否则需要重新挂上
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+      state->armedData = 0;
+      dirty_.push_back(fd);
+    }
+    if (cqe.res < 0) {
+      if (cqe.res == -EBADF && state->fixedFile) {
+        dropFixedFile(state, fd);
+      } else if (cqe.res != -ECANCELED) {
+        LOG_ERROR << "io_uring poll fd = " << fd << " error = " << -cqe.res;
+        markReady(state, fd, POLLERR);
+      }
+      continue;
+    }
+    markReady(state, fd, cqe.res);
+  }
+  __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
+
+// 数据先记下来，收割完再追加，缓冲区在追加后归还；
+// 对端关闭和出错记在 channel 上，都以 EPOLLIN 通知读回调
+void IoUringPoller::handleRecvCompletion(PollState* state,
+                                         int fd,
+                                         const io_uring_cqe& cqe) {
+  if (!(cqe.flags & IORING_CQE_F_MORE)) {
+    state->recvData = 0;
+    state->recvCanceling = false;
+    dirty_.push_back(fd);
+  }
+  if (cqe.res > 0) {
+    assert(cqe.flags & IORING_CQE_F_BUFFER);
+    ++receiveCompletions_;
+    receivedBytes_ += static_cast<uint64_t>(cqe.res);
+    received_.push_back(ReceivedChunk{
+        fd, static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT),
+        static_cast<uint32_t>(cqe.res)});
+    markReady(state, fd, EPOLLIN);
+    return;
+  }
+  if (cqe.flags & IORING_CQE_F_BUFFER) {
+    recycleBuffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+  }
+  if (cqe.res == 0) {
+    state->channel->received()->eof = true;
+    markReady(state, fd, EPOLLIN);
+  } else if (cqe.res == -ENOBUFS) {
+    ++receiveBufferShortages_;  // 缓冲区在这一轮归还，下一轮重新挂上
+  } else if (cqe.res == -ECANCELED) {
+    // 关闭了读
+  } else if (cqe.res == -EBADF && state->fixedFile) {
+    dropFixedFile(state, fd);
+  } else if (cqe.res == -EINVAL) {
+    // 内核不支持 multishot recv，这个 channel 和之后注册的都退回等可读
+    LOG_WARN << "io_uring multishot recv is not supported, fd = " << fd;
+    receiveSupported_ = false;
+    state->receiving = false;
+    state->channel->setReceivedByPoller(false);
+  } else {
+    state->channel->received()->error = -cqe.res;
+    markReady(state, fd, EPOLLIN);
+  }
+}
+
+void IoUringPoller::markReady(PollState* state, int fd, int revents) {
+  if (state->revents == 0) {
+    ready_.push_back(fd);
+  }
+  state->revents |= revents;
+}
+
+void IoUringPoller::dropFixedFile(PollState* state, int fd) {
+  LOG_WARN << "io_uring fixed file is not usable, fd = " << fd;
+  queueFilesUpdate(fd, &kNoFile);
+  state->fixedFile = false;
+  --fixedFiles_;
+  dirty_.push_back(fd);
+}
+
+void IoUringPoller::appendReceived(int fd) {
+  size_t kept = 0;
+  for (size_t i = 0; i < received_.size(); ++i) {
+    const ReceivedChunk chunk = received_[i];
+    if (fd >= 0 && chunk.fd != fd) {
+      received_[kept++] = chunk;
+      continue;
+    }
+    PollState* state = findState(chunk.fd);
+    if (state != nullptr) {
+      Channel* channel = state->channel;
+      channel->receiveBuffer()->append(
+          receiveBuffers_ +
+              static_cast<size_t>(chunk.bufferId) * kReceiveBufferSize,
+          chunk.len);
+      channel->received()->bytes += chunk.len;
+    }
+    recycleBuffer(chunk.bufferId);
+  }
+  received_.resize(kept);
+}
+
+// 放回环尾，tail 和第一个缓冲区的 resv 字段重叠，不能整体赋值
+void IoUringPoller::recycleBuffer(uint16_t bufferId) {
+  io_uring_buf* buf = &bufferRing_[bufferTail_ & (kReceiveBuffers - 1)];
+  buf->addr = reinterpret_cast<uint64_t>(
+      receiveBuffers_ + static_cast<size_t>(bufferId) * kReceiveBufferSize);
+  buf->len = kReceiveBufferSize;
+  buf->bid = bufferId;
+  ++bufferTail_;
+  __atomic_store_n(&bufferRing_[0].resv, bufferTail_, __ATOMIC_RELEASE);
+}
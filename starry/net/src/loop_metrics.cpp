@@ -0,0 +1,27 @@
+#include "loop_metrics.h"
+
+using namespace starry;
+
+LoopMetrics::Snapshot LoopMetrics::snapshot() const {
+  Snapshot snap;
+  snap.pollNanos = pollNanos.snapshot();
+  snap.eventsPerIteration = eventsPerIteration.snapshot();
+  snap.handlerNanos = handlerNanos.snapshot();
+  snap.pendingFunctors = pendingFunctors.snapshot();
+  snap.functorNanos = functorNanos.snapshot();
+  snap.timerNanos = timerNanos.snapshot();
+  snap.iterationNanos = iterationNanos.snapshot();
+  return snap;
+}
+
+std::string LoopMetrics::Snapshot::toString() const {
+  std::string result;
+  result += "poll ns:          " + pollNanos.toString() + "\n";
+  result += "events/iteration: " + eventsPerIteration.toString() + "\n";
+  result += "handler ns:       " + handlerNanos.toString() + "\n";
+  result += "functors/drain:   " + pendingFunctors.toString() + "\n";
+  result += "functor ns:       " + functorNanos.toString() + "\n";
+  result += "timer ns:         " + timerNanos.toString() + "\n";
+  result += "iteration ns:     " + iterationNanos.toString() + "\n";
+  return result;
+}
@@ -0,0 +1,85 @@
+#include "loop_selector.h"
+#include "eventloop.h"
+
+using namespace starry;
+
+std::unique_ptr<LoopSelector> LoopSelector::newRoundRobin() {
+  return std::make_unique<RoundRobinSelector>();
+}
+
+std::unique_ptr<LoopSelector> LoopSelector::newLeastConnections() {
+  return std::make_unique<LeastConnectionsSelector>();
+}
+
+std::unique_ptr<LoopSelector> LoopSelector::newLeastQueue() {
+  return std::make_unique<LeastQueueSelector>();
+}
+
+std::unique_ptr<LoopSelector> LoopSelector::newPowerOfTwoChoices() {
+  return std::make_unique<PowerOfTwoChoicesSelector>();
+}
+
+std::unique_ptr<LoopSelector> LoopSelector::newHash() {
+  return std::make_unique<HashSelector>();
+}
+
+EventLoop* RoundRobinSelector::select(const std::vector<EventLoop*>& loops,
+                                      size_t) {
+  EventLoop* loop = loops[next_ % loops.size()];
+  next_ = (next_ + 1) % loops.size();
+  return loop;
+}
+
+EventLoop* LeastConnectionsSelector::select(
+    const std::vector<EventLoop*>& loops, size_t) {
+  const size_t n = loops.size();
+  size_t best = next_ % n;
+  for (size_t i = 1; i < n; ++i) {
+    size_t index = (next_ + i) % n;
+    if (loops[index]->connectionCount() < loops[best]->connectionCount()) {
+      best = index;
+    }
+  }
+  next_ = best + 1;
+  return loops[best];
+}
+
+EventLoop* LeastQueueSelector::select(const std::vector<EventLoop*>& loops,
+                                      size_t) {
+  const size_t n = loops.size();
+  size_t best = next_ % n;
+  for (size_t i = 1; i < n; ++i) {
+    size_t index = (next_ + i) % n;
+    if (loops[index]->queueSize() < loops[best]->queueSize()) {
+      best = index;
+    }
+  }
+  next_ = best + 1;
+  return loops[best];
+}
+
+uint64_t PowerOfTwoChoicesSelector::nextRandom() {
+  state_ ^= state_ << 13;
+  state_ ^= state_ >> 7;
+  state_ ^= state_ << 17;
+  return state_;
+}
+
+EventLoop* PowerOfTwoChoicesSelector::select(
+    const std::vector<EventLoop*>& loops, size_t) {
+  const size_t n = loops.size();
+  if (n == 1) {
+    return loops[0];
+  }
+  // 第二个从其余 n - 1 个里取，保证两个不同
+  size_t first = nextRandom() % n;
+  size_t second = (first + 1 + nextRandom() % (n - 1)) % n;
+  EventLoop* a = loops[first];
+  EventLoop* b = loops[second];
+  double busyA = a->busyRatio();
+  double busyB = b->busyRatio();
+  if (busyA != busyB) {
+    return busyA < busyB ? a : b;
+  }
+  return a->connectionCount() <= b->connectionCount() ? a : b;
+}
@@ -0,0 +1,124 @@
+#include "loop_watchdog.h"
+#include "logging.h"
+
+#include <cxxabi.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+using namespace starry;
+
+namespace {
+
+std::string demangle(const std::type_info* type) {
+  if (type == nullptr) {
+    return std::string();
+  }
+  int status = 0;
+  char* name = abi::__cxa_demangle(type->name(), nullptr, nullptr, &status);
+  std::string result = status == 0 && name != nullptr ? name : type->name();
+  std::free(name);
+  return result;
+}
+
+}  // namespace
+
+LoopWatchdog::LoopWatchdog(double threshold)
+    : threshold_(threshold),
+      reportInterval_(kDefaultReportInterval),
+      running_(false),
+      stalls_(0),
+      reports_(0) {}
+
+LoopWatchdog::~LoopWatchdog() {
+  stop();
+}
+
+void LoopWatchdog::watch(EventLoop* loop) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  loops_.push_back(Watched{loop, loop->progress().heartbeat, MonoClock::now(),
+                           false, MonoTime::min(), 0});
+}
+
+void LoopWatchdog::unwatch(EventLoop* loop) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  loops_.erase(std::remove_if(loops_.begin(), loops_.end(),
+                              [loop](const Watched& w) { return w.loop == loop; }),
+               loops_.end());
+}
+
+void LoopWatchdog::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (running_) {
+    return;
+  }
+  running_ = true;
+  thread_ = std::thread(&LoopWatchdog::threadFunc, this);
+}
+
+void LoopWatchdog::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  cond_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+// 每 threshold 的 1/4 检查一次，卡住之后最多晚 1/4 个 threshold 发现
+void LoopWatchdog::threadFunc() {
+  const auto interval = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::duration<double>(threshold_ / 4));
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_) {
+    cond_.wait_for(lock, interval);
+    if (running_) {
+      check(MonoClock::now());
+    }
+  }
+}
+
+// 在 poll 里等待或者没有在 loop 的不算卡住；心跳变化说明在正常推进
+void LoopWatchdog::check(MonoTime now) {
+  for (Watched& w : loops_) {
+    const EventLoop::Progress progress = w.loop->progress();
+    if (progress.heartbeat != w.heartbeat ||
+        progress.activity == EventLoop::Activity::kPolling ||
+        progress.activity == EventLoop::Activity::kIdle) {
+      w.heartbeat = progress.heartbeat;
+      w.since = now;
+      w.stalled = false;
+      continue;
+    }
+    const double seconds = std::chrono::duration<double>(now - w.since).count();
+    if (w.stalled || seconds < threshold_) {
+      continue;
+    }
+    w.stalled = true;
+    ++stalls_;
+
+    Stall stall{w.loop, seconds, progress.activity, progress.fd,
+                demangle(progress.callback)};
+    if (w.lastReport == MonoTime::min() ||
+        std::chrono::duration<double>(now - w.lastReport).count() >=
+            reportInterval_) {
+      w.lastReport = now;
+      ++reports_;
+      LOG_WARN << "EventLoop " << w.loop << " stalled for " << seconds
+               << "s while " << EventLoop::activityName(stall.activity)
+               << (stall.fd >= 0 ? ", fd = " + std::to_string(stall.fd) : "")
+               << (stall.callback.empty() ? "" : ", in " + stall.callback)
+               << (w.suppressed > 0
+                       ? " (" + std::to_string(w.suppressed) + " suppressed)"
+                       : "");
+      w.suppressed = 0;
+    } else {
+      ++w.suppressed;
+    }
+    if (stallCallback_) {
+      stallCallback_(stall);
+    }
+  }
+}
@@ -0,0 +1,18 @@
+#include "poller.h"
+#include "channel.h"
+#include "eventloop.h"
+
+using namespace starry;
+
+Poller::Poller(EventLoop* loop) : ownerLoop_(loop) {}
+
+Poller::~Poller() = default;
+
+bool Poller::hasChannel(Channel* channel) const {
+  assertInLoopThread();
+  return channels_.channel(channel->fd()) == channel;
+}
+
+void Poller::assertInLoopThread() const {
+  ownerLoop_->assertInLoopThread();
+}
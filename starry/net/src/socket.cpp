@@ -91,3 +91,9 @@ void Socket::setKeepAlive(bool on) {
   int optval = on ? 1 : 0;
   ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, static_cast<socklen_t>(sizeof(optval)));
 }
+
+bool Socket::setZeroCopy(bool on) {
+  int optval = on ? 1 : 0;
+  return ::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval,
+                      static_cast<socklen_t>(sizeof(optval))) == 0;
+}
@@ -1,6 +1,7 @@
 #include <asm-generic/socket.h>
 #include <endian.h>
 #include <netinet/in.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/uio.h>
@@ -120,6 +121,26 @@ ssize_t sockets::write(int sockfd, const void* buf, size_t count) {
   return ::write(sockfd, buf, count);
 }
 
+// 发送消息, 从数组中聚集写
+ssize_t sockets::writev(int sockfd, const struct iovec* iov, int iovcnt) {
+  return ::writev(sockfd, iov, iovcnt);
+}
+
+// 发送文件，数据在内核里从 fd 直接拷到 socket
+ssize_t sockets::sendfile(int sockfd, int fd, off_t* offset, size_t count) {
+  return ::sendfile(sockfd, fd, offset, count);
+}
+
+// 发送消息，可以带 MSG_ZEROCOPY 等标志
+ssize_t sockets::sendmsg(int sockfd, const struct msghdr* msg, int flags) {
+  return ::sendmsg(sockfd, msg, flags);
+}
+
+// 收取消息，可以带 MSG_ERRQUEUE 等标志
+ssize_t sockets::recvmsg(int sockfd, struct msghdr* msg, int flags) {
+  return ::recvmsg(sockfd, msg, flags);
+}
+
 // 关闭 socket 
 void sockets::close(int sockfd) {
   if (::close(sockfd) < 0) {
@@ -201,6 +222,16 @@ int sockets::getSocketError(int sockfd) {
   }
 }
 
+// 刚 accept 的连接取的是握手包所在的 CPU，开了 RSS 时就是网卡队列对应的 CPU
+int sockets::getIncomingCpu(int sockfd) {
+  int cpu = -1;
+  socklen_t optlen = static_cast<socklen_t>(sizeof(cpu));
+  if (::getsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &optlen) < 0) {
+    return -1;
+  }
+  return cpu;
+}
+
 // 获取当前 sockaddr_in6
 struct sockaddr_in6 sockets::getLocalAddr(int sockfd) {
   struct sockaddr_in6 localaddr;
@@ -1,17 +1,32 @@
+#include <time.h>  // linux/errqueue.h 用到 struct timespec
+#include <linux/errqueue.h>
+#include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <climits>
+#include <chrono>
 #include <cstddef>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
 #include "buffer.h"
+#include "buffer_pool.h"
 #include "callbacks.h"
 #include "channel.h"
 #include "eventloop.h"
 #include "inet_address.h"
+#include "loop_stats.h"
 #include "logging.h"
 #include "socket.h"
 #include "sockets_ops.h"
@@ -19,6 +34,41 @@
 
 using namespace starry;
 
+const size_t TcpConnection::kDefaultMaxCorkedBytes;
+const size_t TcpConnection::kDefaultZeroCopyThreshold;
+const int TcpConnection::kZeroCopyCopiedLimit;
+
+namespace {
+
+// 段数不多时 iovec 放在栈上，避免每次 sendv 都申请内存
+class IovecArray {
+ public:
+  explicit IovecArray(size_t n) : data_(inline_) {
+    if (n > kInlineSize) {
+      heap_.resize(n);
+      data_ = heap_.data();
+    }
+  }
+  struct iovec* data() { return data_; }
+  struct iovec& operator[](size_t i) { return data_[i]; }
+
+ private:
+  static const size_t kInlineSize = ChainBuffer::kMaxIovecs;
+  struct iovec inline_[kInlineSize];
+  std::vector<struct iovec> heap_;
+  struct iovec* data_;
+};
+
+// 记一次写系统调用和写出的字节数
+void countWrite(LoopStats& stats, ssize_t n) {
+  LoopStats::add(stats.writeCalls, 1);
+  if (n > 0) {
+    LoopStats::add(stats.bytesWritten, static_cast<uint64_t>(n));
+  }
+}
+
+}  // namespace
+
 // 默认连接回调
 void starry::defaultConnectionCallback(const TcpConnectionPtr& conn) {
   LOG_TRACE << conn->localAddress().toIpPort() << " -> "
@@ -42,17 +92,44 @@ TcpConnection::TcpConnection(EventLoop* loop,
       state_(StateE::kConnecting),
       reading_(true),
       socket_(new Socket(sockfd)),
-      channel_(new Channel(loop, sockfd)),
+      channel_(newChannel(loop, sockfd)),
       localAddr_(localAddr),
       peerAddr_(peerAddr),
-      highWaterMark_(64 * 1024 * 1024) {
-  channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this, _1));
-  channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
-  channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
-  channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+      highWaterMark_(64 * 1024 * 1024),
+      inputBuffer_(loop->bufferPool()),
+      outputBuffer_(loop->bufferPool()),
+      pendingFileBytes_(0),
+      bufferRetrieved_(0),
+      hasQueuedSends_(false),
+      autoCork_(false),
+      maxCorkedBytes_(kDefaultMaxCorkedBytes),
+      corkFlushScheduled_(false),
+      zeroCopy_(false),
+      zeroCopySocket_(false),
+      zeroCopyThreshold_(kDefaultZeroCopyThreshold),
+      zeroCopyNextId_(0),
+      zeroCopyCopiedStreak_(0),
+      edgeTriggered_(false),
+      writeWaiting_(false),
+      releaseTimerArmed_(false),
+      migrating_(false),
+      bytesReceived_(0),
+      bytesSampled_(0) {
   LOG_DEBUG << "TcpConnection::ctor[" << name_ << "] at " << this
             << " fd=" << sockfd;
   socket_->setKeepAlive(true);
+  getLoop()->addConnection();
+}
+
+Channel* TcpConnection::newChannel(EventLoop* loop, int fd) {
+  Channel* channel = new Channel(loop, fd);
+  channel->setReadCallback(std::bind(&TcpConnection::handleRead, this, _1));
+  channel->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
+  channel->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
+  channel->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+  // poller 支持时由它直接把数据收进读缓冲区，见 handleReceived
+  channel->setReceiveBuffer(&inputBuffer_);
+  return channel;
 }
 
 TcpConnection::~TcpConnection() {
@@ -79,31 +156,124 @@ void TcpConnection::send(const void* data, int len) {
   send(std::string_view(static_cast<const char*>(data), len));
 }
 
-// 把 TcpConnection::sendInLoop 作为函数指针绑定到 runInLoop 中执行
+// 跨线程时 message 会失效，只能拷贝一份
 void TcpConnection::send(const std::string_view& message) {
   if (state_ == StateE::kConnected) {
-    if (loop_->isInLoopThread()) {
+    if (canSendInLoop()) {
       sendInLoop(message);
     } else {
-      void (TcpConnection::*fp)(const std::string_view& message) =
-          &TcpConnection::sendInLoop;
-      loop_->runInLoop(std::bind(fp, this, message));
+      queueSend(BufferSlice::copyOf(message));
     }
   }
 }
 
-// 把 TcpConnection::sendInLoop 作为函数指针绑定到 runInLoop 中执行
+// 跨线程时把数据切成切片交给 loop，不拷贝
 void TcpConnection::send(Buffer* buf) {
   if (state_ == StateE::kConnected) {
-    if (loop_->isInLoopThread()) {
+    if (canSendInLoop()) {
       sendInLoop(buf->peek(), buf->readableBytes());
       buf->retrieveAll();
     } else {
-      void (TcpConnection::*fp)(const std::string_view& message) =
-          &TcpConnection::sendInLoop;
-      loop_->runInLoop(std::bind(fp, this, buf->retrieveAllAsString()));
+      queueSend(buf->retrieveAllAsSlice());
+    }
+  }
+}
+
+// 接管 buf 的存储，不拷贝：较大的数据切成切片，没发完的部分直接挂到链上
+void TcpConnection::send(Buffer&& buf) {
+  if (buf.readableBytes() >= ChainBuffer::kMinSliceSize) {
+    send(buf.retrieveAllAsSlice());
+  } else {
+    send(&buf);
+  }
+}
+
+// 发送切片，跨线程时只增加引用计数
+void TcpConnection::send(const BufferSlice& slice) {
+  if (state_ == StateE::kConnected) {
+    if (canSendInLoop()) {
+      sendInLoop(slice);
+    } else {
+      queueSend(BufferSlice(slice));
+    }
+  }
+}
+
+// 发送切片，跨线程时连引用计数都不用改
+void TcpConnection::send(BufferSlice&& slice) {
+  if (state_ == StateE::kConnected) {
+    if (canSendInLoop()) {
+      sendInLoop(slice);
+    } else {
+      queueSend(std::move(slice));
+    }
+  }
+}
+
+// 队列由空变非空时才投递一次，同一批里的多次发送在 loop 里一次 writev 发出
+void TcpConnection::queueSend(BufferSlice&& message) {
+  bool wasEmpty = false;
+  {
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+    wasEmpty = pendingSends_.empty();
+    pendingSends_.emplace_back(std::move(message));
+    hasQueuedSends_.store(true, std::memory_order_release);
+  }
+  postPendingSends(wasEmpty);
+}
+
+// 文件也走同一个队列，保证和其他线程发送的数据之间的顺序
+void TcpConnection::queueSendFile(FileRange&& file) {
+  bool wasEmpty = false;
+  {
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+    wasEmpty = pendingSends_.empty();
+    pendingSends_.emplace_back(std::move(file));
+    hasQueuedSends_.store(true, std::memory_order_release);
+  }
+  postPendingSends(wasEmpty);
+}
+
+// 迁移之后调用方可能已经在新 loop 线程里了，直接发出，不用再投递
+// 投递的回调持有连接，执行前连接可能已经被其他线程放掉；
+// shared_ptr 放得进 Functor 的内部存储，不用申请内存
+void TcpConnection::postPendingSends(bool wasEmpty) {
+  EventLoop* loop = getLoop();
+  if (loop->isInLoopThread()) {
+    flushPendingSends();
+  } else if (wasEmpty) {
+    TcpConnectionPtr self(shared_from_this());
+    loop->queueInLoop([self] { self->flushPendingSends(); });
+  }
+}
+
+// 交换出整批待发数据，连续的切片合成一次 writev，遇到文件时先发完前面的切片
+void TcpConnection::flushPendingSends() {
+  if (forwardToCurrentLoop(&TcpConnection::flushPendingSends)) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+    flushing_.swap(pendingSends_);
+    hasQueuedSends_.store(false, std::memory_order_relaxed);
+  }
+  for (PendingSend& item : flushing_) {
+    if (BufferSlice* slice = std::get_if<BufferSlice>(&item)) {
+      flushBatch_.push_back(std::move(*slice));
+      continue;
     }
+    if (!flushBatch_.empty()) {
+      sendvSlicesInLoop(flushBatch_);
+      flushBatch_.clear();
+    }
+    FileRange& file = std::get<FileRange>(item);
+    sendFileInLoop(file.fd, file.offset, file.remaining, file.done);
+  }
+  if (!flushBatch_.empty()) {
+    sendvSlicesInLoop(flushBatch_);
+    flushBatch_.clear();
   }
+  flushing_.clear();
 }
 
 // 调用重载版本，向 channel 中写入消息
@@ -111,28 +281,142 @@ void TcpConnection::sendInLoop(const std::string_view& message) {
   sendInLoop(message.data(), message.size());
 }
 
+// 调用重载版本，未发完的部分引用切片
+void TcpConnection::sendInLoop(const BufferSlice& slice) {
+  sendInLoop(slice.data(), slice.size(), &slice);
+}
+
 // 向 channel 中写入消息
 void TcpConnection::sendInLoop(const void* data, size_t len) {
-  loop_->assertInLoopThread();
-  ssize_t nwrote = 0;
-  size_t remaining = len;  // 剩余未发送的字节数
+  sendInLoop(data, len, nullptr);
+}
+
+// 向 channel 中写入消息
+void TcpConnection::sendInLoop(const void* data,
+                               size_t len,
+                               const BufferSlice* slice) {
+  struct iovec vec;
+  vec.iov_base = const_cast<void*>(data);
+  vec.iov_len = len;
+  sendvInLoop(&vec, 1, slice);
+}
+
+// 多段数据拼成 iovec，一次 writev 发出
+void TcpConnection::sendv(std::span<const std::string_view> pieces) {
+  if (state_ == StateE::kConnected) {
+    if (canSendInLoop()) {
+      IovecArray vec(pieces.size());
+      for (size_t i = 0; i < pieces.size(); ++i) {
+        vec[i].iov_base = const_cast<char*>(pieces[i].data());
+        vec[i].iov_len = pieces[i].size();
+      }
+      sendvInLoop(vec.data(), static_cast<int>(pieces.size()), nullptr);
+    } else {
+      // 跨线程时 string_view 会失效，拼进一块 Buffer 后按切片交给 loop
+      size_t total = 0;
+      for (std::string_view piece : pieces) {
+        total += piece.size();
+      }
+      Buffer buf(total);
+      for (std::string_view piece : pieces) {
+        buf.append(piece);
+      }
+      send(&buf);
+    }
+  }
+}
+
+// 多个切片一次 writev 发出，没发完的部分仍然引用切片
+void TcpConnection::sendv(std::span<const BufferSlice> slices) {
+  if (state_ == StateE::kConnected) {
+    if (canSendInLoop()) {
+      sendvSlicesInLoop(slices);
+    } else {
+      for (const BufferSlice& slice : slices) {
+        queueSend(BufferSlice(slice));
+      }
+    }
+  }
+}
+
+void TcpConnection::sendvSlicesInLoop(std::span<const BufferSlice> slices) {
+  IovecArray vec(slices.size());
+  for (size_t i = 0; i < slices.size(); ++i) {
+    vec[i].iov_base = const_cast<char*>(slices[i].data());
+    vec[i].iov_len = slices[i].size();
+  }
+  sendvInLoop(vec.data(), static_cast<int>(slices.size()), slices.data());
+}
+
+// 缓冲区为空时直接写，多段合并成一次 writev；
+// 发不完的部分放到 outputBuffer_ 中，让 handleWrite 自动触发完成发送工作
+void TcpConnection::sendvInLoop(const struct iovec* iov,
+                                int iovcnt,
+                                const BufferSlice* slices) {
+  getLoop()->assertInLoopThread();
+  size_t len = 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    len += iov[i].iov_len;
+  }
+  // 没有数据就什么都不做：不写 fd，也不通知写完成；iovcnt 为 0 时 iov 没有初始化
+  if (len == 0) {
+    return;
+  }
+  size_t nwrote = 0;
   bool faultError = false;
   if (state_ == StateE::kDisconnected) {
     LOG_WARN << "disconnected, give up writing";
     return;
   }
-  if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0) {
-    nwrote = sockets::write(channel_->fd(), data, len);
-    if (nwrote >= 0) {
-      remaining = len - nwrote;
-      if (remaining == 0 && writeCompleteCallback_) {
-        loop_->queueInLoop(
+  // 自动合并写：没有在等 EPOLLOUT 时先攒着，本轮结束或攒够了再写
+  if (autoCork_ && !writeWaiting_) {
+    appendOutput(iov, iovcnt, 0, slices);
+    LoopStats::add(getLoop()->stats().corkedSends, 1);
+    if (outputBuffer_.readableBytes() >= maxCorkedBytes_) {
+      LoopStats::add(getLoop()->stats().corkFlushes, 1);
+      flushOutput();
+    } else {
+      scheduleCorkFlush();
+    }
+    return;
+  }
+  // 足够大的切片先挂到链上，由 flushOutput 零拷贝发送
+  if (zeroCopy_ && slices && len >= zeroCopyThreshold_ &&
+      !writeWaiting_ && !hasPendingOutput()) {
+    appendOutput(iov, iovcnt, 0, slices);
+    flushOutput();
+    return;
+  }
+  bool blocked = false;  // 写是否被阻塞（EAGAIN 或只写出一部分）
+  if (!writeWaiting_ && !hasPendingOutput()) {
+    LoopStats& stats = getLoop()->stats();
+    ssize_t n = 0;
+    size_t attempted = iov[0].iov_len;
+    if (iovcnt == 1) {
+      n = sockets::write(channel_->fd(), iov[0].iov_base, iov[0].iov_len);
+    } else {
+      // 超出 IOV_MAX 的段直接进缓冲区，由 handleWrite 发送
+      const int cnt = std::min(iovcnt, IOV_MAX);
+      n = sockets::writev(channel_->fd(), iov, cnt);
+      attempted = 0;
+      for (int i = 0; i < cnt; ++i) {
+        attempted += iov[i].iov_len;
+      }
+      LoopStats::add(stats.batchedSends, 1);
+      LoopStats::add(stats.syscallsSaved, cnt - 1);
+    }
+    countWrite(stats, n);
+    if (n >= 0) {
+      nwrote = static_cast<size_t>(n);
+      blocked = nwrote < attempted;
+      if (nwrote == len && writeCompleteCallback_) {
+        getLoop()->queueInLoop(
             std::bind(writeCompleteCallback_, shared_from_this()));
       }
     } else {
-      nwrote = 0;
+      blocked = errno == EWOULDBLOCK;
       if (errno != EWOULDBLOCK) {
-        LOG_FATAL << "TcpConnection::sendInLoop";
+        LOG_SYSERR << "TcpConnection::sendInLoop";
         if (errno == EPIPE || errno == ECONNRESET) {
           faultError = true;
         }
@@ -140,36 +424,344 @@ void TcpConnection::sendInLoop(const void* data, size_t len) {
     }
   }
 
-  // 如果一个发不完，就放到 outputBuffer_ 中，让 handleWrite
-  // 自动触发完成发送工作
-  assert(remaining <= len);
-  if (!faultError && remaining > 0) {
-    size_t oldLen = outputBuffer_.readableBytes();
-    if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ &&
-        highWaterMarkCallback_) {
-      loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(),
-                                   oldLen + remaining));
+  assert(nwrote <= len);
+  if (!faultError && nwrote < len) {
+    appendOutput(iov, iovcnt, nwrote, slices);
+    waitForWritable(blocked);
+  }
+}
+
+// 超过高水位时通知上层；跳过已经写出的段，只把尾部追加进缓冲区
+void TcpConnection::appendOutput(const struct iovec* iov,
+                                 int iovcnt,
+                                 size_t skip,
+                                 const BufferSlice* slices) {
+  size_t remaining = 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    remaining += iov[i].iov_len;
+  }
+  remaining -= skip;
+  size_t oldLen = pendingOutputBytes();
+  if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ &&
+      highWaterMarkCallback_) {
+    getLoop()->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(),
+                                 oldLen + remaining));
+  }
+  for (int i = 0; i < iovcnt; ++i) {
+    if (skip >= iov[i].iov_len) {
+      skip -= iov[i].iov_len;
+      continue;
+    }
+    if (slices) {
+      outputBuffer_.append(slices[i].subslice(skip));
+    } else {
+      outputBuffer_.append(static_cast<const char*>(iov[i].iov_base) + skip,
+                           iov[i].iov_len - skip);
+    }
+    skip = 0;
+  }
+}
+
+// 每个连接每轮最多安排一次，持有 shared_ptr 保证执行时连接还在
+void TcpConnection::scheduleCorkFlush() {
+  if (!corkFlushScheduled_) {
+    corkFlushScheduled_ = true;
+    TcpConnectionPtr self(shared_from_this());
+    getLoop()->runAtIterationEnd([self] { self->flushCorked(); });
+  }
+}
+
+void TcpConnection::flushCorked() {
+  if (forwardToCurrentLoop(&TcpConnection::flushCorked)) {
+    return;
+  }
+  corkFlushScheduled_ = false;
+  LoopStats::add(getLoop()->stats().corkFlushes, 1);
+  flushOutput();
+}
+
+// 把缓冲区里的数据立即写出，写不完的交给 handleWrite
+void TcpConnection::flushOutput() {
+  getLoop()->assertInLoopThread();
+  if (state_ == StateE::kDisconnected || writeWaiting_ ||
+      !hasPendingOutput()) {
+    return;
+  }
+  int savedErrno = 0;
+  ssize_t n = writeOutput(&savedErrno);
+  if (n < 0 && savedErrno != EWOULDBLOCK) {
+    errno = savedErrno;
+    LOG_SYSERR << "TcpConnection::flushOutput";
+    if (savedErrno == EPIPE || savedErrno == ECONNRESET) {
+      return;
+    }
+  }
+  if (state_ == StateE::kDisconnected) {
+    return;
+  }
+  if (hasPendingOutput()) {
+    waitForWritable(n < 0 && savedErrno == EWOULDBLOCK);
+  } else {
+    if (writeCompleteCallback_) {
+      getLoop()->queueInLoop(
+          std::bind(writeCompleteCallback_, shared_from_this()));
+    }
+    if (state_ == StateE::kDisconnecting) {
+      shutdownInLoop();
+    }
+  }
+}
+
+// 把 sendFileInLoop 放到 loop 中执行
+void TcpConnection::sendFile(int fd,
+                             off_t offset,
+                             size_t length,
+                             const WriteCompleteCallback& done) {
+  if (state_ == StateE::kConnected) {
+    if (canSendInLoop()) {
+      sendFileInLoop(fd, offset, length, done);
+    } else {
+      queueSendFile(FileRange{fd, offset, length, 0, done});
+    }
+  } else if (done) {
+    getLoop()->queueInLoop(std::bind(done, shared_from_this()));
+  }
+}
+
+// 前面没有待发数据时直接 sendfile，发不完的部分记下在输出流中的位置，
+// 由 handleWrite 在之前的数据写完后继续发送；放弃发送时也调用 done
+void TcpConnection::sendFileInLoop(int fd,
+                                   off_t offset,
+                                   size_t length,
+                                   const WriteCompleteCallback& done) {
+  getLoop()->assertInLoopThread();
+  if (state_ == StateE::kDisconnected) {
+    LOG_WARN << "disconnected, give up sending file";
+    if (done) {
+      getLoop()->queueInLoop(std::bind(done, shared_from_this()));
+    }
+    return;
+  }
+  size_t remaining = length;
+  bool blocked = false;  // sendfile 是否被阻塞
+  if (!writeWaiting_ && !hasPendingOutput() && remaining > 0) {
+    ssize_t n = sockets::sendfile(channel_->fd(), fd, &offset, remaining);
+    LoopStats& stats = getLoop()->stats();
+    LoopStats::add(stats.sendfileCalls, 1);
+    if (n > 0) {
+      LoopStats::add(stats.fileBytesSent, n);
+      remaining -= n;
+      blocked = remaining > 0;
+    } else if (n == 0 || errno != EWOULDBLOCK) {
+      // 文件比请求的短或者读不了，继续发下去对端的数据就错位了
+      if (n == 0) {
+        LOG_ERROR << "TcpConnection::sendFileInLoop [" << name_
+                  << "] - file is shorter than requested";
+      } else {
+        LOG_SYSERR << "TcpConnection::sendFileInLoop";
+      }
+      if (done) {
+        getLoop()->queueInLoop(std::bind(done, shared_from_this()));
+      }
+      forceCloseInLoop();
+      return;
+    } else {
+      blocked = true;
+    }
+  }
+
+  if (remaining == 0) {
+    if (done) {
+      getLoop()->queueInLoop(std::bind(done, shared_from_this()));
     }
-    outputBuffer_.append(static_cast<const char*>(data) + nwrote, remaining);
-    if (!channel_->isWriting()) {
-      channel_->enableWriting();
+    if (writeCompleteCallback_) {
+      getLoop()->queueInLoop(
+          std::bind(writeCompleteCallback_, shared_from_this()));
     }
+    return;
+  }
+
+  size_t oldLen = pendingOutputBytes();
+  if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ &&
+      highWaterMarkCallback_) {
+    getLoop()->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(),
+                                 oldLen + remaining));
   }
+  pendingFiles_.push_back(FileRange{
+      fd, offset, remaining, bufferRetrieved_ + outputBuffer_.readableBytes(),
+      done});
+  pendingFileBytes_ += remaining;
+  waitForWritable(blocked);
+}
+
+// 按输出流的顺序交替写缓冲数据和文件，直到写满 socket 或全部写完
+// 返回写出的字节数，一个字节都没写出就出错时返回 -1
+ssize_t TcpConnection::writePendingOutput(int* savedErrno) {
+  ssize_t total = 0;
+  while (!pendingFiles_.empty()) {
+    FileRange& file = pendingFiles_.front();
+    size_t before = static_cast<size_t>(file.position - bufferRetrieved_);
+    if (before > 0) {
+      ssize_t n = outputBuffer_.writeFd(channel_->fd(), savedErrno, before);
+      countWrite(getLoop()->stats(), n);
+      if (n < 0) {
+        return total > 0 ? total : -1;
+      }
+      bufferRetrieved_ += n;
+      total += n;
+      if (static_cast<size_t>(n) < before) {
+        return total;
+      }
+      continue;
+    }
+
+    ssize_t n =
+        sockets::sendfile(channel_->fd(), file.fd, &file.offset, file.remaining);
+    LoopStats& stats = getLoop()->stats();
+    LoopStats::add(stats.sendfileCalls, 1);
+    if (n < 0 && errno == EWOULDBLOCK) {
+      *savedErrno = errno;
+      return total > 0 ? total : -1;
+    }
+    if (n <= 0) {
+      // 文件比请求的短或者读不了，继续发下去对端的数据就错位了
+      *savedErrno = n == 0 ? EIO : errno;
+      LOG_ERROR << "TcpConnection::writePendingOutput [" << name_
+                << "] - sendfile failed: "
+                << (n == 0 ? "file is shorter than requested"
+                           : strerror_tl(*savedErrno));
+      forceCloseInLoop();  // 连同这个文件一起放弃，调用 done
+      return -1;
+    }
+    LoopStats::add(stats.fileBytesSent, n);
+    total += n;
+    file.remaining -= n;
+    pendingFileBytes_ -= n;
+    if (file.remaining > 0) {
+      return total;
+    }
+    if (file.done) {
+      getLoop()->queueInLoop(std::bind(file.done, shared_from_this()));
+    }
+    pendingFiles_.pop_front();
+  }
+
+  if (outputBuffer_.readableBytes() > 0) {
+    ssize_t n = writeOutputBuffer(savedErrno);
+    if (n < 0) {
+      return total > 0 ? total : -1;
+    }
+    bufferRetrieved_ += n;
+    total += n;
+  }
+  return total;
+}
+
+// 头部是足够大的切片时用 MSG_ZEROCOPY 发送，否则普通 writev
+ssize_t TcpConnection::writeOutputBuffer(int* savedErrno) {
+  LoopStats& stats = getLoop()->stats();
+  if (zeroCopy_ && outputBuffer_.borrowedPrefixBytes() >= zeroCopyThreshold_) {
+    ssize_t n = outputBuffer_.writeFdZeroCopy(channel_->fd(), savedErrno,
+                                              &pinScratch_);
+    countWrite(stats, n);
+    if (n >= 0) {
+      const uint32_t id = zeroCopyNextId_++;
+      for (BufferSlice& slice : pinScratch_) {
+        zeroCopyPinned_.push_back(PinnedSlice{id, std::move(slice)});
+      }
+      pinScratch_.clear();
+      LoopStats::add(stats.zeroCopySends, 1);
+      return n;
+    }
+    // ENOBUFS 表示超出了 optmem 限制，这一次退回普通发送
+    if (*savedErrno != ENOBUFS) {
+      return n;
+    }
+  }
+  ssize_t n = outputBuffer_.writeFd(channel_->fd(), savedErrno);
+  countWrite(stats, n);
+  return n;
+}
+
+// 只能在连接建立前或 loop 线程里设置
+bool TcpConnection::setZeroCopy(bool on, size_t threshold) {
+  if (on && !socket_->setZeroCopy(true)) {
+    LOG_WARN << "TcpConnection::setZeroCopy [" << name_
+             << "] - SO_ZEROCOPY is not supported";
+    zeroCopy_ = false;
+    return false;
+  }
+  zeroCopySocket_ = zeroCopySocket_ || on;
+  zeroCopy_ = on;
+  zeroCopyThreshold_ = threshold;
+  zeroCopyCopiedStreak_ = 0;
+  return true;
+}
+
+// 通知里的 [ee_info, ee_data] 是完成的序号范围，TCP 按顺序完成，
+// 释放序号不超过 ee_data 的切片；带 COPIED 标志说明内核还是拷贝了
+bool TcpConnection::handleZeroCopyCompletions() {
+  LoopStats& stats = getLoop()->stats();
+  bool handled = false;
+  char control[128];
+  for (;;) {
+    struct msghdr msg = {};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (sockets::recvmsg(channel_->fd(), &msg, MSG_ERRQUEUE) < 0) {
+      break;  // EAGAIN，通知读完了
+    }
+    for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr;
+         cm = CMSG_NXTHDR(&msg, cm)) {
+      if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+          !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+        continue;
+      }
+      const struct sock_extended_err* serr =
+          reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cm));
+      if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+        continue;
+      }
+      handled = true;
+      const uint32_t lo = serr->ee_info;
+      const uint32_t hi = serr->ee_data;
+      while (!zeroCopyPinned_.empty() &&
+             static_cast<int32_t>(zeroCopyPinned_.front().id - hi) <= 0) {
+        zeroCopyPinned_.pop_front();
+      }
+      const uint32_t count = hi - lo + 1;
+      LoopStats::add(stats.zeroCopyCompletions, count);
+      if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+        LoopStats::add(stats.zeroCopyCopied, count);
+        zeroCopyCopiedStreak_ += static_cast<int>(count);
+        if (zeroCopy_ && zeroCopyCopiedStreak_ >= kZeroCopyCopiedLimit) {
+          LOG_INFO << "TcpConnection::handleZeroCopyCompletions [" << name_
+                   << "] - kernel keeps copying, fall back to normal send";
+          zeroCopy_ = false;
+        }
+      } else {
+        zeroCopyCopiedStreak_ = 0;
+      }
+    }
+  }
+  return handled;
 }
 
 // 半连接，状态切换成 kDisconnecting, 并把 shutdownInLoop 绑定到 runInLoop
 void TcpConnection::shutdown() {
   if (state_ == StateE::kConnected) {
     setState(StateE::kDisconnecting);
-    loop_->runInLoop(std::bind(&TcpConnection::shutdownInLoop,
+    getLoop()->runInLoop(std::bind(&TcpConnection::shutdownInLoop,
                                this));  // 保证关闭操作的顺序性
   }
 }
 
 // 半连接，回调函数
 void TcpConnection::shutdownInLoop() {
-  loop_->assertInLoopThread();
-  if (!channel_->isWriting()) {
+  if (forwardToCurrentLoop(&TcpConnection::shutdownInLoop)) {
+    return;
+  }
+  if (!writeWaiting_ && !hasPendingOutput()) {
     socket_->shutdownWrite();
   }
 }
@@ -179,14 +771,16 @@ void TcpConnection::forceClose() {
   if (state_ == StateE::kConnected || state_ == StateE::kDisconnecting) {
     setState(StateE::kDisconnecting);
     // 保证关闭操作的顺序性
-    loop_->queueInLoop(
+    getLoop()->queueInLoop(
         std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
   }
 }
 
 // 强制关闭回调
 void TcpConnection::forceCloseInLoop() {
-  loop_->assertInLoopThread();
+  if (forwardToCurrentLoop(&TcpConnection::forceCloseInLoop)) {
+    return;
+  }
   if (state_ == StateE::kConnected || state_ == StateE::kDisconnecting) {
     handleClose();
   }
@@ -215,12 +809,14 @@ void TcpConnection::setTcpNoDelay(bool on) {
 
 // 开启读
 void TcpConnection::startRead() {
-  loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, this));
+  getLoop()->runInLoop(std::bind(&TcpConnection::startReadInLoop, this));
 }
 
 // 读回调
 void TcpConnection::startReadInLoop() {
-  loop_->assertInLoopThread();
+  if (forwardToCurrentLoop(&TcpConnection::startReadInLoop)) {
+    return;
+  }
   if (!reading_ || !channel_->isReading()) {
     channel_->enableReading();
     reading_ = true;
@@ -229,12 +825,14 @@ void TcpConnection::startReadInLoop() {
 
 // 停止读
 void TcpConnection::stopRead() {
-  loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, this));
+  getLoop()->runInLoop(std::bind(&TcpConnection::stopReadInLoop, this));
 }
 
 // 停止读回调
 void TcpConnection::stopReadInLoop() {
-  loop_->assertInLoopThread();
+  if (forwardToCurrentLoop(&TcpConnection::stopReadInLoop)) {
+    return;
+  }
   if (reading_ || channel_->isReading()) {
     channel_->disableReading();
     reading_ = false;
@@ -243,85 +841,388 @@ void TcpConnection::stopReadInLoop() {
 
 // 连接建立
 void TcpConnection::connectEstablished() {
-  loop_->assertInLoopThread();
+  getLoop()->assertInLoopThread();
   assert(state_ == StateE::kConnecting);
   setState(StateE::kConnected);
   channel_->tie(shared_from_this());
-  channel_->enableReading();
+  if (edgeTriggered_) {
+    // 读写事件一次注册好，之后写不完也不再修改 epoll
+    channel_->setEdgeTriggered(true);
+    channel_->enableReadingAndWriting();
+  } else {
+    channel_->enableReading();
+  }
 
   connectionCallback_(shared_from_this());
 }
 
 // 连接断开
 void TcpConnection::connectDestroyed() {
-  loop_->assertInLoopThread();
+  if (forwardToCurrentLoop(&TcpConnection::connectDestroyed)) {
+    return;
+  }
   if (state_ == StateE::kConnected) {
     setState(StateE::kDisconnected);
     channel_->disableAll();
+    abandonPendingFiles();
 
     connectionCallback_(shared_from_this());
   }
   channel_->remove();
+  // 在 loop 线程里减，析构时 loop 可能已经不在了
+  getLoop()->removeConnection();
+  releaseBuffers();
+}
+
+// 总是投递，不在当前调用里执行：调用方可能正在这个连接的 Channel 回调里
+void TcpConnection::migrateTo(EventLoop* loop, const MigrateCallback& done) {
+  TcpConnectionPtr self(shared_from_this());
+  getLoop()->queueInLoop(
+      [self, loop, done] { self->migrateInLoop(loop, done); });
+}
+
+// 在旧 loop 里交出连接：先发出排队的数据，再停止收发，最后切换 loop_
+// 内核里没读的数据留在 socket 里，新 loop 注册之后会收到可读事件
+void TcpConnection::migrateInLoop(EventLoop* target,
+                                  const MigrateCallback& done) {
+  EventLoop* loop = getLoop();
+  // 已经迁走了，或者上一次迁移还没结束，交给现在的 loop 稍后再处理
+  if (migrating_ || !loop->isInLoopThread()) {
+    TcpConnectionPtr self(shared_from_this());
+    loop->queueInLoop(
+        [self, target, done] { self->migrateInLoop(target, done); });
+    return;
+  }
+  if (state_ != StateE::kConnected || target == loop) {
+    if (done) {
+      done(shared_from_this(), target == loop && connected());
+    }
+    return;
+  }
+  migrating_ = true;
+  flushPendingSends();
+  if (state_ != StateE::kConnected) {
+    migrating_ = false;
+    if (done) {
+      done(shared_from_this(), false);
+    }
+    return;
+  }
+  channel_->disableAll();
+  channel_->remove();
+  // poller 移除 channel 时会交出已经收到的数据，到新 loop 再通知上层
+  const bool undelivered = channel_->takeReceived().bytes > 0;
+
+  // 读缓冲区换到新 loop 的 pool，发送缓冲区之后的分段从新 pool 申请
+  Buffer input(target->bufferPool());
+  if (inputBuffer_.readableBytes() > 0) {
+    input.append(inputBuffer_.peek(), inputBuffer_.readableBytes());
+  }
+  inputBuffer_.swap(input);
+  outputBuffer_.setPool(target->bufferPool());
+
+  // 新的 Channel 只能在新 loop 线程里注册
+  channel_.reset(newChannel(target, socket_->fd()));
+  channel_->tie(shared_from_this());
+  channel_->setEdgeTriggered(edgeTriggered_);
+
+  LOG_DEBUG << "TcpConnection::migrateInLoop [" << name_ << "] from " << loop
+            << " to " << target;
+  loop->removeConnection();
+  target->addConnection();
+  loop_.store(target, std::memory_order_release);
+  TcpConnectionPtr self(shared_from_this());
+  target->queueInLoop([self, done, undelivered] {
+    self->migrateEstablished(done, undelivered);
+  });
+}
+
+// 在新 loop 里接管：恢复关注的事件，切换之后的发送可能已经开始等待可写
+void TcpConnection::migrateEstablished(const MigrateCallback& done,
+                                       bool undelivered) {
+  getLoop()->assertInLoopThread();
+  migrating_ = false;
+  if (state_ != StateE::kDisconnected) {
+    if (edgeTriggered_) {
+      channel_->enableReadingAndWriting();
+    } else {
+      if (reading_) {
+        channel_->enableReading();
+      }
+      if (writeWaiting_ && !channel_->isWriting()) {
+        channel_->enableWriting();
+      }
+    }
+    if (undelivered) {
+      messageCallback_(shared_from_this(), &inputBuffer_,
+                       getLoop()->pollReruenTime());
+    }
+  }
+  if (done) {
+    done(shared_from_this(), state_ != StateE::kDisconnected);
+  }
 }
 
-// 处理读
+bool TcpConnection::forwardToCurrentLoop(void (TcpConnection::*fn)()) {
+  EventLoop* loop = getLoop();
+  if (loop->isInLoopThread()) {
+    return false;
+  }
+  TcpConnectionPtr self(shared_from_this());
+  loop->queueInLoop([self, fn] { ((*self).*fn)(); });
+  return true;
+}
+
+// 处理读，按自适应大小预留空间，多出来的先读到 loop 的暂存区
+// 边缘触发时读到 EAGAIN 或 EOF 为止，读满预算还没读空就留到下一轮，避免饿死其他连接；
+// 不能因为没读满就停下，数据和 FIN 一起到达时只有一次通知，不读到 EOF 连接就关不掉
 void TcpConnection::handleRead(Timestamp receiveTime) {
-  loop_->assertInLoopThread();
+  getLoop()->assertInLoopThread();
+  if (channel_->receivedByPoller()) {
+    handleReceived(receiveTime);
+    return;
+  }
+  const int maxReads = edgeTriggered_ ? kMaxIoPerEvent : 1;
+  LoopStats& stats = getLoop()->stats();
   int savedErrno = 0;
-  ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
-  if (n > 0) {
+  ssize_t n = 0;
+  size_t total = 0;
+  for (int i = 0; i < maxReads; ++i) {
+    // 读大小是 2 的幂，按存储大小预留，预留空间算在里面，正好占 pool 的一个块
+    const size_t readSize = readSize_.next();
+    inputBuffer_.ensureStorage(readSize);
+    const size_t writable = inputBuffer_.writableBytes();
+    n = inputBuffer_.readFd(channel_->fd(), &savedErrno,
+                            getLoop()->receiveScratch(),
+                            EventLoop::kReceiveScratchSize);
+    LoopStats::add(stats.readCalls, 1);
+    if (n <= 0) {
+      break;
+    }
+    LoopStats::add(stats.bytesRead, n);
+    LoopStats::add(bytesReceived_, n);
+    if (static_cast<size_t>(n) > writable) {
+      LoopStats::add(stats.scratchOverflows, 1);
+    }
+    readSize_.record(n);
+    total += static_cast<size_t>(n);
+  }
+
+  if (total > 0) {
     messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
-  } else if (n == 0) {
-    handleClose();
-  } else {
-    errno = savedErrno;
-    LOG_SYSERR << "TcpConnection::handleRead";
+    if (inputBuffer_.readableBytes() == 0) {
+      scheduleBufferRelease();
+    }
+  }
+  if (n == 0) {
+    if (state_ != StateE::kDisconnected) {
+      handleClose();
+    }
+  } else if (n < 0) {
+    if (!(edgeTriggered_ && savedErrno == EWOULDBLOCK)) {
+      errno = savedErrno;
+      LOG_SYSERR << "TcpConnection::handleRead";
+      handleError();
+    }
+  } else if (edgeTriggered_) {
+    scheduleReadRetry();  // 用完了预算还没读空
+  }
+}
+
+// io_uring 的 multishot recv 已经把数据追加到 inputBuffer_，不再调用 read
+void TcpConnection::handleReceived(Timestamp receiveTime) {
+  const Channel::Received received = channel_->takeReceived();
+  if (received.bytes > 0) {
+    LoopStats::add(getLoop()->stats().bytesRead, received.bytes);
+    LoopStats::add(bytesReceived_, received.bytes);
+    messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+    if (inputBuffer_.readableBytes() == 0) {
+      scheduleBufferRelease();
+    }
+  }
+  if (received.eof) {
+    if (state_ != StateE::kDisconnected) {
+      handleClose();
+    }
+  } else if (received.error != 0) {
+    errno = received.error;
+    LOG_SYSERR << "TcpConnection::handleReceived";
     handleError();
   }
 }
 
-// 处理写
+// 处理写，用 writev 一次写出多个分段，文件区间用 sendfile
 void TcpConnection::handleWrite() {
-  loop_->assertInLoopThread();
-  if (channel_->isWriting()) {
-    ssize_t n = sockets::write(channel_->fd(), outputBuffer_.peek(),
-                               outputBuffer_.readableBytes());
+  getLoop()->assertInLoopThread();
+  if (writeWaiting_) {
+    int savedErrno = 0;
+    ssize_t n = writeOutput(&savedErrno);
     if (n > 0) {
-      outputBuffer_.retrieve(n);
-      if (outputBuffer_.readableBytes() == 0) {
-        channel_->disableWriting();
+      if (!hasPendingOutput()) {
+        stopWaitingForWritable();
         if (writeCompleteCallback_) {
-          loop_->queueInLoop(
+          getLoop()->queueInLoop(
               std::bind(writeCompleteCallback_, shared_from_this()));
         }
         if (state_ == StateE::kDisconnecting) {
           shutdownInLoop();
         }
+      } else if (edgeTriggered_) {
+        scheduleWriteRetry();  // 用完了预算，没有阻塞就不会再有边缘通知
       }
-    } else {
-      LOG_FATAL << "TcpConnection::handleWrite";
+    } else if (n < 0 && savedErrno != EWOULDBLOCK) {
+      errno = savedErrno;
+      LOG_SYSERR << "TcpConnection::handleWrite";
     }
-  } else {
+  } else if (!edgeTriggered_) {
     LOG_TRACE << "Connection fd = " << channel_->fd()
               << " is down, no more writing";
   }
 }
 
+ssize_t TcpConnection::writeOutput(int* savedErrno) {
+  ssize_t n = writePendingOutput(savedErrno);
+  for (int i = 1;
+       edgeTriggered_ && n > 0 && hasPendingOutput() && i < kMaxIoPerEvent;
+       ++i) {
+    n = writePendingOutput(savedErrno);
+  }
+  return n;
+}
+
+// 水平触发时注册 EPOLLOUT；边缘触发时 EPOLLOUT 一直注册着，只记下标志，
+// 但只有写被阻塞过内核才会再通知，没有阻塞时下一轮主动再写一次
+void TcpConnection::waitForWritable(bool blocked) {
+  if (writeWaiting_) {
+    return;
+  }
+  writeWaiting_ = true;
+  if (!edgeTriggered_) {
+    channel_->enableWriting();
+  } else if (!blocked) {
+    scheduleWriteRetry();
+  }
+}
+
+void TcpConnection::stopWaitingForWritable() {
+  writeWaiting_ = false;
+  if (!edgeTriggered_) {
+    channel_->disableWriting();
+  }
+}
+
+void TcpConnection::scheduleWriteRetry() {
+  TcpConnectionPtr self(shared_from_this());
+  getLoop()->queueInLoop([self] { self->retryWrite(); });
+}
+
+void TcpConnection::scheduleReadRetry() {
+  TcpConnectionPtr self(shared_from_this());
+  getLoop()->queueInLoop([self] { self->retryRead(); });
+}
+
+void TcpConnection::retryWrite() {
+  if (forwardToCurrentLoop(&TcpConnection::retryWrite)) {
+    return;
+  }
+  if (state_ != StateE::kDisconnected) {
+    handleWrite();
+  }
+}
+
+void TcpConnection::retryRead() {
+  if (forwardToCurrentLoop(&TcpConnection::retryRead)) {
+    return;
+  }
+  if (state_ != StateE::kDisconnected && channel_->isReading()) {
+    handleRead(getLoop()->pollReruenTime());
+  }
+}
+
+// 读缓冲区读空后，立即或在空闲 idleTimeout 秒后把存储归还给 loop 的 pool
+void TcpConnection::scheduleBufferRelease() {
+  double idleTimeout = getLoop()->bufferPool()->idleTimeout();
+  if (idleTimeout <= 0) {
+    inputBuffer_.releaseIfEmpty();
+    return;
+  }
+  lastActive_ = getLoop()->now();
+  if (!releaseTimerArmed_) {
+    releaseTimerArmed_ = true;
+    std::weak_ptr<TcpConnection> weakThis(shared_from_this());
+    getLoop()->runAfter(idleTimeout, [weakThis] {
+      if (TcpConnectionPtr conn = weakThis.lock()) {
+        conn->releaseIdleBuffers();
+      }
+    });
+  }
+}
+
+// 空闲时间够了就归还，期间又有读写就按剩余时间重新安排
+void TcpConnection::releaseIdleBuffers() {
+  if (forwardToCurrentLoop(&TcpConnection::releaseIdleBuffers)) {
+    return;
+  }
+  releaseTimerArmed_ = false;
+  if (state_ == StateE::kDisconnected) {
+    return;
+  }
+  double idleTimeout = getLoop()->bufferPool()->idleTimeout();
+  double idle =
+      std::chrono::duration<double>(getLoop()->now() - lastActive_).count();
+  if (idle >= idleTimeout || idleTimeout <= 0) {
+    inputBuffer_.releaseIfEmpty();
+  } else {
+    releaseTimerArmed_ = true;
+    std::weak_ptr<TcpConnection> weakThis(shared_from_this());
+    getLoop()->runAfter(idleTimeout - idle, [weakThis] {
+      if (TcpConnectionPtr conn = weakThis.lock()) {
+        conn->releaseIdleBuffers();
+      }
+    });
+  }
+}
+
 // 处理关闭
 void TcpConnection::handleClose() {
-  loop_->assertInLoopThread();
+  getLoop()->assertInLoopThread();
   LOG_TRACE << "fd = " << channel_->fd() << " state = " << stateToString();
   assert(state_ == StateE::kConnected || state_ == StateE::kDisconnecting);
   setState(StateE::kDisconnected);
   channel_->disableAll();
+  abandonPendingFiles();
 
   TcpConnectionPtr guardThis(shared_from_this());
   connectionCallback_(guardThis);
   closeCallback_(guardThis);
 }
 
-// 处理错误
+// 在 loop 可能析构之前把 loop 持有的存储还给 pool
+void TcpConnection::releaseBuffers() {
+  Buffer input;
+  inputBuffer_.swap(input);
+  outputBuffer_.retrieveAll();
+  outputBuffer_.setPool(nullptr);
+  zeroCopyPinned_.clear();
+}
+
+// 连接断开时没发完的文件不再发送，通知调用方可以关闭 fd 了
+void TcpConnection::abandonPendingFiles() {
+  for (FileRange& file : pendingFiles_) {
+    if (file.done) {
+      getLoop()->queueInLoop(std::bind(file.done, shared_from_this()));
+    }
+  }
+  pendingFiles_.clear();
+  pendingFileBytes_ = 0;
+}
+
+// 处理错误，零拷贝的完成通知也通过错误队列送达
+// 切片已经放掉或者已经退回普通发送时仍然可能收到通知，不读掉的话水平触发会一直报错
 void TcpConnection::handleError() {
+  if (zeroCopySocket_ && handleZeroCopyCompletions()) {
+    return;
+  }
   int err = sockets::getSocketError(channel_->fd());
   LOG_ERROR << "TcpConnection::handleError [" << name_
             << "] - SO_ERROR = " << err << " " << strerror_tl(err);
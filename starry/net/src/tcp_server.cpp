@@ -3,6 +3,8 @@
 #include <cstdio>
 #include <functional>
 #include <string>
+#include <vector>
+#include <utility>
 #include "acceptor.h"
 #include "callbacks.h"
 #include "eventloop.h"
@@ -26,7 +28,18 @@ TcpServer::TcpServer(EventLoop* loop,
       threadPool_(new EventLoopThreadPool(loop, name_)),
       connectionCallback_(defaultConnectionCallback),
       messageCallback_(defaultMessageCallback),
-      nextConnId_(1) {
+      nextConnId_(1),
+      autoCork_(false),
+      maxCorkedBytes_(TcpConnection::kDefaultMaxCorkedBytes),
+      zeroCopy_(false),
+      zeroCopyThreshold_(TcpConnection::kDefaultZeroCopyThreshold),
+      edgeTriggered_(false),
+      incomingCpu_(false),
+      incomingCpuMatches_(0),
+      rebalanceInterval_(0.0),
+      rebalanceHigh_(0.75),
+      rebalanceGap_(0.25),
+      migrations_(0) {
   acceptor_->setNewConnectionCallback(
       std::bind(&TcpServer::newConnection, this, _1, _2));
 }
@@ -34,6 +47,9 @@ TcpServer::TcpServer(EventLoop* loop,
 TcpServer::~TcpServer() {
   loop_->assertInLoopThread();
   LOG_TRACE << "TcpServer::~TcpServer [" << name_ << "] destructing";
+  if (started_ && rebalanceInterval_ > 0) {
+    loop_->cancel(rebalanceTimer_);
+  }
 
   for (auto& item : connections_) {
     TcpConnectionPtr conn(item.second);
@@ -49,20 +65,50 @@ void TcpServer::setThreadNum(int numThreads) {
   threadPool_->setThreadNum(numThreads);
 }
 
+void TcpServer::setThreadPlacement(const ThreadPlacement& placement) {
+  threadPool_->setPlacement(placement);
+}
+
+void TcpServer::setLoopSelector(std::unique_ptr<LoopSelector> selector) {
+  threadPool_->setSelector(std::move(selector));
+}
+
 // 开启监听
 void TcpServer::start() {
   if (!started_) {
     started_ = 1;
     threadPool_->start(threadInitCallback_);
+    if (incomingCpu_ && !threadPool_->pinned()) {
+      LOG_WARN << "TcpServer::start [" << name_
+               << "] incoming CPU placement without thread placement";
+    }
     assert(!acceptor_->listening());
     loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+    if (rebalanceInterval_ > 0) {
+      rebalanceTimer_ =
+          loop_->runEvery(rebalanceInterval_, [this] { rebalance(); });
+    }
   }
 }
 
 // 初始化新连接
 void TcpServer::newConnection(int sockfd, const InetAddress& peerAddr) {
   loop_->assertInLoopThread();
-  EventLoop* ioLoop = threadPool_->getNextLoop();
+  // 按对端 IP 哈希，HashSelector 让同一个客户端的连接落在同一个 loop 上；
+  // 其他策略不看哈希，省掉格式化 IP 和计算哈希
+  const size_t hashCode = threadPool_->selectorNeedsHash()
+                              ? std::hash<std::string>()(peerAddr.toIp())
+                              : 0;
+  EventLoop* ioLoop = nullptr;
+  if (incomingCpu_) {
+    ioLoop = threadPool_->loopForCpu(sockets::getIncomingCpu(sockfd), hashCode);
+    if (ioLoop) {
+      ++incomingCpuMatches_;
+    }
+  }
+  if (!ioLoop) {
+    ioLoop = threadPool_->selectLoop(hashCode);
+  }
   char buf[64];
   snprintf(buf, sizeof(buf), "-%s#%d", ipPort_.c_str(), nextConnId_++);
   std::string connName = name_ + buf;
@@ -78,6 +124,11 @@ void TcpServer::newConnection(int sockfd, const InetAddress& peerAddr) {
   conn->setMessageCallback(messageCallback_);
   conn->setWriteCompleteCallback(writeCompleteCallback_);
   conn->setCloseCallback(std::bind(&TcpServer::removeConnection, this, _1));
+  conn->setAutoCork(autoCork_, maxCorkedBytes_);
+  if (zeroCopy_) {
+    conn->setZeroCopy(true, zeroCopyThreshold_);
+  }
+  conn->setEdgeTriggered(edgeTriggered_);
   ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
 }
 
@@ -97,3 +148,53 @@ void TcpServer::removeConnectionInLoop(const TcpConnectionPtr& conn) {
   EventLoop* ioLoop = conn->getLoop();
   ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
 }
+
+// 连接的热度用这段时间读到的字节数衡量，每个连接自己记着上次检查时的字节数
+void TcpServer::rebalance() {
+  loop_->assertInLoopThread();
+  std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+  if (loops.size() < 2) {
+    return;
+  }
+  EventLoop* hot = loops[0];
+  EventLoop* cold = loops[0];
+  double hotBusy = hot->busyRatio();
+  double coldBusy = hotBusy;
+  for (size_t i = 1; i < loops.size(); ++i) {
+    double busy = loops[i]->busyRatio();
+    if (busy > hotBusy) {
+      hot = loops[i];
+      hotBusy = busy;
+    }
+    if (busy < coldBusy) {
+      cold = loops[i];
+      coldBusy = busy;
+    }
+  }
+
+  TcpConnectionPtr hottest;
+  uint64_t hottestBytes = 0;
+  int onHot = 0;
+  for (const auto& item : connections_) {
+    const TcpConnectionPtr& conn = item.second;
+    const uint64_t delta = conn->sampleBytesReceived();
+    if (conn->getLoop() == hot && conn->connected()) {
+      ++onHot;
+      if (!hottest || delta > hottestBytes) {
+        hottest = conn;
+        hottestBytes = delta;
+      }
+    }
+  }
+
+  if (hotBusy < rebalanceHigh_ || hotBusy - coldBusy < rebalanceGap_ ||
+      onHot < 2) {
+    return;
+  }
+  LOG_INFO << "TcpServer::rebalance [" << name_ << "] - move "
+           << hottest->name() << " (" << hottestBytes << " bytes) from "
+           << hot << " (busy " << hotBusy << ") to " << cold << " (busy "
+           << coldBusy << ")";
+  migrations_.fetch_add(1, std::memory_order_relaxed);
+  hottest->migrateTo(cold);
+}
@@ -0,0 +1,199 @@
+#include "thread_placement.h"
+#include "logging.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <utility>
+
+using namespace starry;
+
+namespace {
+
+// set_mempolicy 的模式，和 <linux/mempolicy.h> 一致，这里不依赖 libnuma
+const int kMpolPreferred = 1;
+
+// 读取 sysfs 文件的第一行，失败返回空串
+std::string readLine(const std::string& path) {
+  std::ifstream in(path);
+  std::string line;
+  std::getline(in, line);
+  return line;
+}
+
+int readInt(const std::string& path, int defaultValue) {
+  std::string line = readLine(path);
+  return line.empty() ? defaultValue : std::atoi(line.c_str());
+}
+
+}  // namespace
+
+std::vector<int> CpuTopology::parseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t end = list.find(',', pos);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    std::string range = list.substr(pos, end - pos);
+    pos = end + 1;
+    if (range.empty() || range[0] < '0' || range[0] > '9') {
+      continue;
+    }
+    size_t dash = range.find('-');
+    int first = std::atoi(range.c_str());
+    int last = dash == std::string::npos ? first
+                                         : std::atoi(range.c_str() + dash + 1);
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+// 在线 CPU 和亲和性掩码取交集，容器里被 cpuset 限制的 CPU 不会被分配
+CpuTopology CpuTopology::load(const std::string& sysfsRoot) {
+  CpuTopology topology;
+  std::vector<int> online = parseCpuList(readLine(sysfsRoot + "/cpu/online"));
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  bool haveMask = ::sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+  if (online.empty()) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (haveMask && CPU_ISSET(cpu, &allowed)) {
+        online.push_back(cpu);
+      }
+    }
+  }
+
+  // 每个 CPU 所在的节点
+  std::map<int, int> nodeOfCpu;
+  std::vector<int> nodes = parseCpuList(readLine(sysfsRoot + "/node/online"));
+  for (int node : nodes) {
+    std::string path = sysfsRoot + "/node/node" + std::to_string(node) + "/cpulist";
+    for (int cpu : parseCpuList(readLine(path))) {
+      nodeOfCpu[cpu] = node;
+    }
+  }
+
+  // (package, core_id) 确定一个物理核，重新编成连续的编号
+  std::map<std::pair<int, int>, int> cores;
+  std::vector<int> usedNodes;
+  for (int cpu : online) {
+    if (haveMask && (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))) {
+      continue;
+    }
+    std::string dir = sysfsRoot + "/cpu/cpu" + std::to_string(cpu) + "/topology/";
+    std::pair<int, int> key(readInt(dir + "physical_package_id", 0),
+                            readInt(dir + "core_id", cpu));
+    auto it = cores.emplace(key, static_cast<int>(cores.size())).first;
+    auto node = nodeOfCpu.find(cpu);
+    Cpu c{cpu, it->second, node == nodeOfCpu.end() ? 0 : node->second};
+    topology.cpus.push_back(c);
+    usedNodes.push_back(c.node);
+  }
+  if (topology.cpus.empty()) {
+    topology.cpus.push_back(Cpu{0, 0, 0});
+    usedNodes.push_back(0);
+  }
+  std::sort(usedNodes.begin(), usedNodes.end());
+  topology.numNodes = static_cast<int>(
+      std::unique(usedNodes.begin(), usedNodes.end()) - usedNodes.begin());
+  return topology;
+}
+
+int CpuTopology::nodeOf(int cpu) const {
+  for (const Cpu& c : cpus) {
+    if (c.id == cpu) {
+      return c.node;
+    }
+  }
+  return -1;
+}
+
+ThreadPlacement ThreadPlacement::cpuList(std::vector<int> cpus) {
+  return ThreadPlacement(Policy::kCpuList, std::move(cpus));
+}
+
+ThreadPlacement ThreadPlacement::perCore() {
+  return ThreadPlacement(Policy::kPerCore);
+}
+
+ThreadPlacement ThreadPlacement::numaLocal() {
+  return ThreadPlacement(Policy::kNumaLocal);
+}
+
+// 只有一个节点时不设置内存策略，首次访问分配已经是本地的
+std::vector<ThreadPlacement::Slot> ThreadPlacement::assign(
+    int numThreads, const CpuTopology& topology) const {
+  std::vector<Slot> slots(numThreads);
+  const bool numa = topology.numNodes > 1;
+  if (policy_ == Policy::kCpuList && !cpus_.empty()) {
+    for (int i = 0; i < numThreads; ++i) {
+      int cpu = cpus_[i % cpus_.size()];
+      slots[i].cpus.push_back(cpu);
+      slots[i].node = numa ? topology.nodeOf(cpu) : -1;
+    }
+  } else if (policy_ == Policy::kPerCore || policy_ == Policy::kNumaLocal) {
+    // 按物理核或节点分组，组内 CPU 按编号排序
+    std::map<int, Slot> groups;
+    for (const CpuTopology::Cpu& c : topology.cpus) {
+      Slot& group = groups[policy_ == Policy::kPerCore ? c.core : c.node];
+      group.cpus.push_back(c.id);
+      group.node = numa ? c.node : -1;
+    }
+    std::vector<Slot> order;
+    for (auto& entry : groups) {
+      order.push_back(std::move(entry.second));
+    }
+    for (int i = 0; i < numThreads; ++i) {
+      slots[i] = order[i % order.size()];
+    }
+  }
+  return slots;
+}
+
+bool ThreadPlacement::apply(const Slot& slot) {
+  bool ok = true;
+  if (!slot.cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : slot.cpus) {
+      if (cpu >= 0 && cpu < CPU_SETSIZE) {
+        CPU_SET(cpu, &set);
+      }
+    }
+    int err = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+      errno = err;
+      LOG_SYSERR << "ThreadPlacement::apply pthread_setaffinity_np";
+      ok = false;
+    }
+  }
+  if (slot.node >= 0) {
+    const size_t kBits = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(slot.node / kBits + 1, 0);
+    mask[slot.node / kBits] |= 1UL << (slot.node % kBits);
+    // maxnode 在内核里会先减一，所以多传一位
+    if (::syscall(SYS_set_mempolicy, kMpolPreferred, mask.data(),
+                  mask.size() * kBits + 1) != 0) {
+      LOG_SYSERR << "ThreadPlacement::apply set_mempolicy node " << slot.node;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void starry::setCurrentThreadName(const std::string& name) {
+  // 内核限制 16 字节，包括结尾的 '\0'
+  ::pthread_setname_np(::pthread_self(), name.substr(0, 15).c_str());
+}
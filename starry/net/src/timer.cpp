@@ -1,17 +1,35 @@
 #include "timer.h"
 #include "callbacks.h"
-#include <atomic>
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
+#include <utility>
 
 using namespace starry;
 
-std::atomic<int64_t> Timer::s_numCreated_;
+void Timer::init(TimerCallback cb,
+                 MonoTime when,
+                 double interval,
+                 int64_t sequence) {
+  callback_ = std::move(cb);
+  expiration_ = when;
+  interval_ =
+      interval > 0 ? std::max<int64_t>(static_cast<int64_t>(interval * 1000000), 1)
+                   : 0;
+  canceled_ = false;
+  sequence_ = sequence;
+}
+
+void Timer::clear() {
+  sequence_ = 0;
+  callback_ = nullptr;
+  canceled_ = false;
+}
 
-void Timer::restart(Timestamp now) {
-  if (repeat_) {
+void Timer::restart(MonoTime now) {
+  if (repeat()) {
     expiration_ = now + std::chrono::microseconds(interval_);
   } else {
-    expiration_ = Timestamp::min();
+    expiration_ = MonoTime::min();
   }
 }
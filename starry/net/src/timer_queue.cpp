@@ -16,9 +16,8 @@
 #include <cstdint>
 #include <cstring>
 #include <ctime>
-#include <format>
 #include <functional>
-#include <iterator>
+#include <mutex>
 #include <utility>
 #include <vector>
 
@@ -34,76 +33,67 @@ int createTimerfd() {
   return timerfd;
 }
 
-// 获取 timerspec 的触发时间，为了初始化 timerfd
-struct timespec howMuchTimeFromNow(Timestamp when) {
-  auto nanoseconds =
-      std::chrono::duration_cast<std::chrono::nanoseconds>(when - Clock::now());
-
-  struct timespec ts;
-  ts.tv_sec =
-      std::chrono::duration_cast<std::chrono::seconds>(nanoseconds).count();
-  ts.tv_nsec = nanoseconds.count() % 1000000000;
-
-  return ts;
-}
-
 // 当 timerfd 触发时，它会变为可读状态。
 // 必须读取数据以"消费"这个事件，
 // 否则 timerfd 会持续处于就绪状态。
-void readTimerfd(int timerfd, Timestamp now) {
+void readTimerfd(int timerfd, MonoTime now) {
   uint64_t howmany;
   ssize_t n = ::read(timerfd, &howmany, sizeof(howmany));
   LOG_TRACE << "TimerQueue::handleRead() " << howmany << " at "
-            << std::format("{:%F %T}", now);
+            << now.time_since_epoch().count();
   if (n != sizeof(howmany)) {
     LOG_ERROR << "TimerQueue::handleRead() reads " << n
               << " bytes instead of 8";
   }
 }
 
-// 初始化 timerfd
-void resetTimerfd(int timerfd, Timestamp expiration) {
-  struct itimerspec newValue;  // 新的定时时间
-  struct itimerspec oldValue;  // 以前的定时时间
-  memset(&newValue, 0, sizeof(newValue));
-  memset(&oldValue, 0, sizeof(oldValue));
-  newValue.it_value = howMuchTimeFromNow(expiration);
-  int ret = ::timerfd_settime(timerfd, 0, &newValue, &oldValue);
-  if (ret) {
-    LOG_FATAL << "timerfd_settime";
-  }
-}
 }  // namespace starry::detail
 
 using namespace starry;
 using namespace starry::detail;
 
-TimerQueue::TimerQueue(EventLoop* loop)
+TimerQueue::TimerQueue(EventLoop* loop, std::chrono::nanoseconds resolution)
     : loop_(loop),
       timerfd_(createTimerfd()),
       timerfdChannel_(loop, timerfd_),
-      timers_(),
-      callingExpiredTimers_(false) {
+      wheel_(resolution),
+      nextSequence_(0),
+      callingExpiredTimers_(false),
+      armedExpiration_(MonoTime::max()),
+      slack_(0) {
   timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
   timerfdChannel_.enableReading();
 }
 
+// 定时器的内存由两个池持有，随池一起释放
 TimerQueue::~TimerQueue() {
   timerfdChannel_.disableAll();
   timerfdChannel_.remove();
   ::close(timerfd_);
-  for (const Entry& timer : timers_) {
-    delete timer.second;
-  }
 }
 
-// 添加一个定时器，绑定添加定时回调函数
+// loop 线程直接从 pool_ 取，其他线程加锁从 sharedPool_ 取，再交给 loop 线程放入时间轮
 TimerId TimerQueue::addTimer(TimerCallback cb,
-                             Timestamp when,
+                             MonoTime when,
                              double interval) {
-  Timer* timer = new Timer(std::move(cb), when, interval);
-  loop_->runInLoop(std::bind(&TimerQueue::addTimerInLoop, this, timer));
-  return TimerId(timer, timer->sequence());
+  const int64_t sequence =
+      nextSequence_.fetch_add(1, std::memory_order_relaxed) + 1;
+  Timer* timer;
+  if (loop_->isInLoopThread()) {
+    timer = pool_.allocate();
+    timer->init(std::move(cb), when, interval, sequence);
+    addTimerInLoop(timer);
+  } else {
+    // 在锁里初始化，loop 线程拿着旧的 TimerId 取消时也在锁里比较序号，
+    // 不会读到写了一半的定时器
+    {
+      std::lock_guard<std::mutex> lock(sharedMutex_);
+      timer = sharedPool_.allocate();
+      timer->init(std::move(cb), when, interval, sequence);
+    }
+    loop_->queueInLoop(std::bind(&TimerQueue::addTimerInLoop, this, timer));
+  }
+  return TimerId(timer, sequence);
 }
 
 // 取消定时器，绑定取消回调函数
@@ -111,124 +101,161 @@ void TimerQueue::cancel(TimerId timerId) {
   loop_->runInLoop(std::bind(&TimerQueue::cancelInLoop, this, timerId));
 }
 
-// 定时回调函数，调用 insert
+void TimerQueue::setResolution(std::chrono::nanoseconds resolution) {
+  loop_->runInLoop(
+      std::bind(&TimerQueue::setResolutionInLoop, this, resolution));
+}
+
+void TimerQueue::setSlack(std::chrono::nanoseconds slack) {
+  loop_->runInLoop(std::bind(&TimerQueue::setSlackInLoop, this, slack));
+}
+
+// 放入时间轮，最晚要处理所在槽的时间比 timerfd 设置的早时才重新设置
 void TimerQueue::addTimerInLoop(Timer* timer) {
   loop_->assertInLoopThread();
-  bool earliestChanged = insert(timer);
-
-  if (earliestChanged) {
-    resetTimerfd(timerfd_, timer->expiration());
+  wheel_.skipTo(loop_->now());
+  MonoTime deadline = deadlineOf(wheel_.insert(timer));
+  if (deadline < armedExpiration_) {
+    resetTimerfd(deadline);
   }
 }
 
-// 同过 activeTimers_ 查找到对应定时器，然后再加入到 cancelingTimers_中，等待
-// handleRead reset取消
+// 池里的内存不会释放，序号不同说明定时器已经触发或取消，槽位可能已经给了新的定时器；
+// 序号只在本队列里唯一，先按地址确认定时器是本队列的池分配的，别的队列的不解引用；
+// 共享池的定时器可能正被其他线程取出初始化，在锁里比较序号
+// 还在时间轮里的直接移除；正在执行的这一批里的标记为取消，不再执行也不再重复
 void TimerQueue::cancelInLoop(TimerId timerId) {
   loop_->assertInLoopThread();
-  assert(timers_.size() == activeTimers_.size());
-  ActiveTimer timer(timerId.timer_, timerId.sequence_);
-  ActiveTimerSet::iterator it = activeTimers_.find(timer);
-  if (it != activeTimers_.end()) {
-    size_t n = timers_.erase(Entry(it->first->expiration(), it->first));
-    assert(n == 1);
-    (void)n;
-    delete it->first;
-    activeTimers_.erase(it);
+  Timer* timer = timerId.timer_;
+  if (timer == nullptr) {
+    return;
+  }
+  if (pool_.owns(timer)) {
+    if (timer->sequence() != timerId.sequence_) {
+      return;
+    }
+  } else {
+    std::lock_guard<std::mutex> lock(sharedMutex_);
+    if (!sharedPool_.owns(timer) || timer->sequence() != timerId.sequence_) {
+      return;
+    }
+  }
+  if (TimingWheel::contains(timer)) {
+    wheel_.remove(timer);
+    release(timer);
   } else if (callingExpiredTimers_) {
-    cancelingTimers_.insert(timer);
+    timer->cancel();
+  }
+}
+
+void TimerQueue::setResolutionInLoop(std::chrono::nanoseconds resolution) {
+  loop_->assertInLoopThread();
+  wheel_.setTick(resolution);
+  rearm();
+}
+
+void TimerQueue::setSlackInLoop(std::chrono::nanoseconds slack) {
+  loop_->assertInLoopThread();
+  slack_ = std::max(slack, std::chrono::nanoseconds(0));
+  rearm();
+}
+
+MonoTime TimerQueue::deadlineOf(MonoTime event) const {
+  if (event >= MonoTime::max() - slack_) {
+    return MonoTime::max();
   }
-  assert(timers_.size() == activeTimers_.size());
+  return event + slack_;
 }
 
-// 处理定时任务
+// 处理定时任务，用 loop 本轮缓存的时间；粗粒度时钟可能比 timerfd 慢一点，
+// timerfd 可读说明已经到了设置的触发时间，取两者中较晚的
 void TimerQueue::handleRead() {
   loop_->assertInLoopThread();
-  Timestamp now = Clock::now();
+  MonoTime now = loop_->now();
+  if (armedExpiration_ != MonoTime::max()) {
+    now = std::max(now, armedExpiration_);
+  }
+  armedExpiration_ = MonoTime::max();
   readTimerfd(timerfd_, now);
+  LoopStats& stats = loop_->stats();
+  LoopStats::add(stats.timerWakeups, 1);
 
-  std::vector<Entry> expired = getExpired(now);
+  expired_.clear();
+  wheel_.expire(now, &expired_);
 
   callingExpiredTimers_ = true;
-  cancelingTimers_.clear();
-  for (const Entry& it : expired) {
-    it.second->run();
+  Histogram& timerNanos = loop_->metrics().timerNanos;
+  MonoTime start = MonoClock::now();
+  for (size_t i = 0; i < expired_.size(); ++i) {
+    Timer* timer = expired_[i];
+    if (timer->canceled()) {
+      continue;
+    }
+    loop_->beginCallback(timerfd_, &timer->callbackType());
+    timer->run();
+    LoopStats::add(stats.timersFired, 1);
+    const MonoTime end = MonoClock::now();
+    timerNanos.record(static_cast<uint64_t>((end - start) /
+                                            std::chrono::nanoseconds(1)));
+    start = end;
   }
   callingExpiredTimers_ = false;
-  reset(expired, now);
-}
-
-// 获取过期的vector 并把过期的元素从 timers_ 中删除
-std::vector<TimerQueue::Entry> TimerQueue::getExpired(Timestamp now) {
-  assert(timers_.size() == activeTimers_.size());
-  std::vector<Entry> expired;
-  Entry sentry(now, reinterpret_cast<Timer*>(UINTPTR_MAX));
-  TimerList::iterator end = timers_.lower_bound(sentry);
-  assert(end == timers_.end() || now < end->first);
-  std::copy(timers_.begin(), end, std::back_inserter(expired));
-  timers_.erase(timers_.begin(), end);
-
-  for (const Entry& it : expired) {
-    ActiveTimer timer(it.second, it.second->sequence());
-    size_t n = activeTimers_.erase(timer);
-    assert(n == 1);
-    (void)n;
-  }
-
-  assert(timers_.size() == activeTimers_.size());
-  return expired;
+  reset(now);
 }
 
-// 处理经过 handleRead 运行过的过期定时器，如果是 repeat 就重置指针，
-// 并重新初始化 timerfd
-void TimerQueue::reset(const std::vector<Entry>& expired, Timestamp now) {
-  Timestamp nextExpire;
-  for (const Entry& it : expired) {
-    ActiveTimer timer(it.second, it.second->sequence());
-    if (it.second->repeat() &&
-        cancelingTimers_.find(timer) == cancelingTimers_.end()) {
-      it.second->restart(now);
-      insert(it.second);
+// 处理经过 handleRead 运行过的过期定时器，重复的重新放入时间轮，
+// 其他的还给池，并重新设置 timerfd
+void TimerQueue::reset(MonoTime now) {
+  for (Timer* timer : expired_) {
+    if (timer->repeat() && !timer->canceled()) {
+      timer->restart(now);
+      wheel_.insert(timer);
     } else {
-      delete it.second;
+      release(timer);
     }
   }
+  expired_.clear();
+  rearm();
+}
 
-  if (!timers_.empty()) {
-    nextExpire = timers_.begin()->second->expiration();
+// 时间轮空了就不再设置，loop 可以正常退出
+// 当前设置的时间在下一次处理的窗口 [next, next + slack] 里时不用重新设置
+void TimerQueue::rearm() {
+  MonoTime next = wheel_.nextEvent();
+  if (next == MonoTime::max()) {
+    return;
   }
-
-  if (nextExpire != Timestamp::min()) {
-    resetTimerfd(timerfd_, nextExpire);
+  MonoTime deadline = deadlineOf(next);
+  if (armedExpiration_ < next || armedExpiration_ > deadline) {
+    resetTimerfd(deadline);
   }
 }
 
-// 分别插入 timers_ 和 activeTimers_
-bool TimerQueue::insert(Timer* timer) {
-  loop_->assertInLoopThread();
-  assert(timers_.size() == activeTimers_.size());
-
-  // 判断是否是最先触发
-  bool earliestChanged = false;
-  Timestamp when = timer->expiration();
-  TimerList::iterator it = timers_.begin();
-  if (it == timers_.end() || when < it->first) {
-    earliestChanged = true;
-  }
-
-  {
-    std::pair<TimerList::iterator, bool> result =
-        timers_.insert(Entry(when, timer));
-    assert(result.second);
-    (void)result;
+void TimerQueue::release(Timer* timer) {
+  if (timer->pool() == &pool_) {
+    pool_.release(timer);
+  } else {
+    std::lock_guard<std::mutex> lock(sharedMutex_);
+    sharedPool_.release(timer);
   }
+}
 
-  {
-    std::pair<ActiveTimerSet::iterator, bool> result =
-        activeTimers_.insert(ActiveTimer(timer, timer->sequence()));
-    assert(result.second);
-    (void)result;
+// timerfd 和 steady_clock 都用 CLOCK_MONOTONIC，直接设置绝对时间，
+// 不需要再读一次当前时间，已经过去的时间会立即触发
+void TimerQueue::resetTimerfd(MonoTime expiration) {
+  struct itimerspec newValue;
+  memset(&newValue, 0, sizeof(newValue));
+  const int64_t ns = std::max<int64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          expiration.time_since_epoch())
+          .count(),
+      1);
+  newValue.it_value.tv_sec = ns / 1000000000;
+  newValue.it_value.tv_nsec = ns % 1000000000;
+  int ret = ::timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &newValue, nullptr);
+  LoopStats::add(loop_->stats().timerfdSettimes, 1);
+  if (ret) {
+    LOG_SYSFATAL << "timerfd_settime";
   }
-
-  assert(timers_.size() == activeTimers_.size());
-  return earliestChanged;
+  armedExpiration_ = expiration;
 }
@@ -0,0 +1,228 @@
+#include "timing_wheel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+using namespace starry;
+
+namespace {
+
+const uint64_t kSlotMask = TimingWheel::kSlots - 1;
+
+// 第 level 层一个槽覆盖的 tick 数的位数
+int levelShift(int level) {
+  return level * TimingWheel::kSlotBits;
+}
+
+// tick 在 shift 位以上的部分，shift 超过 63 时为 0
+int64_t highBits(int64_t tick, int shift) {
+  return shift >= 63 ? 0 : (tick >> shift) << shift;
+}
+
+}  // namespace
+
+TimingWheel::TimingWheel(std::chrono::nanoseconds tick)
+    : tickNanos_(std::max<int64_t>(tick.count(), 1)), currentTick_(0), size_(0) {
+  memset(occupied_, 0, sizeof(occupied_));
+  memset(slots_, 0, sizeof(slots_));
+  currentTick_ = floorTick(MonoClock::now());
+}
+
+int64_t TimingWheel::ceilTick(MonoTime time) const {
+  const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         time.time_since_epoch())
+                         .count();
+  if (ns <= 0) {
+    return 0;
+  }
+  // 不用 (ns + tick - 1) / tick，MonoTime::max() 会溢出
+  return ns / tickNanos_ + (ns % tickNanos_ != 0);
+}
+
+int64_t TimingWheel::floorTick(MonoTime time) const {
+  const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         time.time_since_epoch())
+                         .count();
+  return ns <= 0 ? 0 : ns / tickNanos_;
+}
+
+MonoTime TimingWheel::timeOf(int64_t tick) const {
+  if (tick > std::numeric_limits<int64_t>::max() / tickNanos_) {
+    return MonoTime::max();
+  }
+  return MonoTime(std::chrono::duration_cast<MonoClock::duration>(
+      std::chrono::nanoseconds(tick * tickNanos_)));
+}
+
+MonoTime TimingWheel::insert(Timer* timer) {
+  assert(!contains(timer));
+  timer->tick_ = std::max(ceilTick(timer->expiration()), currentTick_ + 1);
+  return timeOf(place(timer));
+}
+
+void TimingWheel::remove(Timer* timer) {
+  assert(contains(timer));
+  unlink(timer);
+}
+
+// 到期 tick 和当前 tick 从高位数第一个不同的位决定放在哪一层
+int64_t TimingWheel::place(Timer* timer) {
+  const int64_t tick = timer->tick_;
+  assert(tick >= currentTick_);
+  const uint64_t diff =
+      static_cast<uint64_t>(tick) ^ static_cast<uint64_t>(currentTick_);
+  const int level = diff == 0 ? 0 : (63 - __builtin_clzll(diff)) / kSlotBits;
+  const int shift = levelShift(level);
+  const int index = static_cast<int>((tick >> shift) & kSlotMask);
+
+  Slot& slot = slots_[level * kSlots + index];
+  timer->prev_ = slot.tail;
+  timer->next_ = nullptr;
+  if (slot.tail) {
+    slot.tail->next_ = timer;
+  } else {
+    slot.head = timer;
+  }
+  slot.tail = timer;
+  timer->bucket_ = level * kSlots + index;
+  occupied_[level] |= 1ULL << index;
+  ++size_;
+  return highBits(tick, shift);
+}
+
+void TimingWheel::unlink(Timer* timer) {
+  Slot& slot = slots_[timer->bucket_];
+  if (timer->prev_) {
+    timer->prev_->next_ = timer->next_;
+  } else {
+    slot.head = timer->next_;
+  }
+  if (timer->next_) {
+    timer->next_->prev_ = timer->prev_;
+  } else {
+    slot.tail = timer->prev_;
+  }
+  if (slot.head == nullptr) {
+    occupied_[timer->bucket_ / kSlots] &= ~(1ULL << (timer->bucket_ % kSlots));
+  }
+  timer->prev_ = nullptr;
+  timer->next_ = nullptr;
+  timer->bucket_ = Timer::kNoBucket;
+  --size_;
+}
+
+// 低层的槽都在当前这个高层槽的范围里，比高层下一个非空槽的起点早，
+// 所以从低到高第一个有非空槽的层给出的就是最早的
+int64_t TimingWheel::nextEventTick() const {
+  for (int level = 0; level < kLevels; ++level) {
+    const int shift = levelShift(level);
+    const uint64_t current = (currentTick_ >> shift) & kSlotMask;
+    const uint64_t ahead =
+        current == kSlotMask ? 0 : occupied_[level] & (~0ULL << (current + 1));
+    if (ahead) {
+      const int64_t index = __builtin_ctzll(ahead);
+      return highBits(currentTick_, shift + kSlotBits) | (index << shift);
+    }
+  }
+  return std::numeric_limits<int64_t>::max();
+}
+
+void TimingWheel::cascade(int level, int index) {
+  Slot& slot = slots_[level * kSlots + index];
+  Timer* timer = slot.head;
+  slot.head = nullptr;
+  slot.tail = nullptr;
+  occupied_[level] &= ~(1ULL << index);
+  while (timer) {
+    Timer* next = timer->next_;
+    --size_;
+    place(timer);
+    timer = next;
+  }
+}
+
+void TimingWheel::expire(MonoTime now, std::vector<Timer*>* expired) {
+  const int64_t target = floorTick(now);
+  for (;;) {
+    const int64_t event = nextEventTick();
+    if (event > target) {
+      break;
+    }
+    currentTick_ = event;
+    // 先降高层，降下来的定时器可能正好落在更低一层的当前槽里
+    for (int level = kLevels - 1; level > 0; --level) {
+      const int shift = levelShift(level);
+      if ((event & ((int64_t(1) << shift) - 1)) == 0) {
+        const int index = static_cast<int>((event >> shift) & kSlotMask);
+        if (occupied_[level] & (1ULL << index)) {
+          cascade(level, index);
+        }
+      }
+    }
+
+    const int index = static_cast<int>(event & kSlotMask);
+    Slot& slot = slots_[index];
+    for (Timer* timer = slot.head; timer;) {
+      Timer* next = timer->next_;
+      timer->prev_ = nullptr;
+      timer->next_ = nullptr;
+      timer->bucket_ = Timer::kNoBucket;
+      --size_;
+      expired->push_back(timer);
+      timer = next;
+    }
+    slot.head = nullptr;
+    slot.tail = nullptr;
+    occupied_[0] &= ~(1ULL << index);
+  }
+  currentTick_ = std::max(currentTick_, target);
+}
+
+MonoTime TimingWheel::nextEvent() const {
+  const int64_t event = nextEventTick();
+  return event == std::numeric_limits<int64_t>::max() ? MonoTime::max()
+                                                      : timeOf(event);
+}
+
+void TimingWheel::skipTo(MonoTime now) {
+  const int64_t target = floorTick(now);
+  if (target > currentTick_ && nextEventTick() > target) {
+    currentTick_ = target;
+  }
+}
+
+void TimingWheel::setTick(std::chrono::nanoseconds tick) {
+  std::vector<Timer*> timers;
+  takeAll(&timers);
+  const int64_t nowNanos = currentTick_ * tickNanos_;
+  tickNanos_ = std::max<int64_t>(tick.count(), 1);
+  currentTick_ = nowNanos / tickNanos_;
+  for (Timer* timer : timers) {
+    insert(timer);
+  }
+}
+
+void TimingWheel::takeAll(std::vector<Timer*>* timers) {
+  for (int level = 0; level < kLevels; ++level) {
+    for (uint64_t bits = occupied_[level]; bits; bits &= bits - 1) {
+      Slot& slot = slots_[level * kSlots + __builtin_ctzll(bits)];
+      for (Timer* timer = slot.head; timer;) {
+        Timer* next = timer->next_;
+        timer->prev_ = nullptr;
+        timer->next_ = nullptr;
+        timer->bucket_ = Timer::kNoBucket;
+        timers->push_back(timer);
+        timer = next;
+      }
+      slot.head = nullptr;
+      slot.tail = nullptr;
+    }
+    occupied_[level] = 0;
+  }
+  size_ = 0;
+}
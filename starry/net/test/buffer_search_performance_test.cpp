@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "buffer.h"
+#include "delimiter_search.h"
+
+using namespace starry;
+
+namespace {
+
+const search::Kernel kKernels[] = {search::Kernel::kScalar,
+                                   search::Kernel::kSse2,
+                                   search::Kernel::kAvx2};
+
+// 原来 Buffer::findCRLF 的实现，作为对比基准
+const char* findBaseline(const char* begin,
+                         const char* end,
+                         std::string_view token) {
+  const char* found = std::search(begin, end, token.begin(), token.end());
+  return found == end ? nullptr : found;
+}
+
+// 生成 lines 行流水线请求，每行长度 lineLen，以 \r\n 结尾
+std::string makePipelined(size_t lines, size_t lineLen) {
+  std::string data;
+  data.reserve(lines * (lineLen + 2));
+  for (size_t i = 0; i < lines; ++i) {
+    for (size_t j = 0; j < lineLen; ++j) {
+      data.push_back(static_cast<char>('a' + (i + j) % 26));
+    }
+    data.append("\r\n");
+  }
+  return data;
+}
+
+}  // namespace
+
+class BufferSearchPerformanceTest : public ::testing::Test {};
+
+// 1. 各个内核与基准实现的结果一致
+TEST_F(BufferSearchPerformanceTest, KernelsAgree) {
+  std::string data;
+  srand(42);
+  for (int i = 0; i < 5000; ++i) {
+    data.push_back("ab\r\nxyz"[rand() % 7]);
+  }
+  const std::string_view tokens[] = {"\r\n", "\n", "\r\n\r\n", "xyz", "zzzzz"};
+  for (search::Kernel kernel : kKernels) {
+    if (!search::kernelSupported(kernel)) {
+      continue;
+    }
+    for (std::string_view token : tokens) {
+      for (size_t start = 0; start < 200; ++start) {
+        const char* b = data.data() + start;
+        const char* e = data.data() + data.size() - start / 2;
+        EXPECT_EQ(search::find(kernel, b, e, token), findBaseline(b, e, token))
+            << search::kernelName(kernel) << " token=" << token.size();
+      }
+    }
+  }
+}
+
+// 2. 流水线请求中逐行查找 \r\n 的吞吐量，数据放在缓存里反复扫描
+TEST_F(BufferSearchPerformanceTest, PipelinedLines) {
+  const size_t kLineLens[] = {64, 1024, 16384};
+  const int kRounds = 64;
+  for (size_t lineLen : kLineLens) {
+    const std::string data = makePipelined((256 << 10) / lineLen, lineLen);
+    const char* end = data.data() + data.size();
+
+    auto run = [&](const char* name, auto&& findFn) {
+      auto start = std::chrono::steady_clock::now();
+      size_t lines = 0;
+      for (int round = 0; round < kRounds; ++round) {
+        const char* p = data.data();
+        while (const char* crlf = findFn(p, end)) {
+          ++lines;
+          p = crlf + 2;
+        }
+      }
+      auto elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+      printf("line=%-6zu %-8s %8.1f MB/s\n", lineLen, name,
+             data.size() * kRounds / elapsed / 1e6);
+      return lines;
+    };
+
+    size_t expected = run("baseline", [](const char* b, const char* e) {
+      return findBaseline(b, e, "\r\n");
+    });
+    for (search::Kernel kernel : kKernels) {
+      if (!search::kernelSupported(kernel)) {
+        continue;
+      }
+      size_t lines =
+          run(search::kernelName(kernel), [kernel](const char* b, const char* e) {
+            return search::find(kernel, b, e, "\r\n");
+          });
+      EXPECT_EQ(lines, expected);
+    }
+  }
+}
+
+// 3. 半帧数据分批到达时，续扫比每次从头扫描少扫很多字节
+TEST_F(BufferSearchPerformanceTest, ResumeScan) {
+  const std::string frame = std::string(1 << 20, 'x') + "\r\n";
+  const size_t kChunk = 1024;
+
+  auto run = [&](bool resume) {
+    Buffer buf;
+    size_t scanned = 0;
+    const char* crlf = nullptr;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t off = 0; off < frame.size() && !crlf; off += kChunk) {
+      buf.append(std::string_view(frame).substr(off, kChunk));
+      crlf = resume ? buf.findCRLF(&scanned) : buf.findCRLF();
+    }
+    auto elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    printf("%-10s %8.3f ms\n", resume ? "resume" : "rescan", elapsed * 1e3);
+    return crlf ? static_cast<size_t>(crlf - buf.peek()) : 0;
+  };
+
+  EXPECT_EQ(run(false), frame.size() - 2);
+  EXPECT_EQ(run(true), frame.size() - 2);
+}
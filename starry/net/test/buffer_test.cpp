@@ -1,7 +1,11 @@
 // buffer_test.cc
 #include <gtest/gtest.h>
+#include <memory>
 #include <string>
 #include "buffer.h"
+#include "buffer_pool.h"
+#include "eventloop.h"
+#include "read_size_policy.h"
 
 using namespace starry;
 
@@ -98,3 +102,199 @@ TEST_F(BufferTest, NetworkOperations) {
   ::close(pipefd[0]);
   ::close(pipefd[1]);
 }
+
+// 7. 从内存池延迟申请存储
+TEST_F(BufferTest, LazyPoolStorage) {
+  BufferPool pool;
+  Buffer buf(&pool);
+  EXPECT_FALSE(buf.hasStorage());
+  EXPECT_EQ(buf.writableBytes(), 0);
+  EXPECT_EQ(pool.stats().allocations, 0);
+
+  buf.append("hello");
+  EXPECT_TRUE(buf.hasStorage());
+  EXPECT_EQ(pool.stats().bytesInUse, BufferPool::kMinBlockSize);
+
+  EXPECT_FALSE(buf.releaseIfEmpty());
+  EXPECT_EQ(buf.retrieveAllAsString(), "hello");
+  EXPECT_TRUE(buf.releaseIfEmpty());
+  EXPECT_FALSE(buf.hasStorage());
+  EXPECT_EQ(pool.stats().bytesInUse, 0);
+  EXPECT_EQ(pool.stats().bytesCached, BufferPool::kMinBlockSize);
+
+  // 再次写入时复用缓存的块
+  buf.append("world");
+  EXPECT_EQ(pool.stats().hits, 1);
+  EXPECT_EQ(buf.retrieveAllAsString(), "world");
+}
+
+// 8. 扩容时按分级申请，并保留可读数据
+TEST_F(BufferTest, PoolGrow) {
+  BufferPool pool;
+  Buffer buf(&pool);
+  std::string str(3000, 'x');
+  buf.append(str);
+  EXPECT_EQ(buf.internalCapacity(), 4096);
+  buf.append(std::string(5000, 'y'));
+  EXPECT_EQ(buf.internalCapacity(), 8192);
+  EXPECT_EQ(buf.retrieveAsString(3000), str);
+  EXPECT_EQ(buf.readableBytes(), 5000);
+}
+
+// 9. 自适应读大小
+TEST_F(BufferTest, ReadSizePolicy) {
+  ReadSizePolicy policy;
+  EXPECT_EQ(policy.next(), ReadSizePolicy::kInitialReadSize);
+
+  // 读满就变大，直到上限
+  for (int i = 0; i < 10; ++i) {
+    policy.record(policy.next());
+  }
+  EXPECT_EQ(policy.next(), ReadSizePolicy::kMaxReadSize);
+
+  // 连续两次读不满才变小
+  policy.record(100);
+  EXPECT_EQ(policy.next(), ReadSizePolicy::kMaxReadSize);
+  policy.record(100);
+  EXPECT_EQ(policy.next(), ReadSizePolicy::kMaxReadSize / 2);
+
+  for (int i = 0; i < 100; ++i) {
+    policy.record(1);
+  }
+  EXPECT_EQ(policy.next(), ReadSizePolicy::kMinReadSize);
+}
+
+// 10. 续扫查找，跨两次到达的 \r\n 也能找到
+TEST_F(BufferTest, ResumableFind) {
+  size_t scanned = 0;
+  buffer_->append("GET / HTTP/1.1\r");
+  EXPECT_EQ(buffer_->findCRLF(&scanned), nullptr);
+  EXPECT_EQ(scanned, 14);
+
+  buffer_->append("\nHost: a\r\n");
+  const char* crlf = buffer_->findCRLF(&scanned);
+  ASSERT_NE(crlf, nullptr);
+  EXPECT_EQ(crlf - buffer_->peek(), 14);
+
+  buffer_->retrieveUntil(crlf + 2);
+  scanned = 0;
+  EXPECT_EQ(buffer_->find("a\r\n", &scanned) - buffer_->peek(), 6);
+  EXPECT_EQ(buffer_->findEOL() - buffer_->peek(), 8);
+}
+
+// 11. 切片不拷贝，Buffer 之后的写入和搬移不影响已切出的数据
+TEST_F(BufferTest, SliceSurvivesBufferReuse) {
+  auto pool = std::make_shared<BufferPool>();
+  Buffer buf(pool.get());
+  buf.append("frame-1frame-2");
+  BufferSlice first = buf.retrieveAsSlice(7);
+  EXPECT_EQ(first.view(), "frame-1");
+  EXPECT_EQ(first.data() + 7, buf.peek());
+
+  // 触发搬移和重用，切片引用的存储不能被覆盖
+  buf.append(std::string(2000, 'z'));
+  buf.prepend("hd", 2);
+  BufferSlice rest = buf.retrieveAllAsSlice();
+  EXPECT_EQ(first.view(), "frame-1");
+  EXPECT_EQ(rest.size(), 2 + 7 + 2000);
+  EXPECT_EQ(rest.subslice(2, 7).view(), "frame-2");
+
+  buf.append("next");
+  EXPECT_EQ(buf.retrieveAllAsString(), "next");
+  EXPECT_EQ(first.view(), "frame-1");
+
+  // 最后一个切片释放时存储才归还给 pool
+  first.reset();
+  rest.reset();
+  buf.releaseIfEmpty();
+  EXPECT_EQ(pool->stats().bytesInUse, 0);
+}
+
+// 12. 切片都释放后 Buffer 收回存储，原地复用
+TEST_F(BufferTest, SliceReleasedReclaimsStorage) {
+  Buffer buf;
+  buf.append("abcdef");
+  const char* storage = buf.peek();
+  {
+    BufferSlice s = buf.retrieveAsSlice(3);
+    EXPECT_EQ(s.view(), "abc");
+  }
+  buf.retrieveAll();
+  buf.append("xyz");
+  EXPECT_EQ(buf.peek(), storage);
+  EXPECT_EQ(buf.retrieveAllAsString(), "xyz");
+
+  BufferSlice copy = BufferSlice::copyOf("owned");
+  BufferSlice other = copy;
+  copy.removePrefix(2);
+  EXPECT_EQ(copy.view(), "ned");
+  EXPECT_EQ(other.view(), "owned");
+}
+
+// 13. 按分级的大小预留时正好占一个块，预留空间在块里面
+TEST_F(BufferTest, StorageFitsSizeClass) {
+  BufferPool pool;
+  for (size_t size = BufferPool::kMinBlockSize; size <= BufferPool::kMaxBlockSize;
+       size *= 2) {
+    Buffer buf(&pool);
+    buf.ensureStorage(size);
+    EXPECT_EQ(buf.internalCapacity(), size);
+    EXPECT_EQ(buf.writableBytes(), size - Buffer::kCheapPrepend);
+  }
+
+  // 没有存储时 prepend 申请的默认存储也是一个最小的块
+  Buffer buf(&pool);
+  buf.prependInt32(1);
+  EXPECT_EQ(buf.internalCapacity(), Buffer::kInitialSize);
+  EXPECT_EQ(buf.internalCapacity(), BufferPool::kMinBlockSize);
+}
+
+// 14. 读大小到了上限，每次读还是从 pool 的最大一级取块，归还后复用
+TEST_F(BufferTest, MaxReadSizeUsesPool) {
+  BufferPool pool;
+  Buffer buf(&pool);
+  ReadSizePolicy policy;
+  for (int i = 0; i < 10; ++i) {
+    policy.record(policy.next());
+  }
+  ASSERT_EQ(policy.next(), ReadSizePolicy::kMaxReadSize);
+
+  int pipefd[2];
+  ASSERT_EQ(::pipe(pipefd), 0);
+  const std::string data(ReadSizePolicy::kMaxReadSize - Buffer::kCheapPrepend,
+                         'r');
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_EQ(::write(pipefd[1], data.data(), data.size()),
+              static_cast<ssize_t>(data.size()));
+    buf.ensureStorage(policy.next());
+    EXPECT_EQ(buf.internalCapacity(), BufferPool::kMaxBlockSize);
+    int savedErrno = 0;
+    EXPECT_EQ(buf.readFd(pipefd[0], &savedErrno),
+              static_cast<ssize_t>(data.size()));
+    EXPECT_EQ(buf.retrieveAllAsString(), data);
+    EXPECT_TRUE(buf.releaseIfEmpty());
+  }
+  EXPECT_EQ(pool.stats().allocations, 2);
+  EXPECT_EQ(pool.stats().hits, 1);
+  EXPECT_EQ(pool.stats().bytesCached, BufferPool::kMaxBlockSize);
+
+  ::close(pipefd[0]);
+  ::close(pipefd[1]);
+}
+
+// 15. 切片比所属的 EventLoop 活得久：pool 等最后一个切片释放后才析构
+TEST_F(BufferTest, SliceOutlivesLoop) {
+  std::unique_ptr<EventLoop> loop(new EventLoop);
+  std::weak_ptr<BufferPool> pool = loop->bufferPool()->weak_from_this();
+  BufferSlice slice;
+  {
+    Buffer buf(loop->bufferPool());
+    buf.append("escaped");
+    slice = buf.retrieveAllAsSlice();
+  }
+  loop.reset();
+  EXPECT_FALSE(pool.expired());
+  EXPECT_EQ(slice.view(), "escaped");
+  slice.reset();
+  EXPECT_TRUE(pool.expired());
+}
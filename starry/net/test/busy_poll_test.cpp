@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "eventloop.h"
+#include "eventloop_thread.h"
+
+using namespace starry;
+
+namespace {
+
+// 其他线程 queueInLoop 一个任务到它被执行的往返时间，返回排好序的纳秒数
+std::vector<int64_t> measureRoundTrips(EventLoop* loop, int samples) {
+  std::vector<int64_t> latencies;
+  latencies.reserve(samples);
+  for (int i = 0; i < samples; ++i) {
+    std::atomic<bool> done(false);
+    auto start = std::chrono::steady_clock::now();
+    loop->queueInLoop([&done] { done.store(true, std::memory_order_release); });
+    while (!done.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+    latencies.push_back((std::chrono::steady_clock::now() - start) /
+                        std::chrono::nanoseconds(1));
+    // 间隔一段时间，让 loop 回到空闲状态
+    std::this_thread::sleep_for(std::chrono::microseconds(20));
+  }
+  std::sort(latencies.begin(), latencies.end());
+  return latencies;
+}
+
+}  // namespace
+
+class BusyPollTest : public ::testing::Test {};
+
+// 1. 空闲时自旋窗口用完转为阻塞，自旋时间只占很小一部分
+TEST_F(BusyPollTest, IdleBacksOff) {
+  EventLoop loop;
+  loop.setBusyPoll(true);
+  EXPECT_TRUE(loop.busyPoll());
+  std::thread quitter([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    loop.quit();
+  });
+  loop.loop();
+  quitter.join();
+
+  const LoopStats& stats = loop.stats();
+  EXPECT_GT(stats.spinMisses.load(), 0u);
+  EXPECT_GT(stats.blockNanos.load(), stats.spinNanos.load());
+  EXPECT_LT(stats.spinFraction(), 0.5);
+}
+
+// 2. 与阻塞模式对比跨线程投递的往返延迟
+TEST_F(BusyPollTest, RoundTripLatency) {
+  const int kSamples = 2000;
+  for (bool busy : {false, true}) {
+    EventLoopThread thread;
+    EventLoop* loop = thread.startLoop();
+    loop->setBusyPoll(busy);
+    std::vector<int64_t> latencies = measureRoundTrips(loop, kSamples);
+    ASSERT_EQ(latencies.size(), static_cast<size_t>(kSamples));
+
+    const LoopStats& stats = loop->stats();
+    printf("%-8s p50 %7.1f us  p99 %7.1f us  spin %.1f%%  hits %llu  misses %llu\n",
+           busy ? "busy" : "blocking", latencies[kSamples / 2] / 1e3,
+           latencies[kSamples * 99 / 100] / 1e3, stats.spinFraction() * 100,
+           static_cast<unsigned long long>(stats.spinHits.load()),
+           static_cast<unsigned long long>(stats.spinMisses.load()));
+    if (busy) {
+      EXPECT_GT(stats.spinHits.load() + stats.spinMisses.load(), 0u);
+    } else {
+      EXPECT_EQ(stats.spinNanos.load(), 0u);
+    }
+  }
+}
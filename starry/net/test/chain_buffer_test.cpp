@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <string>
+#include "chain_buffer.h"
+
+using namespace starry;
+
+class ChainBufferTest : public ::testing::Test {
+ protected:
+  ChainBuffer buffer_;
+};
+
+// 1. 跨分段追加和读取
+TEST_F(ChainBufferTest, AppendAcrossSegments) {
+  std::string str(ChainBuffer::kSegmentSize * 2 + 100, 'x');
+  buffer_.append(str);
+  EXPECT_EQ(buffer_.readableBytes(), str.size());
+  EXPECT_EQ(buffer_.segmentCount(), 3);
+
+  buffer_.append("tail");
+  EXPECT_EQ(buffer_.segmentCount(), 3);
+  EXPECT_EQ(buffer_.retrieveAllAsString(), str + "tail");
+  EXPECT_EQ(buffer_.segmentCount(), 0);
+}
+
+// 2. 部分取出不搬移数据，读完的分段被释放
+TEST_F(ChainBufferTest, PartialRetrieve) {
+  std::string str(ChainBuffer::kSegmentSize + 10, 'a');
+  buffer_.append(str);
+  buffer_.append("bcd");
+  buffer_.retrieve(ChainBuffer::kSegmentSize + 5);
+  EXPECT_EQ(buffer_.segmentCount(), 1);
+  EXPECT_EQ(buffer_.retrieveAllAsString(), "aaaaabcd");
+}
+
+// 3. writev 写出多个分段
+TEST_F(ChainBufferTest, WriteFd) {
+  int fds[2];
+  ASSERT_EQ(::pipe2(fds, O_NONBLOCK), 0);
+  std::string str;
+  for (size_t i = 0; i < ChainBuffer::kSegmentSize * 3; ++i) {
+    str.push_back(static_cast<char>('a' + i % 26));
+  }
+  buffer_.append(str);
+
+  std::string received;
+  char buf[4096];
+  while (buffer_.readableBytes() > 0) {
+    int savedErrno = 0;
+    ssize_t n = buffer_.writeFd(fds[1], &savedErrno);
+    ASSERT_TRUE(n > 0 || savedErrno == EAGAIN);
+    ssize_t r;
+    while ((r = ::read(fds[0], buf, sizeof(buf))) > 0) {
+      received.append(buf, r);
+    }
+  }
+  EXPECT_EQ(received, str);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+// 4. 大切片直接挂到链上，小切片拷进尾段
+TEST_F(ChainBufferTest, AppendSlice) {
+  std::string big(ChainBuffer::kMinSliceSize * 4, 'b');
+  BufferSlice slice = BufferSlice::copyOf(big);
+  buffer_.append("head");
+  buffer_.append(slice);
+  buffer_.append(BufferSlice::copyOf("tail"));
+  EXPECT_EQ(buffer_.segmentCount(), 3);
+  EXPECT_EQ(buffer_.readableBytes(), 4 + big.size() + 4);
+
+  struct iovec vec[4];
+  ASSERT_EQ(buffer_.fillIovec(vec, 4), 3);
+  EXPECT_EQ(vec[1].iov_base, slice.data());
+
+  buffer_.retrieve(10);
+  EXPECT_EQ(buffer_.retrieveAllAsString(), big.substr(6) + "tail");
+}
+
+// 5. 限制写出的字节数，文件之前的数据只写到文件为止
+TEST_F(ChainBufferTest, WriteFdLimited) {
+  int fds[2];
+  ASSERT_EQ(::pipe2(fds, O_NONBLOCK), 0);
+  std::string str(ChainBuffer::kSegmentSize + 500, 'w');
+  buffer_.append(str);
+  int savedErrno = 0;
+  EXPECT_EQ(buffer_.writeFd(fds[1], &savedErrno, ChainBuffer::kSegmentSize + 7),
+            static_cast<ssize_t>(ChainBuffer::kSegmentSize + 7));
+  EXPECT_EQ(buffer_.readableBytes(), 493);
+  EXPECT_EQ(buffer_.writeFd(fds[1], &savedErrno, 100), 100);
+  EXPECT_EQ(buffer_.readableBytes(), 393);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
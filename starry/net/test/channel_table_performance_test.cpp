@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "channel.h"
+#include "channel_table.h"
+#include "eventloop.h"
+#include "inet_address.h"
+#include "tcp_connection.h"
+#include "tcp_server.h"
+
+using namespace starry;
+
+namespace {
+
+const int kChurnCycles = 1000000;
+
+double elapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// 尽量调高 fd 上限，返回可以同时打开的 fd 数
+size_t raiseFdLimit() {
+  struct rlimit limit;
+  ::getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  ::setrlimit(RLIMIT_NOFILE, &limit);
+  ::getrlimit(RLIMIT_NOFILE, &limit);
+  return static_cast<size_t>(limit.rlim_cur);
+}
+
+// 只用来当作表里的值，不会被解引用
+Channel* fakeChannel(int fd) {
+  return reinterpret_cast<Channel*>(static_cast<uintptr_t>(fd + 1) * 64);
+}
+
+}  // namespace
+
+class ChannelTablePerformanceTest : public ::testing::Test {};
+
+// 1. 纯数据结构：10 万个常驻 fd 下反复注册、查找、移除，对比 std::map
+TEST_F(ChannelTablePerformanceTest, TableVersusMap) {
+  const int kLive = 100000;
+  ChannelTable table;
+  std::map<int, Channel*> map;
+  for (int fd = 0; fd < kLive; ++fd) {
+    table.insert(fd, fakeChannel(fd), 1);
+    map[fd] = fakeChannel(fd);
+  }
+
+  // 每次关掉一个 fd 再打开，新 fd 落在同一个位置上
+  uint64_t seed = 88172645463325252ull;
+  auto nextFd = [&seed] {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return static_cast<int>(seed % kLive);
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  size_t hits = 0;
+  for (int i = 0; i < kChurnCycles; ++i) {
+    int fd = nextFd();
+    hits += table.channel(fd) == fakeChannel(fd);
+    table.erase(fd);
+    table.insert(fd, fakeChannel(fd), 1);
+    hits += table.find(fd)->state == 1;
+  }
+  double tableMs = elapsedMs(start);
+
+  seed = 88172645463325252ull;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kChurnCycles; ++i) {
+    int fd = nextFd();
+    hits += map.find(fd)->second == fakeChannel(fd);
+    map.erase(fd);
+    map[fd] = fakeChannel(fd);
+    hits += map.find(fd) != map.end();
+  }
+  double mapMs = elapsedMs(start);
+
+  printf("%d churn cycles over %d fds: table %.1f ms  map %.1f ms\n",
+         kChurnCycles, kLive, tableMs, mapMs);
+  EXPECT_EQ(hits, 4u * kChurnCycles);
+  EXPECT_EQ(table.size(), static_cast<size_t>(kLive));
+  EXPECT_EQ(table.channel(kLive), nullptr);
+}
+
+// 2. 经过 poller：在大量常驻 fd 之上打开、注册、注销、关闭 100 万次
+TEST_F(ChannelTablePerformanceTest, PollerChurn) {
+  const size_t limit = raiseFdLimit();
+  const size_t live = std::min<size_t>(100000, limit > 256 ? limit - 256 : 0);
+  EventLoop loop;
+  std::vector<int> fds;
+  std::vector<std::unique_ptr<Channel>> channels;
+  for (size_t i = 0; i < live; ++i) {
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ASSERT_GE(fd, 0);
+    fds.push_back(fd);
+    channels.emplace_back(new Channel(&loop, fd));
+    channels.back()->enableReading();
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kChurnCycles; ++i) {
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    Channel channel(&loop, fd);
+    channel.enableReading();
+    EXPECT_TRUE(loop.hasChannel(&channel));
+    channel.disableAll();
+    channel.remove();
+    ::close(fd);
+  }
+  double churnMs = elapsedMs(start);
+  printf("%s: %d open/register/remove/close cycles over %zu live fds: "
+         "%.1f ms (%.0f ns/cycle)\n",
+         loop.pollerName(), kChurnCycles, live, churnMs,
+         churnMs * 1e6 / kChurnCycles);
+
+  for (size_t i = 0; i < live; ++i) {
+    channels[i]->disableAll();
+    channels[i]->remove();
+    ::close(fds[i]);
+  }
+}
+
+// 3. 真实的 accept/close：服务端建立后立即关闭，客户端等到 EOF 再关闭
+// 默认 2 万个连接，设置 STARRY_CHURN_CONNECTIONS=1000000 跑完整的 100 万个
+TEST_F(ChannelTablePerformanceTest, AcceptCloseChurn) {
+  int connections = 20000;
+  if (const char* env = ::getenv("STARRY_CHURN_CONNECTIONS")) {
+    connections = std::atoi(env);
+  }
+  EventLoop loop;
+  InetAddress addr(19878, true);
+  TcpServer server(&loop, addr, "churn");
+  std::atomic<int> accepted(0);
+  std::atomic<int> closed(0);
+  // 服务端主动关闭，TIME_WAIT 留在服务端，客户端的临时端口可以马上复用
+  server.setConnectionCallback([&](const TcpConnectionPtr& conn) {
+    if (conn->connected()) {
+      accepted.fetch_add(1, std::memory_order_relaxed);
+      conn->forceClose();
+    } else {
+      closed.fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+  server.start();
+
+  auto start = std::chrono::steady_clock::now();
+  std::thread client([&] {
+    sockaddr_in serverAddr = {};
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(19878);
+    serverAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int i = 0; i < connections; ++i) {
+      int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (::connect(fd, reinterpret_cast<sockaddr*>(&serverAddr),
+                    sizeof(serverAddr)) == 0) {
+        char c;
+        while (::read(fd, &c, 1) > 0) {
+        }
+      }
+      ::close(fd);
+    }
+    while (closed.load(std::memory_order_relaxed) < connections) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    loop.quit();
+  });
+  loop.loop();
+  client.join();
+  double churnMs = elapsedMs(start);
+
+  printf("%s: %d accept/close: %.1f ms (%.1f us/connection)\n",
+         loop.pollerName(), connections, churnMs,
+         churnMs * 1e3 / connections);
+  EXPECT_EQ(accepted.load(), connections);
+  EXPECT_EQ(closed.load(), connections);
+}
@@ -0,0 +1,244 @@
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "eventloop.h"
+#include "eventloop_thread.h"
+#include "inet_address.h"
+#include "loop_selector.h"
+#include "tcp_connection.h"
+#include "tcp_server.h"
+
+using namespace starry;
+
+namespace {
+
+// 在 loop 线程执行 cb 并等它完成
+void runAndWait(EventLoop* loop, EventLoop::Functor cb) {
+  std::atomic<bool> done(false);
+  loop->queueInLoop([&cb, &done] {
+    cb();
+    done = true;
+  });
+  while (!done) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+// 阻塞式连接到本机端口，返回 fd
+int connectTo(uint16_t port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) !=
+      0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// 第 i 个字节的内容，周期和分段大小互质，错位或丢字节都能发现
+char patternAt(size_t i) {
+  return static_cast<char>('a' + i % 251 % 26);
+}
+
+// 回显服务器：在 loop 线程直接回写，或者交给另一个线程跨线程回写
+class EchoServer {
+ public:
+  EchoServer(EventLoop* baseLoop,
+             uint16_t port,
+             bool edgeTriggered,
+             bool crossThread)
+      : baseLoop_(baseLoop), senderLoop_(sender_.startLoop()) {
+    runAndWait(baseLoop_, [&] {
+      server_.reset(new TcpServer(baseLoop_, InetAddress(port, true), "mig"));
+      server_->setThreadNum(2);
+      server_->setEdgeTriggered(edgeTriggered);
+      server_->setConnectionCallback([this](const TcpConnectionPtr& conn) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (conn->connected()) {
+          conns_.push_back(conn);
+        }
+      });
+      server_->setMessageCallback(
+          [this, crossThread](const TcpConnectionPtr& conn, Buffer* buf,
+                              Timestamp) {
+            if (crossThread) {
+              std::string data = buf->retrieveAllAsString();
+              senderLoop_->queueInLoop([conn, data] { conn->send(data); });
+            } else {
+              conn->send(buf);
+            }
+          });
+      server_->start();
+    });
+  }
+
+  ~EchoServer() {
+    runAndWait(baseLoop_, [&] { server_.reset(); });
+  }
+
+  TcpServer* server() { return server_.get(); }
+  std::vector<TcpConnectionPtr> connections() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return conns_;
+  }
+
+ private:
+  EventLoop* baseLoop_;
+  EventLoopThread sender_;  // 跨线程回写的线程
+  EventLoop* senderLoop_;
+  std::unique_ptr<TcpServer> server_;
+  std::mutex mutex_;
+  std::vector<TcpConnectionPtr> conns_;
+};
+
+// 客户端边发边收，同时不断把连接在两个 IO 线程之间迁移，回显的数据要和发出的一致
+void runMigratingEcho(uint16_t port, bool edgeTriggered, bool crossThread) {
+  EventLoopThread baseThread;
+  EventLoop* baseLoop = baseThread.startLoop();
+  EchoServer echo(baseLoop, port, edgeTriggered, crossThread);
+  int fd = connectTo(port);
+  ASSERT_GE(fd, 0);
+  while (echo.connections().empty()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  TcpConnectionPtr conn = echo.connections()[0];
+  std::vector<EventLoop*> loops;
+  runAndWait(baseLoop,
+             [&] { loops = echo.server()->threadPool()->getAllLoops(); });
+
+  const size_t kTotal = 8 << 20;
+  std::thread writer([fd, kTotal] {
+    std::string chunk;
+    for (size_t sent = 0; sent < kTotal;) {
+      chunk.clear();
+      for (size_t i = 0; i < 4093 && sent + i < kTotal; ++i) {
+        chunk.push_back(patternAt(sent + i));
+      }
+      ssize_t n = ::write(fd, chunk.data(), chunk.size());
+      ASSERT_GT(n, 0);
+      sent += static_cast<size_t>(n);
+    }
+  });
+
+  std::atomic<bool> stop(false);
+  std::atomic<int> migrated(0);
+  std::thread migrator([&] {
+    for (int i = 0; !stop; ++i) {
+      conn->migrateTo(loops[i % 2], [&](const TcpConnectionPtr& c, bool ok) {
+        if (ok) {
+          EXPECT_TRUE(c->getLoop()->isInLoopThread());
+          ++migrated;
+        }
+      });
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+  });
+
+  size_t received = 0;
+  size_t mismatch = kTotal;
+  char buf[65536];
+  while (received < kTotal) {
+    ssize_t n = ::read(fd, buf, sizeof(buf));
+    ASSERT_GT(n, 0);
+    for (ssize_t i = 0; i < n && mismatch == kTotal; ++i) {
+      if (buf[i] != patternAt(received + i)) {
+        mismatch = received + i;
+      }
+    }
+    received += static_cast<size_t>(n);
+  }
+  stop = true;
+  migrator.join();
+  writer.join();
+  EXPECT_EQ(mismatch, kTotal);
+  EXPECT_EQ(received, kTotal);
+  EXPECT_GT(migrated.load(), 10);
+  printf("migrated %d times\n", migrated.load());
+  ::close(fd);
+}
+
+}  // namespace
+
+class ConnectionMigrationTest : public ::testing::Test {};
+
+// 1. 水平触发，在 loop 线程回写：迁移期间字节不丢、不乱序，回调都在新 loop 里
+TEST_F(ConnectionMigrationTest, StreamSurvivesMigration) {
+  runMigratingEcho(19880, false, false);
+}
+
+// 2. 边缘触发，跨线程回写：新 loop 注册时内核里已有的数据也要能读到，
+// 迁移前在旧 loop 排队的发送不能被之后的发送超过
+TEST_F(ConnectionMigrationTest, EdgeTriggeredCrossThreadSend) {
+  runMigratingEcho(19881, true, true);
+}
+
+// 3. 两个连接挤在同一个忙碌的线程上，负载均衡把其中一个迁走
+TEST_F(ConnectionMigrationTest, RebalanceMovesHotConnection) {
+  EventLoopThread baseThread;
+  EventLoop* baseLoop = baseThread.startLoop();
+  const uint16_t kPort = 19882;
+  std::unique_ptr<TcpServer> server;
+  runAndWait(baseLoop, [&] {
+    server.reset(new TcpServer(baseLoop, InetAddress(kPort, true), "rebal"));
+    server->setThreadNum(2);
+    // 同一个 IP 落在同一个线程
+    server->setLoopSelector(LoopSelector::newHash());
+    server->setRebalance(0.05, 0.5, 0.3);
+    // 每条消息忙 2ms，让所在的线程一直很忙
+    server->setMessageCallback(
+        [](const TcpConnectionPtr&, Buffer* buf, Timestamp) {
+          buf->retrieveAll();
+          auto until =
+              std::chrono::steady_clock::now() + std::chrono::milliseconds(2);
+          while (std::chrono::steady_clock::now() < until) {
+          }
+        });
+    server->start();
+  });
+
+  std::vector<int> clients{connectTo(kPort), connectTo(kPort)};
+  ASSERT_GE(clients[0], 0);
+  ASSERT_GE(clients[1], 0);
+  std::atomic<bool> stop(false);
+  std::thread writer([&] {
+    while (!stop) {
+      for (int fd : clients) {
+        ::write(fd, "x", 1);
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+  });
+
+  std::vector<int> counts;
+  for (int i = 0; i < 3000; ++i) {
+    runAndWait(baseLoop,
+               [&] { counts = server->threadPool()->connectionCounts(); });
+    if (counts == std::vector<int>{1, 1}) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  stop = true;
+  writer.join();
+  EXPECT_EQ(counts, (std::vector<int>{1, 1}));
+  EXPECT_GE(server->migrations(), 1u);
+
+  for (int fd : clients) {
+    ::close(fd);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  runAndWait(baseLoop, [&] { server.reset(); });
+}
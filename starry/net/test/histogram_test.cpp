@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include "channel.h"
+#include "eventloop.h"
+#include "eventloop_thread.h"
+#include "histogram.h"
+
+using namespace starry;
+
+class HistogramTest : public ::testing::Test {};
+
+// 1. 桶连续覆盖整个 uint64 范围，分位数的相对误差不超过 1/8
+TEST_F(HistogramTest, BucketsAndPercentiles) {
+  using Snapshot = HistogramSnapshot;
+  for (int i = 1; i < Snapshot::kBuckets; ++i) {
+    ASSERT_EQ(Snapshot::bucketLowerBound(i),
+              Snapshot::bucketUpperBound(i - 1) + 1);
+  }
+  EXPECT_EQ(Snapshot::bucketUpperBound(Snapshot::kBuckets - 1), UINT64_MAX);
+  for (uint64_t v : {uint64_t{0}, uint64_t{7}, uint64_t{8}, uint64_t{1000},
+                     uint64_t{123456789}, UINT64_MAX}) {
+    int index = Snapshot::bucketIndex(v);
+    EXPECT_LE(Snapshot::bucketLowerBound(index), v);
+    EXPECT_GE(Snapshot::bucketUpperBound(index), v);
+  }
+
+  Histogram histogram;
+  for (uint64_t v = 1; v <= 10000; ++v) {
+    histogram.record(v);
+  }
+  HistogramSnapshot snap = histogram.snapshot();
+  EXPECT_EQ(snap.count, 10000u);
+  EXPECT_EQ(snap.max, 10000u);
+  EXPECT_DOUBLE_EQ(snap.mean(), 5000.5);
+  for (double p : {0.5, 0.9, 0.99}) {
+    double exact = p * 10000;
+    EXPECT_GE(static_cast<double>(snap.percentile(p)), exact);
+    EXPECT_LE(static_cast<double>(snap.percentile(p)), exact * 1.125 + 1);
+  }
+  EXPECT_EQ(snap.percentile(1.0), 10000u);
+}
+
+// 2. 记录的同时在另一个线程取快照，计数只增不减
+TEST_F(HistogramTest, ConcurrentSnapshot) {
+  Histogram histogram;
+  std::atomic<bool> done(false);
+  const uint64_t kRecords = 2000000;
+  std::thread writer([&] {
+    for (uint64_t i = 0; i < kRecords; ++i) {
+      histogram.record(i & 0xffff);
+    }
+    done = true;
+  });
+  uint64_t last = 0;
+  int snapshots = 0;
+  while (!done) {
+    HistogramSnapshot snap = histogram.snapshot();
+    EXPECT_GE(snap.count, last);
+    last = snap.count;
+    ++snapshots;
+  }
+  writer.join();
+  EXPECT_EQ(histogram.snapshot().count, kRecords);
+  EXPECT_GT(snapshots, 0);
+}
+
+// 3. loop 的分布：事件、待处理函数和定时器都有记录，可以在其他线程读取
+TEST_F(HistogramTest, LoopMetrics) {
+  EventLoopThread thread;
+  EventLoop* loop = thread.startLoop();
+  int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ASSERT_GE(fd, 0);
+  std::atomic<int> reads(0);
+  Channel channel(loop, fd);
+  channel.setReadCallback([&](Timestamp) {
+    uint64_t value;
+    ::read(fd, &value, sizeof(value));
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+    reads.fetch_add(1);
+  });
+  loop->runInLoop([&] { channel.enableReading(); });
+
+  std::atomic<int> timers(0);
+  loop->runAfter(0.001, [&] { timers.fetch_add(1); });
+  for (int i = 0; i < 20; ++i) {
+    uint64_t one = 1;
+    ASSERT_EQ(::write(fd, &one, sizeof(one)), 8);
+    loop->queueInLoop([] {});
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  while (reads.load() == 0 || timers.load() == 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  LoopMetrics::Snapshot snap = loop->metrics().snapshot();
+  printf("%s", snap.toString().c_str());
+  EXPECT_GT(snap.pollNanos.count, 0u);
+  EXPECT_GT(snap.eventsPerIteration.max, 0u);
+  EXPECT_GE(snap.handlerNanos.max, 200000u);
+  EXPECT_GT(snap.pendingFunctors.max, 0u);
+  EXPECT_GT(snap.functorNanos.count, 0u);
+  EXPECT_EQ(snap.timerNanos.count, 1u);
+  // 快照不是同一时刻的，loop 可能正处在两次记录之间
+  EXPECT_LE(snap.pollNanos.count - snap.iterationNanos.count, 1u);
+
+  loop->runInLoop([&] {
+    channel.disableAll();
+    channel.remove();
+  });
+  std::atomic<bool> removed(false);
+  loop->queueInLoop([&] { removed = true; });
+  while (!removed) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ::close(fd);
+}
@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include "eventloop.h"
+#include "inline_function.h"
+
+using namespace starry;
+
+namespace {
+
+// 统计本线程的堆分配次数
+thread_local size_t t_allocations = 0;
+
+}  // namespace
+
+void* operator new(size_t size) {
+  ++t_allocations;
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+class InlineFunctionTest : public ::testing::Test {};
+
+// 1. [conn, msg] 这样的 lambda 内联存放，构造和移动都不分配内存
+TEST_F(InlineFunctionTest, SmallLambdaInline) {
+  auto conn = std::make_shared<int>(42);
+  std::string msg = "hello";
+  int result = 0;
+
+  size_t before = t_allocations;
+  InlineFunction<void()> f = [conn, msg, &result] {
+    result = *conn + static_cast<int>(msg.size());
+  };
+  InlineFunction<void()> g = std::move(f);
+  EXPECT_EQ(t_allocations, before);
+
+  EXPECT_FALSE(f);
+  EXPECT_TRUE(g);
+  EXPECT_FALSE(g.onHeap());
+  g();
+  EXPECT_EQ(result, 47);
+  EXPECT_EQ(conn.use_count(), 2);
+  g = nullptr;
+  EXPECT_EQ(conn.use_count(), 1);
+}
+
+// 2. 超过内联大小的放到堆上，移动后只析构一次
+TEST_F(InlineFunctionTest, LargeLambdaOnHeap) {
+  auto conn = std::make_shared<int>(1);
+  char padding[128] = {};
+  {
+    InlineFunction<int(int)> f = [conn, padding](int x) {
+      return x + *conn + padding[0];
+    };
+    EXPECT_TRUE(f.onHeap());
+    InlineFunction<int(int)> g = std::move(f);
+    EXPECT_EQ(g(2), 3);
+    EXPECT_EQ(conn.use_count(), 2);
+  }
+  EXPECT_EQ(conn.use_count(), 1);
+
+  std::function<void()> empty;
+  InlineFunction<void()> h = empty;
+  EXPECT_FALSE(h);
+}
+
+// 3. 其他线程 queueInLoop 一个 [conn, msg] lambda 不分配内存
+TEST_F(InlineFunctionTest, QueueInLoopNoAllocation) {
+  EventLoop loop;
+  auto conn = std::make_shared<int>(0);
+  std::string msg = "ping";  // const 成员的移动会退化为可能抛异常的复制，不能内联
+  const int kPosts = 512;
+  std::atomic<int> executed(0);
+  size_t allocations = 0;
+  size_t stdFunctionAllocations = 0;
+
+  std::thread producer([&] {
+    size_t before = t_allocations;
+    for (int i = 0; i < kPosts; ++i) {
+      loop.queueInLoop([conn, msg, &executed] {
+        if (*conn == 0 && msg.size() == 4) {
+          executed.fetch_add(1);
+        }
+      });
+    }
+    allocations = t_allocations - before;
+
+    // 对比：同样的 lambda 放进 std::function
+    before = t_allocations;
+    for (int i = 0; i < kPosts; ++i) {
+      std::function<void()> f = [conn, msg, &executed] { executed.load(); };
+    }
+    stdFunctionAllocations = t_allocations - before;
+    loop.queueInLoop([&] { loop.quit(); });
+  });
+  loop.loop();
+  producer.join();
+
+  printf("allocations per post: InlineFunction %.2f  std::function %.2f\n",
+         static_cast<double>(allocations) / kPosts,
+         static_cast<double>(stdFunctionAllocations) / kPosts);
+  EXPECT_EQ(allocations, 0u);
+  EXPECT_EQ(executed.load(), kPosts);
+}
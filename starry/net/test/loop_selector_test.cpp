@@ -0,0 +1,234 @@
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "eventloop.h"
+#include "eventloop_thread.h"
+#include "inet_address.h"
+#include "loop_selector.h"
+#include "tcp_server.h"
+#include "thread_placement.h"
+
+using namespace starry;
+
+namespace {
+
+// 在 loop 线程执行 cb 并等它完成
+void runAndWait(EventLoop* loop, EventLoop::Functor cb) {
+  std::atomic<bool> done(false);
+  loop->queueInLoop([&cb, &done] {
+    cb();
+    done = true;
+  });
+  while (!done) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+// 阻塞式连接到本机端口，返回 fd
+int connectTo(uint16_t port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) !=
+      0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// 等到 cond 成立，最多 2 秒
+template <typename Cond>
+bool waitFor(Cond cond) {
+  for (int i = 0; i < 2000 && !cond(); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return cond();
+}
+
+}  // namespace
+
+class LoopSelectorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (int i = 0; i < 3; ++i) {
+      threads_.emplace_back(new EventLoopThread());
+      loops_.push_back(threads_.back()->startLoop());
+    }
+  }
+
+  std::vector<std::unique_ptr<EventLoopThread>> threads_;
+  std::vector<EventLoop*> loops_;
+};
+
+// 1. 轮询和哈希
+TEST_F(LoopSelectorTest, RoundRobinAndHash) {
+  auto roundRobin = LoopSelector::newRoundRobin();
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(roundRobin->select(loops_, 0), loops_[i % 3]);
+  }
+  auto hash = LoopSelector::newHash();
+  EXPECT_EQ(hash->select(loops_, 7), loops_[1]);
+  EXPECT_EQ(hash->select(loops_, 7), loops_[1]);
+  // 只有按哈希选择时才需要调用者计算哈希
+  EXPECT_FALSE(roundRobin->needsHash());
+  EXPECT_TRUE(hash->needsHash());
+}
+
+// 2. 连接数最少；相同时轮流，不会都落在第一个上
+TEST_F(LoopSelectorTest, LeastConnections) {
+  auto selector = LoopSelector::newLeastConnections();
+  std::vector<int> picks(3, 0);
+  for (int i = 0; i < 6; ++i) {
+    EventLoop* loop = selector->select(loops_, 0);
+    loop->addConnection();
+    ++picks[std::find(loops_.begin(), loops_.end(), loop) - loops_.begin()];
+  }
+  EXPECT_EQ(picks, (std::vector<int>{2, 2, 2}));
+
+  loops_[0]->removeConnection();
+  EXPECT_EQ(selector->select(loops_, 0), loops_[0]);
+  for (EventLoop* loop : loops_) {
+    while (loop->connectionCount() > 0) {
+      loop->removeConnection();
+    }
+  }
+}
+
+// 3. 待处理函数堆积的 loop 不会被选中
+TEST_F(LoopSelectorTest, LeastQueue) {
+  std::atomic<bool> release(false);
+  loops_[0]->queueInLoop([&release] {
+    while (!release) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+  for (int i = 0; i < 10; ++i) {
+    loops_[0]->queueInLoop([] {});
+  }
+  auto selector = LoopSelector::newLeastQueue();
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_NE(selector->select(loops_, 0), loops_[0]);
+  }
+  release = true;
+  runAndWait(loops_[0], [] {});
+}
+
+// 4. 卡在慢回调里的 loop 忙碌占比上升，两选一时不会被选中；空闲之后回落
+TEST_F(LoopSelectorTest, PowerOfTwoChoices) {
+  std::vector<EventLoop*> two{loops_[0], loops_[1]};
+  std::atomic<bool> release(false);
+  loops_[0]->queueInLoop([&release] {
+    while (!release) {
+    }
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  EXPECT_GT(loops_[0]->busyRatio(), 0.8);
+  EXPECT_LT(loops_[1]->busyRatio(), 0.2);
+  auto selector = LoopSelector::newPowerOfTwoChoices();
+  for (int i = 0; i < 20; ++i) {
+    EXPECT_EQ(selector->select(two, 0), loops_[1]);
+  }
+  release = true;
+  runAndWait(loops_[0], [] {});
+  std::this_thread::sleep_for(std::chrono::milliseconds(400));
+  EXPECT_LT(loops_[0]->busyRatio(), 0.1);
+}
+
+// 5. TcpServer 按 selector 分配连接，每个 loop 的连接数可以读出来
+TEST_F(LoopSelectorTest, ServerConnectionCounts) {
+  EventLoop* baseLoop = loops_[0];
+  const uint16_t kPort = 19879;
+  std::unique_ptr<TcpServer> server;
+  runAndWait(baseLoop, [&] {
+    server.reset(new TcpServer(baseLoop, InetAddress(kPort, true), "counts"));
+    server->setThreadNum(2);
+    server->setLoopSelector(LoopSelector::newLeastConnections());
+    server->start();
+  });
+
+  std::vector<int> clients;
+  for (int i = 0; i < 4; ++i) {
+    clients.push_back(connectTo(kPort));
+    ASSERT_GE(clients.back(), 0);
+    // 等这个连接分配完再发起下一个
+    ASSERT_TRUE(waitFor([&] {
+      std::vector<int> counts;
+      runAndWait(baseLoop,
+                 [&] { counts = server->threadPool()->connectionCounts(); });
+      return counts[0] + counts[1] == i + 1;
+    }));
+  }
+  std::vector<int> counts;
+  runAndWait(baseLoop, [&] { counts = server->threadPool()->connectionCounts(); });
+  EXPECT_EQ(counts, (std::vector<int>{2, 2}));
+
+  for (int fd : clients) {
+    ::close(fd);
+  }
+  EXPECT_TRUE(waitFor([&] {
+    runAndWait(baseLoop,
+               [&] { counts = server->threadPool()->connectionCounts(); });
+    return counts[0] + counts[1] == 0;
+  }));
+  runAndWait(baseLoop, [&] { server.reset(); });
+}
+
+// 6. 按收包 CPU 分配：客户端和 IO 线程绑在同一个 CPU 上，连接都交给绑核的线程；
+// 没有绑核时回落到 selector
+TEST_F(LoopSelectorTest, IncomingCpuPlacement) {
+  EventLoop* baseLoop = loops_[0];
+  const int cpu = CpuTopology::load().cpus.back().id;
+  const uint16_t kPorts[] = {19883, 19884};
+  for (bool pinned : {true, false}) {
+    const uint16_t port = kPorts[pinned ? 0 : 1];
+    std::unique_ptr<TcpServer> server;
+    runAndWait(baseLoop, [&] {
+      server.reset(new TcpServer(baseLoop, InetAddress(port, true), "incoming"));
+      server->setThreadNum(2);
+      if (pinned) {
+        server->setThreadPlacement(ThreadPlacement::cpuList({cpu}));
+      }
+      server->setIncomingCpuPlacement(true);
+      server->start();
+    });
+
+    // 回环上的收包在发送方所在的 CPU 上处理
+    std::vector<int> clients;
+    std::thread client([&] {
+      ThreadPlacement::apply(ThreadPlacement::Slot{{cpu}, -1});
+      for (int i = 0; i < 2; ++i) {
+        clients.push_back(connectTo(port));
+      }
+    });
+    client.join();
+    std::vector<int> counts;
+    EXPECT_TRUE(waitFor([&] {
+      runAndWait(baseLoop,
+                 [&] { counts = server->threadPool()->connectionCounts(); });
+      return counts[0] + counts[1] == 2;
+    }));
+    EXPECT_EQ(server->incomingCpuMatches(), pinned ? 2u : 0u);
+
+    for (int fd : clients) {
+      ::close(fd);
+    }
+    EXPECT_TRUE(waitFor([&] {
+      runAndWait(baseLoop,
+                 [&] { counts = server->threadPool()->connectionCounts(); });
+      return counts[0] + counts[1] == 0;
+    }));
+    runAndWait(baseLoop, [&] { server.reset(); });
+  }
+}
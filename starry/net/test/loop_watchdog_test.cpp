@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "channel.h"
+#include "eventloop.h"
+#include "eventloop_thread.h"
+#include "loop_watchdog.h"
+
+using namespace starry;
+
+namespace {
+
+// 在 loop 线程执行 cb 并等它完成
+void runAndWait(EventLoop* loop, EventLoop::Functor cb) {
+  std::atomic<bool> done(false);
+  loop->queueInLoop([&cb, &done] {
+    cb();
+    done = true;
+  });
+  while (!done) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+struct SlowTask {
+  void operator()() const {
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  }
+};
+
+}  // namespace
+
+class LoopWatchdogTest : public ::testing::Test {};
+
+// 1. 卡在待处理函数里：报告函数类型；限速期间的第二次只计数，回调照常调用
+TEST_F(LoopWatchdogTest, FunctorStall) {
+  EventLoopThread thread;
+  EventLoop* loop = thread.startLoop();
+  LoopWatchdog watchdog(0.05);
+  std::mutex mutex;
+  std::vector<LoopWatchdog::Stall> stalls;
+  watchdog.setStallCallback([&](const LoopWatchdog::Stall& stall) {
+    std::lock_guard<std::mutex> lock(mutex);
+    stalls.push_back(stall);
+  });
+  watchdog.watch(loop);
+  watchdog.start();
+
+  runAndWait(loop, SlowTask());
+  runAndWait(loop, SlowTask());
+  watchdog.stop();
+  watchdog.unwatch(loop);
+
+  EXPECT_EQ(watchdog.stalls(), 2u);
+  EXPECT_EQ(watchdog.reports(), 1u);
+  ASSERT_EQ(stalls.size(), 2u);
+  EXPECT_EQ(stalls[0].loop, loop);
+  EXPECT_EQ(stalls[0].activity, EventLoop::Activity::kRunningFunctors);
+  EXPECT_EQ(stalls[0].fd, -1);
+  EXPECT_NE(stalls[0].callback.find("runAndWait"), std::string::npos)
+      << stalls[0].callback;
+  EXPECT_GE(stalls[0].seconds, 0.05);
+}
+
+// 2. 卡在 channel 的事件回调里：报告 fd
+TEST_F(LoopWatchdogTest, ChannelStall) {
+  EventLoopThread thread;
+  EventLoop* loop = thread.startLoop();
+  int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ASSERT_GE(fd, 0);
+  std::atomic<bool> handled(false);
+  Channel channel(loop, fd);
+  channel.setReadCallback([&](Timestamp) {
+    uint64_t value;
+    ::read(fd, &value, sizeof(value));
+    SlowTask()();
+    handled = true;
+  });
+  runAndWait(loop, [&] { channel.enableReading(); });
+
+  LoopWatchdog watchdog(0.05);
+  std::atomic<int> stalledFd(-2);
+  watchdog.setStallCallback(
+      [&](const LoopWatchdog::Stall& stall) { stalledFd = stall.fd; });
+  watchdog.watch(loop);
+  watchdog.start();
+  uint64_t one = 1;
+  ASSERT_EQ(::write(fd, &one, sizeof(one)), 8);
+  while (!handled) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  watchdog.stop();
+  watchdog.unwatch(loop);
+
+  EXPECT_EQ(watchdog.stalls(), 1u);
+  EXPECT_EQ(stalledFd.load(), fd);
+  runAndWait(loop, [&] {
+    channel.disableAll();
+    channel.remove();
+  });
+  ::close(fd);
+}
+
+// 3. 空闲的 loop 阻塞在 poll 里，不算卡住
+TEST_F(LoopWatchdogTest, IdleIsNotStall) {
+  EventLoopThread thread;
+  EventLoop* loop = thread.startLoop();
+  LoopWatchdog watchdog(0.02);
+  watchdog.watch(loop);
+  watchdog.start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  watchdog.stop();
+  watchdog.unwatch(loop);
+  EXPECT_EQ(watchdog.stalls(), 0u);
+  EXPECT_EQ(loop->progress().activity, EventLoop::Activity::kPolling);
+}
@@ -0,0 +1,284 @@
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include "buffer.h"
+#include "channel.h"
+#include "eventloop.h"
+#include "eventloop_thread.h"
+#include "inet_address.h"
+#include "io_uring_poller.h"
+#include "tcp_client.h"
+#include "tcp_connection.h"
+#include "tcp_server.h"
+
+using namespace starry;
+
+// 每个用例分别在 epoll 和 io_uring 上运行
+class PollerTest : public ::testing::TestWithParam<const char*> {
+ protected:
+  void SetUp() override { ::setenv("STARRY_POLLER", GetParam(), 1); }
+  void TearDown() override { ::unsetenv("STARRY_POLLER"); }
+
+  // io_uring 不可用时会退回 epoll
+  bool backendAvailable(const EventLoop& loop) const {
+    return ::strcmp(loop.pollerName(), GetParam()) == 0;
+  }
+};
+
+// 1. 水平触发：每次只读一个字节，剩下的数据在后续轮次继续触发
+TEST_P(PollerTest, LevelTriggeredRead) {
+  EventLoop loop;
+  if (!backendAvailable(loop)) {
+    GTEST_SKIP() << GetParam() << " is not available";
+  }
+  int fds[2];
+  ASSERT_EQ(::pipe(fds), 0);
+  Channel channel(&loop, fds[0]);
+  std::string received;
+  channel.setReadCallback([&](Timestamp) {
+    char c;
+    if (::read(fds[0], &c, 1) == 1) {
+      received.push_back(c);
+    }
+    if (received.size() == 5) {
+      channel.disableAll();
+      channel.remove();
+      loop.quit();
+    }
+  });
+  channel.enableReading();
+  std::thread writer([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ASSERT_EQ(::write(fds[1], "hello", 5), 5);
+  });
+  loop.loop();
+  writer.join();
+  EXPECT_EQ(received, "hello");
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+// 2. 修改关注的事件：先等可写，再改为等可读，最后移除
+TEST_P(PollerTest, ModifyAndRemove) {
+  EventLoop loop;
+  if (!backendAvailable(loop)) {
+    GTEST_SKIP() << GetParam() << " is not available";
+  }
+  int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ASSERT_GE(fd, 0);
+  Channel channel(&loop, fd);
+  int writes = 0;
+  int reads = 0;
+  channel.setWriteCallback([&] {
+    ++writes;
+    channel.disableWriting();
+    channel.enableReading();
+    uint64_t one = 1;
+    ASSERT_EQ(::write(fd, &one, sizeof(one)), 8);
+  });
+  channel.setReadCallback([&](Timestamp) {
+    ++reads;
+    uint64_t value = 0;
+    ASSERT_EQ(::read(fd, &value, sizeof(value)), 8);
+    channel.disableAll();
+    channel.remove();
+    EXPECT_FALSE(loop.hasChannel(&channel));
+    loop.quit();
+  });
+  channel.enableWriting();
+  EXPECT_TRUE(loop.hasChannel(&channel));
+  loop.loop();
+  EXPECT_EQ(writes, 1);
+  EXPECT_EQ(reads, 1);
+  ::close(fd);
+}
+
+namespace {
+
+// 回显服务器和客户端跑在同一个后端上，服务端可选边缘触发
+void runEcho(EventLoop* loop, uint16_t port, bool edgeTriggered) {
+  InetAddress addr(port, true);
+  TcpServer server(loop, addr, "echo");
+  server.setThreadNum(1);
+  server.setEdgeTriggered(edgeTriggered);
+  server.setConnectionCallback([edgeTriggered](const TcpConnectionPtr& conn) {
+    if (conn->connected()) {
+      EXPECT_EQ(conn->edgeTriggered(), edgeTriggered);
+    }
+  });
+  server.setMessageCallback(
+      [](const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+        conn->send(buf);
+      });
+  server.start();
+
+  std::string expected;
+  for (size_t i = 0; i < (4 << 20); ++i) {
+    expected.push_back(static_cast<char>('a' + i % 26));
+  }
+  std::string received;
+  EventLoopThread clientThread;
+  TcpClient client(clientThread.startLoop(), addr, "client");
+  client.setConnectionCallback([&](const TcpConnectionPtr& conn) {
+    if (conn->connected()) {
+      conn->send(expected);
+    }
+  });
+  client.setMessageCallback(
+      [&](const TcpConnectionPtr&, Buffer* buf, Timestamp) {
+        received += buf->retrieveAllAsString();
+        if (received.size() >= expected.size()) {
+          loop->queueInLoop([loop] { loop->quit(); });
+        }
+      });
+  client.connect();
+  loop->loop();
+  EXPECT_EQ(received, expected);
+  // io_uring 上由 poller 直接收数据，服务端不调用 read
+  if (::strcmp(loop->pollerName(), "io_uring") == 0) {
+    for (EventLoop* ioLoop : server.threadPool()->getAllLoops()) {
+      EXPECT_EQ(ioLoop->stats().readCalls.load(), 0u);
+      EXPECT_GE(ioLoop->stats().bytesRead.load(), expected.size());
+    }
+  }
+  // 服务端的连接在 loop 里关闭，再跑一会儿 loop 等两端都关闭后再析构
+  client.disconnect();
+  std::thread quitter([loop] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    loop->quit();
+  });
+  loop->loop();
+  quitter.join();
+}
+
+}  // namespace
+
+// 3. 水平触发的回显
+TEST_P(PollerTest, Echo) {
+  EventLoop loop;
+  if (!backendAvailable(loop)) {
+    GTEST_SKIP() << GetParam() << " is not available";
+  }
+  runEcho(&loop, 19876, false);
+}
+
+// 4. 边缘触发的回显：读写都要一直做到 EAGAIN，否则数据会卡住
+TEST_P(PollerTest, EdgeTriggeredEcho) {
+  EventLoop loop;
+  if (!backendAvailable(loop)) {
+    GTEST_SKIP() << GetParam() << " is not available";
+  }
+  runEcho(&loop, 19877, true);
+}
+
+// 5. 边缘触发的半关闭：数据和 FIN 一起到达时只有一次通知，服务端要读到 EOF，
+// 回显之后关闭连接，客户端才能读到 EOF
+TEST_P(PollerTest, EdgeTriggeredHalfClose) {
+  EventLoop loop;
+  if (!backendAvailable(loop)) {
+    GTEST_SKIP() << GetParam() << " is not available";
+  }
+  const uint16_t kPort = 19897;
+  TcpServer server(&loop, InetAddress(kPort, true), "half-close");
+  server.setEdgeTriggered(true);
+  server.setMessageCallback(
+      [](const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+        conn->send(buf);
+      });
+  server.start();
+
+  std::string received;
+  bool eof = false;
+  std::thread client([&] {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct timeval timeout = {5, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                  sizeof(addr)) == 0 &&
+        ::write(fd, "hello", 5) == 5 && ::shutdown(fd, SHUT_WR) == 0) {
+      char buf[64];
+      ssize_t n = 0;
+      while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+        received.append(buf, static_cast<size_t>(n));
+      }
+      eof = n == 0;
+    }
+    ::close(fd);
+    loop.queueInLoop([&loop] { loop.quit(); });
+  });
+  loop.loop();
+  client.join();
+  EXPECT_EQ(received, "hello");
+  EXPECT_TRUE(eof);
+}
+
+// 6. io_uring 直接收数据：数据追加到 channel 的接收缓冲区，对端关闭时带上 eof，
+// fd 注册在固定文件表里，移除时注销
+TEST(IoUringPollerTest, ReceivesIntoChannelBuffer) {
+  EventLoop loop;
+  IoUringPoller poller(&loop);
+  if (!poller.valid() || !poller.receiveSupported()) {
+    GTEST_SKIP() << "io_uring receive is not available";
+  }
+  int fds[2];
+  ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+                         fds),
+            0);
+  Buffer buffer;
+  Channel channel(&loop, fds[0]);
+  channel.setReceiveBuffer(&buffer);
+  // 事件也注册到了 loop 自己的 poller，这里只用单独创建的 poller 等待
+  channel.enableReading();
+  poller.updateChannel(&channel);
+  EXPECT_TRUE(channel.receivedByPoller());
+  EXPECT_EQ(poller.fixedFiles(), 1u);
+
+  auto waitActive = [&] {
+    Poller::ChannelList active;
+    for (int i = 0; i < 50 && active.empty(); ++i) {
+      poller.poll(100, &active);
+    }
+    return active;
+  };
+  ASSERT_EQ(::write(fds[1], "hello", 5), 5);
+  Poller::ChannelList active = waitActive();
+  ASSERT_EQ(active.size(), 1u);
+  EXPECT_EQ(active[0], &channel);
+  EXPECT_EQ(buffer.retrieveAllAsString(), "hello");
+  Channel::Received received = channel.takeReceived();
+  EXPECT_EQ(received.bytes, 5u);
+  EXPECT_FALSE(received.eof);
+  EXPECT_EQ(poller.receivedBytes(), 5u);
+
+  ::close(fds[1]);
+  active = waitActive();
+  ASSERT_EQ(active.size(), 1u);
+  received = channel.takeReceived();
+  EXPECT_EQ(received.bytes, 0u);
+  EXPECT_TRUE(received.eof);
+
+  channel.disableAll();
+  poller.removeChannel(&channel);
+  EXPECT_FALSE(channel.receivedByPoller());
+  EXPECT_EQ(poller.fixedFiles(), 0u);
+  channel.remove();
+  ::close(fds[0]);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends,
+                         PollerTest,
+                         ::testing::Values("epoll", "io_uring"));
@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "eventloop.h"
+#include "mpsc_queue.h"
+
+using namespace starry;
+
+namespace {
+
+using Functor = std::function<void()>;
+
+// 原来 EventLoop::queueInLoop 的实现，作为对比基准
+class MutexQueue {
+ public:
+  size_t push(Functor&& cb) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.push_back(std::move(cb));
+    return pending_.size() - 1;
+  }
+  size_t drain(std::vector<Functor>* out) {
+    std::vector<Functor> functors;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      functors.swap(pending_);
+    }
+    for (Functor& f : functors) {
+      out->push_back(std::move(f));
+    }
+    return functors.size();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<Functor> pending_;
+};
+
+// producers 个线程各投递 perProducer 个任务，一个消费者线程执行，返回耗时（秒）
+template <typename Queue>
+double runContention(Queue* queue, int producers, int perProducer) {
+  const int64_t total = static_cast<int64_t>(producers) * perProducer;
+  std::atomic<int64_t> executed(0);
+  auto start = std::chrono::steady_clock::now();
+  std::thread consumer([&] {
+    std::vector<Functor> running;
+    while (executed.load(std::memory_order_relaxed) < total) {
+      queue->drain(&running);
+      for (const Functor& f : running) {
+        f();
+      }
+      running.clear();
+    }
+  });
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < perProducer; ++i) {
+        queue->push([&executed] {
+          executed.fetch_add(1, std::memory_order_relaxed);
+        });
+      }
+    });
+  }
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  consumer.join();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+}  // namespace
+
+class TaskQueuePerformanceTest : public ::testing::Test {};
+
+// 1. 环满了走溢出队列时，每个生产者的任务仍按投递顺序取出
+TEST_F(TaskQueuePerformanceTest, PerProducerOrder) {
+  const int kProducers = 4;
+  const int kPerProducer = 20000;
+  MpscQueue<Functor> queue(16);
+  std::vector<int> last(kProducers, -1);
+  bool ordered = true;
+  std::atomic<int> executed(0);
+
+  std::thread consumer([&] {
+    std::vector<Functor> running;
+    while (executed.load() < kProducers * kPerProducer) {
+      queue.drain(&running);
+      for (const Functor& f : running) {
+        f();
+      }
+      running.clear();
+    }
+  });
+  std::vector<std::thread> threads;
+  for (int p = 0; p < kProducers; ++p) {
+    threads.emplace_back([&, p] {
+      for (int i = 0; i < kPerProducer; ++i) {
+        queue.push([&, p, i] {
+          if (last[p] + 1 != i) {
+            ordered = false;
+          }
+          last[p] = i;
+          executed.fetch_add(1);
+        });
+      }
+    });
+  }
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  consumer.join();
+  EXPECT_TRUE(ordered);
+  EXPECT_EQ(queue.size(), 0u);
+}
+
+// 2. 其他线程投递的任务都会被执行，执行期间投递的任务在下一轮执行
+TEST_F(TaskQueuePerformanceTest, QueueInLoop) {
+  EventLoop loop;
+  const int kProducers = 4;
+  const int kPerProducer = 10000;
+  std::atomic<int> executed(0);
+  std::vector<std::thread> threads;
+  for (int p = 0; p < kProducers; ++p) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < kPerProducer; ++i) {
+        loop.queueInLoop([&] {
+          if (++executed == kProducers * kPerProducer) {
+            // 执行期间再投递，验证自己唤醒下一轮
+            loop.queueInLoop([&] { loop.quit(); });
+          }
+        });
+      }
+    });
+  }
+  loop.loop();
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(executed.load(), kProducers * kPerProducer);
+  EXPECT_EQ(loop.queueSize(), 0u);
+}
+
+// 3. loop 开始前在 loop 线程投递的任务：队列已经非空，其他线程再投递不会唤醒，
+// 要由 loop 自己唤醒，否则第一轮 poll 要等到超时
+TEST_F(TaskQueuePerformanceTest, QueuedBeforeLoop) {
+  EventLoop loop;
+  bool ran = false;
+  loop.queueInLoop([&] { ran = true; });
+  std::thread quitter([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    loop.queueInLoop([&] { loop.quit(); });
+  });
+  const auto start = std::chrono::steady_clock::now();
+  loop.loop();
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  quitter.join();
+  EXPECT_TRUE(ran);
+  EXPECT_LT(elapsed, std::chrono::seconds(1));
+}
+
+// 4. 多个生产者竞争时与原来的 mutex + vector 对比
+TEST_F(TaskQueuePerformanceTest, Contention) {
+  const int kPerProducer = 200000;
+  for (int producers : {1, 2, 4, 8}) {
+    MutexQueue mutexQueue;
+    MpscQueue<Functor> mpscQueue;
+    double mutexTime = runContention(&mutexQueue, producers, kPerProducer);
+    double mpscTime = runContention(&mpscQueue, producers, kPerProducer);
+    double ops = static_cast<double>(producers) * kPerProducer;
+    printf("producers=%d mutex %8.2f Mops/s  mpsc %8.2f Mops/s\n", producers,
+           ops / mutexTime / 1e6, ops / mpscTime / 1e6);
+  }
+}
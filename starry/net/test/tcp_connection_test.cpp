@@ -0,0 +1,529 @@
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "buffer.h"
+#include "buffer_pool.h"
+#include "buffer_slice.h"
+#include "eventloop.h"
+#include "inet_address.h"
+#include "loop_stats.h"
+#include "tcp_connection.h"
+#include "tcp_server.h"
+
+using namespace starry;
+
+namespace {
+
+// 阻塞式连接到本机端口，读超时 5 秒，返回 fd
+int connectTo(uint16_t port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct timeval timeout = {5, 0};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) !=
+      0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// 读满 n 个字节，超时或对端关闭时返回已经读到的部分
+std::string readExactly(int fd, size_t n) {
+  std::string data(n, '\0');
+  size_t got = 0;
+  while (got < n) {
+    ssize_t r = ::read(fd, &data[got], n - got);
+    if (r <= 0) {
+      break;
+    }
+    got += static_cast<size_t>(r);
+  }
+  data.resize(got);
+  return data;
+}
+
+// 第 i 个字节的内容，错位或丢字节都能发现
+std::string pattern(size_t n, size_t seed = 0) {
+  std::string data(n, '\0');
+  for (size_t i = 0; i < n; ++i) {
+    data[i] = static_cast<char>('a' + (seed + i) % 251 % 26);
+  }
+  return data;
+}
+
+// 内容为 data 的临时文件，返回可读的 fd，文件已经删除
+int makeFile(const std::string& data) {
+  char path[] = "/tmp/tcp_connection_test_XXXXXX";
+  int fd = ::mkstemp(path);
+  if (fd >= 0) {
+    ::unlink(path);
+    if (::write(fd, data.data(), data.size()) !=
+        static_cast<ssize_t>(data.size())) {
+      ::close(fd);
+      return -1;
+    }
+  }
+  return fd;
+}
+
+// 测试线程的 loop 上的一条服务端连接，对端是阻塞的客户端 socket
+class ServerConnection {
+ public:
+  ServerConnection(EventLoop* loop,
+                   uint16_t port,
+                   const std::function<void(TcpServer*)>& setup = nullptr)
+      : loop_(loop), server_(loop, InetAddress(port, true), "conn"), client_(-1) {
+    server_.setConnectionCallback([this](const TcpConnectionPtr& conn) {
+      if (conn->connected()) {
+        conn_ = conn;
+        loop_->quit();
+      }
+    });
+    if (setup) {
+      setup(&server_);
+    }
+    server_.start();
+    client_ = connectTo(port);
+    if (client_ >= 0) {
+      loop_->loop();  // 等 accept
+    }
+  }
+
+  // 关闭客户端，再跑一会儿 loop 让服务端的连接关闭
+  ~ServerConnection() {
+    if (client_ >= 0) {
+      ::close(client_);
+    }
+    conn_.reset();
+    runFor(0.05);
+  }
+
+  const TcpConnectionPtr& conn() const { return conn_; }
+  int client() const { return client_; }
+  LoopStats& stats() { return loop_->stats(); }
+
+  void runFor(double seconds) {
+    loop_->runAfter(seconds, [this] { loop_->quit(); });
+    loop_->loop();
+  }
+
+  // 另一个线程从客户端读 n 个字节，期间 loop 一直运行，读完后退出
+  std::string receive(size_t n) {
+    std::string data;
+    std::thread reader([this, n, &data] {
+      data = readExactly(client_, n);
+      loop_->queueInLoop([this] { loop_->quit(); });
+    });
+    loop_->loop();
+    reader.join();
+    return data;
+  }
+
+ private:
+  EventLoop* loop_;
+  TcpServer server_;
+  int client_;
+  TcpConnectionPtr conn_;
+};
+
+}  // namespace
+
+class TcpConnectionTest : public ::testing::Test {};
+
+// 1. sendv 一次 writev 发出多段，写不完的尾部留在 outputBuffer_，之后由 handleWrite 发完
+TEST_F(TcpConnectionTest, SendvPartialWriteKeepsTail) {
+  EventLoop loop;
+  ServerConnection peer(&loop, 19885);
+  ASSERT_TRUE(peer.conn());
+  const size_t kPiece = 8 << 20;
+  std::vector<std::string> pieces;
+  std::string expected;
+  for (size_t i = 0; i < 4; ++i) {
+    pieces.push_back(pattern(kPiece, i));
+    expected += pieces.back();
+  }
+  const uint64_t writes = peer.stats().writeCalls.load();
+  const uint64_t written = peer.stats().bytesWritten.load();
+  const uint64_t batched = peer.stats().batchedSends.load();
+  const uint64_t saved = peer.stats().syscallsSaved.load();
+  peer.conn()->sendv({pieces[0], pieces[1], pieces[2], pieces[3]});
+
+  // 对端还没读，32 MiB 写不进 socket，只有尾部进了缓冲区
+  const size_t queued = peer.conn()->outputBuffer()->readableBytes();
+  EXPECT_GT(queued, 0u);
+  EXPECT_LT(queued, expected.size());
+  EXPECT_EQ(peer.stats().writeCalls.load() - writes, 1u);
+  EXPECT_EQ(peer.stats().bytesWritten.load() - written, expected.size() - queued);
+  EXPECT_EQ(peer.stats().batchedSends.load() - batched, 1u);
+  EXPECT_EQ(peer.stats().syscallsSaved.load() - saved, 3u);
+
+  EXPECT_EQ(peer.receive(expected.size()), expected);
+  EXPECT_EQ(peer.conn()->outputBuffer()->readableBytes(), 0u);
+  EXPECT_EQ(peer.stats().bytesWritten.load() - written, expected.size());
+}
+
+// 2. 超过 IOV_MAX 的段：第一次 writev 只带 IOV_MAX 段，剩下的进缓冲区继续发送
+TEST_F(TcpConnectionTest, SendvClampsToIovMax) {
+  EventLoop loop;
+  ServerConnection peer(&loop, 19886);
+  ASSERT_TRUE(peer.conn());
+  const size_t kPieces = IOV_MAX + 976;
+  const size_t kPieceSize = 16;
+  const std::string expected = pattern(kPieces * kPieceSize);
+  std::vector<std::string_view> pieces;
+  for (size_t i = 0; i < kPieces; ++i) {
+    pieces.push_back(std::string_view(expected).substr(i * kPieceSize, kPieceSize));
+  }
+  const uint64_t writes = peer.stats().writeCalls.load();
+  const uint64_t batched = peer.stats().batchedSends.load();
+  const uint64_t saved = peer.stats().syscallsSaved.load();
+  peer.conn()->sendv(pieces);
+
+  EXPECT_EQ(peer.stats().writeCalls.load() - writes, 1u);
+  EXPECT_EQ(peer.stats().batchedSends.load() - batched, 1u);
+  EXPECT_EQ(peer.stats().syscallsSaved.load() - saved,
+            static_cast<uint64_t>(IOV_MAX - 1));
+  EXPECT_EQ(peer.conn()->outputBuffer()->readableBytes(),
+            (kPieces - IOV_MAX) * kPieceSize);
+
+  EXPECT_EQ(peer.receive(expected.size()), expected);
+  EXPECT_GT(peer.stats().writeCalls.load() - writes, 1u);
+}
+
+// 3. sendFile 和前后的数据按顺序到达对端，发完后调用一次 done
+TEST_F(TcpConnectionTest, SendFile) {
+  EventLoop loop;
+  ServerConnection peer(&loop, 19887);
+  ASSERT_TRUE(peer.conn());
+  const std::string content = pattern(3 << 20, 7);
+  int fd = makeFile(content);
+  ASSERT_GE(fd, 0);
+  const uint64_t fileBytes = peer.stats().fileBytesSent.load();
+  int done = 0;
+  peer.conn()->send(std::string_view("head"));
+  peer.conn()->sendFile(fd, 0, content.size(),
+                        [&done](const TcpConnectionPtr&) { ++done; });
+  peer.conn()->send(std::string_view("tail"));
+
+  EXPECT_EQ(peer.receive(content.size() + 8), "head" + content + "tail");
+  EXPECT_EQ(done, 1);
+  EXPECT_EQ(peer.stats().fileBytesSent.load() - fileBytes, content.size());
+  EXPECT_TRUE(peer.conn()->connected());
+  ::close(fd);
+}
+
+// 4. 文件比 length 短：发出已有的部分后关闭连接，done 仍然被调用
+TEST_F(TcpConnectionTest, SendFileShorterThanLength) {
+  EventLoop loop;
+  ServerConnection peer(&loop, 19888);
+  ASSERT_TRUE(peer.conn());
+  const std::string content = pattern(1000);
+  int fd = makeFile(content);
+  ASSERT_GE(fd, 0);
+  int done = 0;
+  peer.conn()->sendFile(fd, 0, 5000,
+                        [&done](const TcpConnectionPtr&) { ++done; });
+
+  EXPECT_EQ(peer.receive(content.size()), content);
+  peer.runFor(0.05);
+  EXPECT_EQ(done, 1);
+  EXPECT_TRUE(peer.conn()->disconnected());
+  ::close(fd);
+}
+
+// 5. 直接发送时 sendfile 出错：关闭连接并调用 done，调用方才能关闭 fd
+TEST_F(TcpConnectionTest, SendFileErrorCallsDone) {
+  EventLoop loop;
+  ServerConnection peer(&loop, 19889);
+  ASSERT_TRUE(peer.conn());
+  int done = 0;
+  peer.conn()->sendFile(-1, 0, 100,
+                        [&done](const TcpConnectionPtr&) { ++done; });
+
+  peer.runFor(0.05);
+  EXPECT_EQ(done, 1);
+  EXPECT_TRUE(peer.conn()->disconnected());
+}
+
+namespace {
+
+// 第 seq 条消息，首字节是发送线程，长度固定
+std::string record(int thread, int seq) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%c%07d\n", 'a' + thread, seq);
+  return buf;
+}
+
+// 检查每个线程的消息都按发送顺序到达，一条不少
+void expectPerThreadOrder(const std::string& data, int threads, int perThread) {
+  const size_t kRecord = record(0, 0).size();
+  ASSERT_EQ(data.size(), kRecord * threads * perThread);
+  std::vector<int> next(threads, 0);
+  for (size_t pos = 0; pos < data.size(); pos += kRecord) {
+    const int thread = data[pos] - 'a';
+    ASSERT_GE(thread, 0);
+    ASSERT_LT(thread, threads);
+    ASSERT_EQ(data.substr(pos, kRecord), record(thread, next[thread]));
+    ++next[thread];
+  }
+}
+
+}  // namespace
+
+// 6. 多个线程交替跨线程发送，对端看到的每个线程的消息保持各自的顺序
+TEST_F(TcpConnectionTest, CrossThreadSendOrder) {
+  EventLoop loop;
+  ServerConnection peer(&loop, 19890);
+  ASSERT_TRUE(peer.conn());
+  const int kThreads = 4;
+  const int kPerThread = 5000;
+  TcpConnectionPtr conn = peer.conn();
+  std::vector<std::thread> senders;
+  for (int t = 0; t < kThreads; ++t) {
+    senders.emplace_back([conn, t] {
+      for (int i = 0; i < kPerThread; ++i) {
+        conn->send(record(t, i));
+      }
+    });
+  }
+  const std::string data =
+      peer.receive(record(0, 0).size() * kThreads * kPerThread);
+  for (std::thread& sender : senders) {
+    sender.join();
+  }
+  expectPerThreadOrder(data, kThreads, kPerThread);
+}
+
+// 7. loop 忙的时候其他线程的发送攒在 pendingSends_，之后一次 writev 发出
+TEST_F(TcpConnectionTest, CrossThreadSendsBatched) {
+  EventLoop loop;
+  ServerConnection peer(&loop, 19891);
+  ASSERT_TRUE(peer.conn());
+  const int kThreads = 3;
+  const int kPerThread = 10;
+  TcpConnectionPtr conn = peer.conn();
+  std::atomic<bool> blocked(false);
+  std::atomic<int> finished(0);
+  // 让 loop 停在这个函数里，直到所有线程都发完
+  loop.queueInLoop([&] {
+    blocked = true;
+    while (finished < kThreads) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+  std::vector<std::thread> senders;
+  for (int t = 0; t < kThreads; ++t) {
+    senders.emplace_back([&, t] {
+      while (!blocked) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      for (int i = 0; i < kPerThread; ++i) {
+        conn->send(record(t, i));
+      }
+      ++finished;
+    });
+  }
+  const uint64_t writes = peer.stats().writeCalls.load();
+  const uint64_t saved = peer.stats().syscallsSaved.load();
+  const std::string data =
+      peer.receive(record(0, 0).size() * kThreads * kPerThread);
+  for (std::thread& sender : senders) {
+    sender.join();
+  }
+  expectPerThreadOrder(data, kThreads, kPerThread);
+  EXPECT_EQ(peer.stats().writeCalls.load() - writes, 1u);
+  EXPECT_EQ(peer.stats().syscallsSaved.load() - saved,
+            static_cast<uint64_t>(kThreads * kPerThread - 1));
+}
+
+// 8. 自动合并写：同一轮里的多次 send 只有一次写系统调用
+TEST_F(TcpConnectionTest, AutoCorkCoalescesSends) {
+  EventLoop loop;
+  ServerConnection peer(&loop, 19892,
+                        [](TcpServer* server) { server->setAutoCork(true); });
+  ASSERT_TRUE(peer.conn());
+  const int kSends = 10;
+  std::string expected;
+  for (int i = 0; i < kSends; ++i) {
+    expected += record(0, i);
+  }
+  const uint64_t writes = peer.stats().writeCalls.load();
+  const uint64_t corked = peer.stats().corkedSends.load();
+  const uint64_t flushes = peer.stats().corkFlushes.load();
+  TcpConnectionPtr conn = peer.conn();
+  loop.queueInLoop([conn, kSends] {
+    for (int i = 0; i < kSends; ++i) {
+      conn->send(record(0, i));
+    }
+  });
+
+  EXPECT_EQ(peer.receive(expected.size()), expected);
+  EXPECT_EQ(peer.stats().writeCalls.load() - writes, 1u);
+  EXPECT_EQ(peer.stats().corkedSends.load() - corked,
+            static_cast<uint64_t>(kSends));
+  EXPECT_EQ(peer.stats().corkFlushes.load() - flushes, 1u);
+}
+
+// 9. 攒下的数据在 loop 阻塞之前写出：定时器回调里的 send，
+// 以及本轮结束函数里再 send 的数据，都不用等下一次唤醒
+TEST_F(TcpConnectionTest, AutoCorkFlushesBeforeBlocking) {
+  EventLoop loop;
+  ServerConnection peer(&loop, 19893,
+                        [](TcpServer* server) { server->setAutoCork(true); });
+  ASSERT_TRUE(peer.conn());
+  TcpConnectionPtr conn = peer.conn();
+  loop.runAfter(0.01, [&loop, conn] {
+    conn->send(std::string_view("timer"));
+    loop.runAtIterationEnd([conn] { conn->send(std::string_view("-end")); });
+  });
+
+  // 没有及时写出的话 poll 要阻塞到超时，读会先超时
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(peer.receive(9), "timer-end");
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+}
+
+namespace {
+
+// 从 pool 申请存储的切片，pool 为空时直接 new
+BufferSlice makeSlice(const std::string& data, BufferPool* pool = nullptr) {
+  Buffer buf(pool);
+  buf.append(data);
+  return buf.retrieveAllAsSlice();
+}
+
+// 开启零拷贝的服务端，不支持 SO_ZEROCOPY 的内核上跳过
+#define SKIP_WITHOUT_ZEROCOPY(peer)                       \
+  if (!(peer).conn()->zeroCopy()) {                       \
+    GTEST_SKIP() << "SO_ZEROCOPY is not supported";       \
+  }
+
+}  // namespace
+
+// 10. 小于阈值的切片普通发送，不小于阈值的才用 MSG_ZEROCOPY
+TEST_F(TcpConnectionTest, ZeroCopyThreshold) {
+  EventLoop loop;
+  const size_t kThreshold = 64 * 1024;
+  ServerConnection peer(&loop, 19894, [kThreshold](TcpServer* server) {
+    server->setZeroCopy(true, kThreshold);
+  });
+  ASSERT_TRUE(peer.conn());
+  SKIP_WITHOUT_ZEROCOPY(peer);
+  const uint64_t sends = peer.stats().zeroCopySends.load();
+  const std::string small = pattern(kThreshold - 1, 1);
+  peer.conn()->send(makeSlice(small));
+  EXPECT_EQ(peer.receive(small.size()), small);
+  EXPECT_EQ(peer.stats().zeroCopySends.load() - sends, 0u);
+
+  const std::string large = pattern(kThreshold, 2);
+  peer.conn()->send(makeSlice(large));
+  EXPECT_EQ(peer.receive(large.size()), large);
+  EXPECT_GE(peer.stats().zeroCopySends.load() - sends, 1u);
+}
+
+// 11. 零拷贝发出的切片离开发送缓冲区后仍然被持有，内核的完成通知到了才释放
+TEST_F(TcpConnectionTest, ZeroCopyPinsUntilCompletion) {
+  EventLoop loop;
+  ServerConnection peer(&loop, 19895,
+                        [](TcpServer* server) { server->setZeroCopy(true); });
+  ASSERT_TRUE(peer.conn());
+  SKIP_WITHOUT_ZEROCOPY(peer);
+  auto pool = std::make_shared<BufferPool>();
+  const std::string data = pattern(TcpConnection::kDefaultZeroCopyThreshold, 3);
+  const uint64_t sends = peer.stats().zeroCopySends.load();
+  const uint64_t completions = peer.stats().zeroCopyCompletions.load();
+  peer.conn()->send(makeSlice(data, pool.get()));
+
+  // 数据已经交给内核，还没有处理完成通知，存储不能还给 pool
+  ASSERT_EQ(peer.stats().zeroCopySends.load() - sends, 1u);
+  EXPECT_EQ(peer.conn()->outputBuffer()->readableBytes(), 0u);
+  EXPECT_GE(pool->stats().bytesInUse, data.size());
+
+  EXPECT_EQ(peer.receive(data.size()), data);
+  for (int i = 0; i < 100 && peer.stats().zeroCopyCompletions.load() ==
+                                 completions;
+       ++i) {
+    peer.runFor(0.01);
+  }
+  EXPECT_EQ(peer.stats().zeroCopyCompletions.load() - completions, 1u);
+  EXPECT_EQ(pool->stats().bytesInUse, 0u);
+}
+
+// 12. 回环上内核总是拷贝，连续 kZeroCopyCopiedLimit 次 COPIED 之后退回普通发送；
+// 退回之后到达的通知也要读掉
+TEST_F(TcpConnectionTest, ZeroCopyFallsBackWhenCopied) {
+  EventLoop loop;
+  ServerConnection peer(&loop, 19896,
+                        [](TcpServer* server) { server->setZeroCopy(true); });
+  ASSERT_TRUE(peer.conn());
+  SKIP_WITHOUT_ZEROCOPY(peer);
+  const int kSends = TcpConnection::kZeroCopyCopiedLimit * 2;
+  const size_t kSize = TcpConnection::kDefaultZeroCopyThreshold;
+  const uint64_t copied = peer.stats().zeroCopyCopied.load();
+  std::string expected;
+  for (int i = 0; i < kSends; ++i) {
+    expected += pattern(kSize, i);
+  }
+  // 每轮发一个，各自一次 sendmsg
+  TcpConnectionPtr conn = peer.conn();
+  int sent = 0;
+  TimerId timer = loop.runEvery(0.002, [conn, &sent, kSends, kSize] {
+    if (sent < kSends) {
+      conn->send(makeSlice(pattern(kSize, sent)));
+      ++sent;
+    }
+  });
+  EXPECT_EQ(peer.receive(expected.size()), expected);
+  loop.cancel(timer);
+  for (int i = 0; i < 100 && peer.stats().zeroCopyCompletions.load() <
+                                 peer.stats().zeroCopySends.load();
+       ++i) {
+    peer.runFor(0.01);
+  }
+
+  EXPECT_FALSE(conn->zeroCopy());
+  EXPECT_GE(peer.stats().zeroCopyCopied.load() - copied,
+            static_cast<uint64_t>(TcpConnection::kZeroCopyCopiedLimit));
+  EXPECT_EQ(peer.stats().zeroCopyCompletions.load(),
+            peer.stats().zeroCopySends.load());
+}
+
+// 13. 空的 sendv 不写 fd，也不通知写完成
+TEST_F(TcpConnectionTest, EmptySendvIsNoop) {
+  EventLoop loop;
+  ServerConnection peer(&loop, 19898);
+  ASSERT_TRUE(peer.conn());
+  int completes = 0;
+  peer.conn()->setWriteCompleteCallback(
+      [&completes](const TcpConnectionPtr&) { ++completes; });
+  const uint64_t writes = peer.stats().writeCalls.load();
+  peer.conn()->sendv(std::span<const std::string_view>());
+  peer.conn()->sendv(std::span<const BufferSlice>());
+  peer.conn()->sendv({std::string_view(), std::string_view()});
+  peer.runFor(0.01);
+  EXPECT_EQ(peer.stats().writeCalls.load() - writes, 0u);
+  EXPECT_EQ(completes, 0);
+
+  peer.conn()->sendv({"ab", "cd"});
+  EXPECT_EQ(peer.receive(4), "abcd");
+  EXPECT_EQ(completes, 1);
+}
@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "eventloop.h"
+#include "eventloop_threadpool.h"
+#include "thread_placement.h"
+
+using namespace starry;
+
+namespace {
+
+// 8 个 CPU，4 个物理核，2 个节点：cpu i 和 i+4 是同一个核的超线程
+CpuTopology fakeTopology() {
+  CpuTopology topology;
+  for (int cpu = 0; cpu < 8; ++cpu) {
+    topology.cpus.push_back(CpuTopology::Cpu{cpu, cpu % 4, cpu % 4 / 2});
+  }
+  topology.numNodes = 2;
+  return topology;
+}
+
+}  // namespace
+
+class ThreadPlacementTest : public ::testing::Test {};
+
+// 1. CPU 列表的解析
+TEST_F(ThreadPlacementTest, ParseCpuList) {
+  EXPECT_EQ(CpuTopology::parseCpuList("0-3,8,10-11\n"),
+            (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+  EXPECT_EQ(CpuTopology::parseCpuList("5,1,1"), (std::vector<int>{1, 5}));
+  EXPECT_TRUE(CpuTopology::parseCpuList("").empty());
+
+  CpuTopology topology = CpuTopology::load();
+  EXPECT_FALSE(topology.cpus.empty());
+  EXPECT_GE(topology.numNodes, 1);
+}
+
+// 2. 三种策略的分配结果，线程多于核或节点时循环
+TEST_F(ThreadPlacementTest, Assign) {
+  CpuTopology topology = fakeTopology();
+
+  auto slots = ThreadPlacement::cpuList({6, 1}).assign(3, topology);
+  ASSERT_EQ(slots.size(), 3u);
+  EXPECT_EQ(slots[0].cpus, std::vector<int>{6});
+  EXPECT_EQ(slots[0].node, 1);
+  EXPECT_EQ(slots[1].cpus, std::vector<int>{1});
+  EXPECT_EQ(slots[1].node, 0);
+  EXPECT_EQ(slots[2].cpus, std::vector<int>{6});
+
+  slots = ThreadPlacement::perCore().assign(5, topology);
+  EXPECT_EQ(slots[0].cpus, (std::vector<int>{0, 4}));
+  EXPECT_EQ(slots[2].cpus, (std::vector<int>{2, 6}));
+  EXPECT_EQ(slots[2].node, 1);
+  EXPECT_EQ(slots[4].cpus, (std::vector<int>{0, 4}));
+
+  slots = ThreadPlacement::numaLocal().assign(3, topology);
+  EXPECT_EQ(slots[0].cpus, (std::vector<int>{0, 1, 4, 5}));
+  EXPECT_EQ(slots[0].node, 0);
+  EXPECT_EQ(slots[1].cpus, (std::vector<int>{2, 3, 6, 7}));
+  EXPECT_EQ(slots[1].node, 1);
+  EXPECT_EQ(slots[2].node, 0);
+
+  // 单节点不设置内存策略，不指定策略不绑核
+  topology.numNodes = 1;
+  EXPECT_EQ(ThreadPlacement::perCore().assign(1, topology)[0].node, -1);
+  slots = ThreadPlacement().assign(2, topology);
+  EXPECT_TRUE(slots[1].cpus.empty());
+  EXPECT_EQ(slots[1].node, -1);
+}
+
+// 3. 线程池的 loop 线程绑定到指定 CPU，线程名来自线程池的名字
+TEST_F(ThreadPlacementTest, PoolPinsAndNamesThreads) {
+  const int cpu = CpuTopology::load().cpus.back().id;
+  EventLoop baseLoop;
+  EventLoopThreadPool pool(&baseLoop, "placed");
+  pool.setThreadNum(2);
+  pool.setPlacement(ThreadPlacement::cpuList({cpu}));
+  pool.start();
+
+  std::vector<EventLoop*> loops = pool.getAllLoops();
+  ASSERT_EQ(loops.size(), 2u);
+  for (size_t i = 0; i < loops.size(); ++i) {
+    std::atomic<bool> done(false);
+    int runningOn = -1;
+    char name[16] = {0};
+    loops[i]->runInLoop([&] {
+      runningOn = ::sched_getcpu();
+      ::pthread_getname_np(::pthread_self(), name, sizeof(name));
+      done = true;
+    });
+    while (!done) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(runningOn, cpu);
+    EXPECT_STREQ(name, ("placed" + std::to_string(i)).c_str());
+  }
+}
+
+// 4. 同一个 CPU 上的几个 loop 之间轮询，不影响 selectLoop 的轮询位置
+TEST_F(ThreadPlacementTest, LoopForCpuKeepsSelectorState) {
+  const int cpu = CpuTopology::load().cpus.back().id;
+  EventLoop baseLoop;
+  EventLoopThreadPool pool(&baseLoop, "pinned");
+  pool.setThreadNum(2);
+  pool.setPlacement(ThreadPlacement::cpuList({cpu}));
+  pool.start();
+
+  std::vector<EventLoop*> loops = pool.getAllLoops();
+  ASSERT_EQ(loops.size(), 2u);
+  EXPECT_EQ(pool.loopForCpu(cpu + 1, 0), nullptr);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(pool.selectLoop(0), loops[i % 2]);
+    EXPECT_EQ(pool.loopForCpu(cpu, 0), loops[i % 2]);
+  }
+
+  // 哈希策略在绑定的 loop 里也按 hashCode 取模
+  pool.setSelector(LoopSelector::newHash());
+  EXPECT_EQ(pool.loopForCpu(cpu, 3), loops[1]);
+  EXPECT_EQ(pool.loopForCpu(cpu, 3), loops[1]);
+}
@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "eventloop.h"
+#include "eventloop_thread.h"
+
+using namespace starry;
+
+class TimerTest : public ::testing::Test {};
+
+// 1. 最后一个定时器触发后 timerfd 不再设置，loop 可以正常退出
+TEST_F(TimerTest, RunAfterFiresOnce) {
+  EventLoop loop;
+  int fired = 0;
+  const MonoTime start = MonoClock::now();
+  loop.runAfter(0.02, [&] {
+    ++fired;
+    loop.quit();
+  });
+  loop.loop();
+  EXPECT_EQ(fired, 1);
+  EXPECT_GE(MonoClock::now() - start, std::chrono::milliseconds(20));
+}
+
+// 2. 重复定时器按秒数的间隔触发，取消后不再触发
+TEST_F(TimerTest, RunEveryInterval) {
+  EventLoop loop;
+  std::vector<MonoTime> fires;
+  TimerId every = loop.runEvery(0.01, [&] { fires.push_back(loop.now()); });
+  loop.runAfter(0.105, [&] {
+    loop.cancel(every);
+    loop.runAfter(0.05, [&] { loop.quit(); });
+  });
+  loop.loop();
+  ASSERT_GE(fires.size(), 8u);
+  EXPECT_LE(fires.size(), 10u);
+  for (size_t i = 1; i < fires.size(); ++i) {
+    EXPECT_GE(fires[i] - fires[i - 1], std::chrono::milliseconds(9));
+  }
+}
+
+// 3. 同一轮里 now() 不变，refreshNow() 读新的时间
+TEST_F(TimerTest, CachedClock) {
+  EventLoop loop;
+  loop.runAfter(0.001, [&] {
+    const MonoTime cached = loop.now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_EQ(loop.now(), cached);
+    const MonoTime fresh = loop.refreshNow();
+    EXPECT_GE(fresh - cached, std::chrono::milliseconds(5));
+    EXPECT_EQ(loop.now(), fresh);
+    loop.quit();
+  });
+  loop.loop();
+}
+
+// 4. 粗粒度时钟下定时器照常触发，缓存的时间不早于设置的到期时间
+TEST_F(TimerTest, CoarseClock) {
+  EventLoopThread thread;
+  EventLoop* loop = thread.startLoop();
+  loop->setCoarseClock(true);
+  EXPECT_TRUE(loop->coarseClock());
+  std::atomic<int> fired(0);
+  for (int i = 1; i <= 5; ++i) {
+    loop->runAfter(0.002 * i, [&fired] { fired.fetch_add(1); });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(fired.load(), 5);
+}
+
+// 5. 到期时间向上取整到 tick：触发时缓存的时间不早于到期时间所在 tick 的终点
+TEST_F(TimerTest, Resolution) {
+  EventLoop loop;
+  const auto tick = std::chrono::milliseconds(10);
+  loop.setTimerResolution(tick);
+  std::vector<std::pair<MonoTime, MonoTime>> fires;  // 到期时间，触发时间
+  for (int i = 1; i <= 3; ++i) {
+    const MonoTime when = MonoClock::now() + std::chrono::milliseconds(3 * i);
+    loop.runAt(when, [&loop, &fires, when] {
+      fires.emplace_back(when, loop.now());
+    });
+  }
+  loop.runAfter(0.05, [&] { loop.quit(); });
+  loop.loop();
+
+  ASSERT_EQ(fires.size(), 3u);
+  for (const auto& fire : fires) {
+    const auto ns = fire.first.time_since_epoch();
+    const auto roundedUp = (ns + tick - std::chrono::nanoseconds(1)) / tick * tick;
+    EXPECT_GE(fire.second.time_since_epoch(), roundedUp);
+  }
+}
+
+// 6. 同一批到期的定时器，先执行的取消了后面的，后面的不再执行；
+// 其他线程添加后马上取消的定时器不会触发
+TEST_F(TimerTest, CancelPendingAndCrossThread) {
+  EventLoopThread thread;
+  EventLoop* loop = thread.startLoop();
+  std::atomic<int> first(0);
+  std::atomic<int> second(0);
+  std::atomic<int> crossThread(0);
+  std::atomic<bool> done(false);
+  TimerId later;
+  loop->runInLoop([&] {
+    const MonoTime when = loop->now() + std::chrono::milliseconds(5);
+    loop->runAt(when, [&] {
+      ++first;
+      loop->cancel(later);
+    });
+    later = loop->runAt(when, [&] { ++second; });
+  });
+
+  TimerId id = loop->runAfter(0.02, [&] { ++crossThread; });
+  loop->cancel(id);
+  loop->runAfter(0.04, [&] { done = true; });
+  while (!done) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(first.load(), 1);
+  EXPECT_EQ(second.load(), 0);
+  EXPECT_EQ(crossThread.load(), 0);
+}
+
+// 7. 每隔 2 毫秒到期一个定时器：不允许推迟时分别唤醒，
+// slack 覆盖全部到期时间时一次唤醒、设置一次 timerfd，而且都不会提前触发
+TEST_F(TimerTest, SlackCoalescesWakeups) {
+  for (int slackMs : {0, 30}) {
+    EventLoop loop;
+    loop.setTimerSlack(std::chrono::milliseconds(slackMs));
+    const LoopStats& stats = loop.stats();
+    uint64_t wakeups = 0;
+    uint64_t settimes = 0;
+    int early = 0;
+    const int kTimers = 10;
+    loop.runAfter(0.001, [&] {
+      const uint64_t wakeupsBefore = stats.timerWakeups.load();
+      const uint64_t settimesBefore = stats.timerfdSettimes.load();
+      const MonoTime base = loop.now();
+      for (int i = 1; i <= kTimers; ++i) {
+        const MonoTime when = base + std::chrono::milliseconds(2 * i);
+        loop.runAt(when, [&, i, when, wakeupsBefore, settimesBefore] {
+          early += loop.now() < when;
+          if (i == kTimers) {
+            wakeups = stats.timerWakeups.load() - wakeupsBefore;
+            settimes = stats.timerfdSettimes.load() - settimesBefore;
+            loop.quit();
+          }
+        });
+      }
+    });
+    WakeupRateMeter meter(stats);
+    loop.loop();
+    WakeupRateMeter::Rates rates = meter.sample();
+    printf("slack %d ms: %lu timer wakeups, %lu timerfd_settime, "
+           "%.0f wakeups/s %.0f settime/s\n",
+           slackMs, wakeups, settimes, rates.timerWakeups, rates.timerfdSettimes);
+    EXPECT_EQ(early, 0);
+    if (slackMs == 0) {
+      EXPECT_GE(wakeups, 2u);
+    } else {
+      EXPECT_EQ(wakeups, 1u);
+      EXPECT_LE(settimes, 1u);
+    }
+  }
+}
+
+// 8. 过期的 TimerId 不会取消复用了同一个槽位的新定时器，
+// 别的 loop 的 TimerId 也不会取消本 loop 的定时器
+TEST_F(TimerTest, StaleAndForeignTimerIds) {
+  EventLoopThread threadA;
+  EventLoopThread threadB;
+  EventLoop* loopA = threadA.startLoop();
+  EventLoop* loopB = threadB.startLoop();
+  std::atomic<int> fired(0);
+  std::atomic<int> done(0);
+
+  TimerId stale = loopA->runAfter(0.01, [&] { ++fired; });
+  loopA->cancel(stale);
+  loopA->runAfter(0.01, [&] { ++fired; });
+  loopA->cancel(stale);
+
+  TimerId foreign = loopB->runAfter(0.01, [&] { ++fired; });
+  loopA->cancel(foreign);
+
+  loopA->runAfter(0.04, [&] { ++done; });
+  loopB->runAfter(0.04, [&] { ++done; });
+  while (done < 2) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(fired.load(), 2);
+}
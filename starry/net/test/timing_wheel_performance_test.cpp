@@ -0,0 +1,295 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+#include "eventloop.h"
+#include "timer.h"
+#include "timer_pool.h"
+#include "timing_wheel.h"
+
+using namespace starry;
+
+namespace {
+
+double elapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// xorshift64，两边用同样的序列
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state_(seed | 1) {}
+  uint64_t next() {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 7;
+    state_ ^= state_ << 17;
+    return state_;
+  }
+
+ private:
+  uint64_t state_;
+};
+
+// 原来 TimerQueue 的做法：按到期时间排序的 set，取消用按指针查找的 set，
+// 每个定时器单独 new
+class SetTimers {
+ public:
+  SetTimers() : sequence_(0) {}
+  ~SetTimers() {
+    for (const Entry& entry : timers_) {
+      delete entry.second;
+    }
+  }
+
+  std::pair<Timer*, int64_t> add(TimerCallback cb, MonoTime when) {
+    Timer* timer = new Timer();
+    timer->init(std::move(cb), when, 0.0, ++sequence_);
+    timers_.insert(Entry(when, timer));
+    active_.insert(ActiveTimer(timer, sequence_));
+    return {timer, sequence_};
+  }
+
+  void cancel(Timer* timer, int64_t sequence) {
+    auto it = active_.find(ActiveTimer(timer, sequence));
+    if (it != active_.end()) {
+      timers_.erase(Entry(timer->expiration(), timer));
+      active_.erase(it);
+      delete timer;
+    }
+  }
+
+  // 执行 now 之前到期的定时器
+  size_t expire(MonoTime now) {
+    Entry sentry(now, reinterpret_cast<Timer*>(UINTPTR_MAX));
+    auto end = timers_.lower_bound(sentry);
+    std::vector<Entry> expired(timers_.begin(), end);
+    timers_.erase(timers_.begin(), end);
+    for (const Entry& entry : expired) {
+      active_.erase(ActiveTimer(entry.second, entry.second->sequence()));
+      entry.second->run();
+      delete entry.second;
+    }
+    return expired.size();
+  }
+
+  size_t size() const { return timers_.size(); }
+
+ private:
+  using Entry = std::pair<MonoTime, Timer*>;
+  using ActiveTimer = std::pair<Timer*, int64_t>;
+
+  std::set<Entry> timers_;
+  std::set<ActiveTimer> active_;
+  int64_t sequence_;
+};
+
+// TimerQueue 的做法：池里取定时器，放进时间轮
+class WheelTimers {
+ public:
+  explicit WheelTimers(std::chrono::nanoseconds tick)
+      : wheel_(tick), sequence_(0) {}
+
+  std::pair<Timer*, int64_t> add(TimerCallback cb, MonoTime when) {
+    Timer* timer = pool_.allocate();
+    timer->init(std::move(cb), when, 0.0, ++sequence_);
+    wheel_.insert(timer);
+    return {timer, sequence_};
+  }
+
+  void cancel(Timer* timer, int64_t sequence) {
+    if (timer->sequence() == sequence && TimingWheel::contains(timer)) {
+      wheel_.remove(timer);
+      pool_.release(timer);
+    }
+  }
+
+  size_t expire(MonoTime now) {
+    expired_.clear();
+    wheel_.expire(now, &expired_);
+    for (Timer* timer : expired_) {
+      timer->run();
+      pool_.release(timer);
+    }
+    return expired_.size();
+  }
+
+  size_t size() const { return wheel_.size(); }
+
+ private:
+  TimerPool pool_;
+  TimingWheel wheel_;
+  std::vector<Timer*> expired_;
+  int64_t sequence_;
+};
+
+// 依次添加 n 个定时器，取消一半，再把时间往后推到全部到期
+template <typename Timers>
+void runBenchmark(Timers* timers,
+                  size_t n,
+                  MonoTime base,
+                  double* addNs,
+                  double* cancelNs,
+                  double* expireNs,
+                  size_t* fired) {
+  const int64_t kSpanMs = 60 * 1000;
+  Random random(88172645463325252ull);
+  std::vector<std::pair<Timer*, int64_t>> ids(n);
+  size_t calls = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n; ++i) {
+    MonoTime when = base + std::chrono::microseconds(
+                               1000 + random.next() % (kSpanMs * 1000));
+    ids[i] = timers->add([&calls] { ++calls; }, when);
+  }
+  *addNs = elapsedMs(start) * 1e6 / n;
+
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n; i += 2) {
+    size_t index = random.next() % n;
+    timers->cancel(ids[index].first, ids[index].second);
+  }
+  *cancelNs = elapsedMs(start) * 1e6 / (n / 2);
+  const size_t live = timers->size();
+
+  // loop 每 10 毫秒醒一次
+  start = std::chrono::steady_clock::now();
+  for (int64_t ms = 0; ms <= kSpanMs + 10; ms += 10) {
+    timers->expire(base + std::chrono::milliseconds(ms));
+  }
+  *expireNs = elapsedMs(start) * 1e6 / std::max<size_t>(live, 1);
+  *fired = calls;
+  EXPECT_EQ(calls, live);
+  EXPECT_EQ(timers->size(), 0u);
+}
+
+}  // namespace
+
+class TimingWheelPerformanceTest : public ::testing::Test {};
+
+// 1. 和 set 实现比较：到期时间是 tick 的整数倍时，每次推进时间到期的定时器完全相同，
+// 时间轮按到期时间的顺序给出；跨度从毫秒到几天，覆盖多层的降级
+TEST_F(TimingWheelPerformanceTest, MatchesSet) {
+  const auto tick = std::chrono::milliseconds(1);
+  WheelTimers wheel(tick);
+  SetTimers set;
+  const MonoTime base =
+      MonoTime(std::chrono::duration_cast<MonoClock::duration>(
+          (MonoClock::now().time_since_epoch() / tick + 1) * tick));
+  Random random(12345);
+  std::vector<int> wheelFired;
+  std::vector<int> setFired;
+  std::vector<std::pair<Timer*, int64_t>> wheelIds;
+  std::vector<std::pair<Timer*, int64_t>> setIds;
+  std::vector<MonoTime> whenOf;
+
+  MonoTime now = base;
+  int nextId = 0;
+  const int64_t spans[] = {100, 10 * 1000, 3600 * 1000, 3 * 86400 * 1000LL};
+  for (int round = 0; round < 2000; ++round) {
+    for (int i = 0; i < 20; ++i) {
+      const int64_t span = spans[random.next() % 4];
+      // 已经到期的定时器时间轮放到下一个 tick，这里至少晚一个 tick
+      const MonoTime when =
+          now + std::chrono::milliseconds(
+                    1 + random.next() % static_cast<uint64_t>(span));
+      const int id = nextId++;
+      whenOf.push_back(when);
+      wheelIds.push_back(wheel.add([&wheelFired, id] { wheelFired.push_back(id); },
+                                   when));
+      setIds.push_back(set.add([&setFired, id] { setFired.push_back(id); }, when));
+    }
+    for (int i = 0; i < 5; ++i) {
+      const size_t index = random.next() % wheelIds.size();
+      wheel.cancel(wheelIds[index].first, wheelIds[index].second);
+      set.cancel(setIds[index].first, setIds[index].second);
+    }
+    // 大多数时候小步推进，偶尔跳过几个小时
+    const int64_t step = random.next() % 10 == 0
+                             ? static_cast<int64_t>(random.next() % (6 * 3600 * 1000))
+                             : static_cast<int64_t>(random.next() % 50);
+    now += std::chrono::milliseconds(step);
+
+    wheelFired.clear();
+    setFired.clear();
+    wheel.expire(now);
+    set.expire(now);
+    for (size_t i = 1; i < wheelFired.size(); ++i) {
+      EXPECT_LE(whenOf[wheelFired[i - 1]], whenOf[wheelFired[i]]);
+    }
+    std::sort(wheelFired.begin(), wheelFired.end());
+    std::sort(setFired.begin(), setFired.end());
+    ASSERT_EQ(wheelFired, setFired) << "round " << round;
+    ASSERT_EQ(wheel.size(), set.size());
+  }
+  now += std::chrono::hours(24 * 4);
+  wheel.expire(now);
+  set.expire(now);
+  EXPECT_EQ(wheel.size(), 0u);
+  EXPECT_EQ(set.size(), 0u);
+}
+
+// 2. 添加、取消一半、全部到期，1 万和 100 万个定时器；
+// 设置 STARRY_TIMER_BENCH_LARGE 时再跑 1000 万个，需要 3 GB 左右的内存
+TEST_F(TimingWheelPerformanceTest, WheelVersusSet) {
+  std::vector<size_t> counts{10000, 1000000};
+  if (::getenv("STARRY_TIMER_BENCH_LARGE")) {
+    counts.push_back(10000000);
+  }
+  for (size_t n : counts) {
+    const MonoTime base = MonoClock::now();
+    double add[2], cancel[2], expire[2];
+    size_t fired[2];
+    {
+      WheelTimers wheel(std::chrono::milliseconds(1));
+      runBenchmark(&wheel, n, base, &add[0], &cancel[0], &expire[0], &fired[0]);
+    }
+    {
+      SetTimers set;
+      runBenchmark(&set, n, base, &add[1], &cancel[1], &expire[1], &fired[1]);
+    }
+    printf("%8zu timers: add wheel %6.1f ns  set %6.1f ns | "
+           "cancel wheel %6.1f ns  set %6.1f ns | "
+           "expire wheel %6.1f ns  set %6.1f ns\n",
+           n, add[0], add[1], cancel[0], cancel[1], expire[0], expire[1]);
+    EXPECT_EQ(fired[0], fired[1]);
+  }
+}
+
+// 3. 经过 EventLoop：10 万个定时器，取消一半，其余都在到期之后触发
+TEST_F(TimingWheelPerformanceTest, LoopFiresAll) {
+  const int kTimers = 100000;
+  EventLoop loop;
+  Random random(99);
+  std::vector<TimerId> ids;
+  int fired = 0;
+  int early = 0;
+  const MonoTime base = MonoClock::now();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kTimers; ++i) {
+    const MonoTime when =
+        base + std::chrono::microseconds(1000 + random.next() % 200000);
+    ids.push_back(loop.runAt(when, [&loop, &fired, &early, when] {
+      ++fired;
+      early += loop.now() < when;
+    }));
+  }
+  for (int i = 0; i < kTimers; i += 2) {
+    loop.cancel(ids[i]);
+  }
+  const double scheduleMs = elapsedMs(start);
+  loop.runAfter(0.3, [&loop] { loop.quit(); });
+  loop.loop();
+  printf("%d timers through EventLoop: add + cancel half %.1f ms\n", kTimers,
+         scheduleMs);
+  EXPECT_EQ(fired, kTimers / 2);
+  EXPECT_EQ(early, 0);
+}